@@ -36,6 +36,8 @@
 using namespace Contactsd;
 using namespace ML10N;
 
+static DebugCategory logCategory("birthday");
+
 // A random ID.
 const QLatin1String calNotebookId("b1376da7-5555-1111-2222-227549c4e570");
 const QLatin1String calNotebookColor("#e00080"); // Pink
@@ -91,7 +93,7 @@ CDBirthdayCalendar::~CDBirthdayCalendar()
         mStorage->close();
     }
 
-    debug() << "Destroyed birthday calendar";
+    debug(logCategory) << "Destroyed birthday calendar";
 }
 
 mKCal::Notebook::Ptr CDBirthdayCalendar::createNotebook()
@@ -114,7 +116,7 @@ QHash<CDBirthdayCalendar::ContactIdType, CalendarBirthday>
 CDBirthdayCalendar::birthdays()
 {
     if (not mStorage->loadNotebookIncidences(calNotebookId)) {
-        warning() << Q_FUNC_INFO << "Failed to load all incidences";
+        warning(logCategory) << Q_FUNC_INFO << "Failed to load all incidences";
         return QHash<ContactIdType, CalendarBirthday>();
     }
 
@@ -131,7 +133,7 @@ CDBirthdayCalendar::birthdays()
 #endif
             result.insert(contactId, CalendarBirthday(event->dtStart().date(), event->summary()));
         } else {
-            warning() << Q_FUNC_INFO << "Birthday event with a bad uid: " << eventUid;
+            warning(logCategory) << Q_FUNC_INFO << "Birthday event with a bad uid: " << eventUid;
         }
     }
 
@@ -155,14 +157,14 @@ void CDBirthdayCalendar::updateBirthday(const QContact &contact)
     const QDate contactBirthday = contact.detail<QContactBirthday>().date();
 
     if (displayLabel.isEmpty() || contactBirthday.isNull()) {
-        warning() << Q_FUNC_INFO << "Contact without name or birthday, local ID: "
+        warning(logCategory) << Q_FUNC_INFO << "Contact without name or birthday, local ID: "
                   << contactId(contact);
         return;
     }
 
     // Retrieve birthday event.
     if (not mStorage->isValidNotebook(calNotebookId)) {
-        warning() << Q_FUNC_INFO << "Invalid notebook ID: " << calNotebookId;
+        warning(logCategory) << Q_FUNC_INFO << "Invalid notebook ID: " << calNotebookId;
         return;
     }
 
@@ -179,7 +181,7 @@ void CDBirthdayCalendar::updateBirthday(const QContact &contact)
         event->setCategories(QStringList() << QLatin1String("BIRTHDAY"));
 
         if (not mCalendar->addEvent(event, calNotebookId)) {
-            warning() << Q_FUNC_INFO << "Failed to add event to calendar";
+            warning(logCategory) << Q_FUNC_INFO << "Failed to add event to calendar";
             return;
         }
     } else {
@@ -253,7 +255,7 @@ void CDBirthdayCalendar::updateBirthday(const QContact &contact)
     event->setReadOnly(true);
     event->endUpdates();
 
-    debug() << "Updated birthday event in calendar, local ID: " << contactId(contact);
+    debug(logCategory) << "Updated birthday event in calendar, local ID: " << contactId(contact);
 }
 
 void CDBirthdayCalendar::deleteBirthday(ContactIdType contactId)
@@ -261,19 +263,19 @@ void CDBirthdayCalendar::deleteBirthday(ContactIdType contactId)
     KCalCore::Event::Ptr event = calendarEvent(contactId);
 
     if (event.isNull()) {
-        debug() << Q_FUNC_INFO << "Not found in calendar:" << contactId;
+        debug(logCategory) << Q_FUNC_INFO << "Not found in calendar:" << contactId;
         return;
     }
 
     mCalendar->deleteEvent(event);
 
-    debug() << "Deleted birthday event in calendar, local ID: " << event->uid();
+    debug(logCategory) << "Deleted birthday event in calendar, local ID: " << event->uid();
 }
 
 void CDBirthdayCalendar::save()
 {
     if (not mStorage->save()) {
-        warning() << Q_FUNC_INFO << "Failed to update birthdays in calendar";
+        warning(logCategory) << Q_FUNC_INFO << "Failed to update birthdays in calendar";
     }
 }
 
@@ -339,14 +341,14 @@ KCalCore::Event::Ptr CDBirthdayCalendar::calendarEvent(ContactIdType contactId)
     const QString eventId = calendarEventId(contactId);
 
     if (not mStorage->load(eventId)) {
-        warning() << Q_FUNC_INFO << "Unable to load event from calendar";
+        warning(logCategory) << Q_FUNC_INFO << "Unable to load event from calendar";
         return KCalCore::Event::Ptr();
     }
 
     KCalCore::Event::Ptr event = mCalendar->event(eventId);
 
     if (event.isNull()) {
-        debug() << Q_FUNC_INFO << "Not found in calendar:" << contactId;
+        debug(logCategory) << Q_FUNC_INFO << "Not found in calendar:" << contactId;
     }
 
     return event;
@@ -357,16 +359,16 @@ void CDBirthdayCalendar::onLocaleChanged()
     mKCal::Notebook::Ptr notebook = mStorage->notebook(calNotebookId);
 
     if (notebook.isNull()) {
-        warning() << Q_FUNC_INFO << "Calendar not found while changing locale";
+        warning(logCategory) << Q_FUNC_INFO << "Calendar not found while changing locale";
         return;
     }
 
     const QString name = qtTrId("qtn_caln_birthdays");
 
-    debug() << Q_FUNC_INFO << "Updating calendar name to" << name;
+    debug(logCategory) << Q_FUNC_INFO << "Updating calendar name to" << name;
     notebook->setName(name);
 
     if (not mStorage->updateNotebook(notebook)) {
-        warning() << Q_FUNC_INFO << "Could not save calendar";
+        warning(logCategory) << Q_FUNC_INFO << "Could not save calendar";
     }
 }
@@ -46,6 +46,8 @@ QTM_USE_NAMESPACE
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("birthday");
+
 CDBirthdayController::CDBirthdayController(QObject *parent)
     : QObject(parent)
     , mCalendar(0)
@@ -121,7 +123,7 @@ CDBirthdayController::createStampFile()
 
     if (not cacheFile.exists()) {
         if (not cacheFile.open(QIODevice::WriteOnly)) {
-            warning() << Q_FUNC_INFO << "Unable to create birthday plugin stamp file "
+            warning(logCategory) << Q_FUNC_INFO << "Unable to create birthday plugin stamp file "
                                      << cacheFile.fileName() << " with error " << cacheFile.errorString();
         } else {
             cacheFile.close();
@@ -211,12 +213,12 @@ CDBirthdayController::fetchContacts(const QContactFilter &filter, const char *sl
     connect(fetchRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)), slot);
 
     if (not fetchRequest->start()) {
-        warning() << Q_FUNC_INFO << "Unable to start birthday contact fetch request";
+        warning(logCategory) << Q_FUNC_INFO << "Unable to start birthday contact fetch request";
         delete fetchRequest;
         return;
     }
 
-    debug() << "Birthday contacts fetch request started";
+    debug(logCategory) << "Birthday contacts fetch request started";
 }
 
 bool
@@ -225,7 +227,7 @@ CDBirthdayController::processFetchRequest(QContactFetchRequest *const fetchReque
                                           SyncMode syncMode)
 {
     if (fetchRequest == 0) {
-        warning() << Q_FUNC_INFO << "Invalid fetch request";
+        warning(logCategory) << Q_FUNC_INFO << "Invalid fetch request";
         return false;
     }
 
@@ -233,10 +235,10 @@ CDBirthdayController::processFetchRequest(QContactFetchRequest *const fetchReque
 
     switch (newState) {
     case QContactAbstractRequest::FinishedState:
-        debug() << "Birthday contacts fetch request finished";
+        debug(logCategory) << "Birthday contacts fetch request finished";
 
         if (fetchRequest->error() != QContactManager::NoError) {
-            warning() << Q_FUNC_INFO << "Error during birthday contact fetch request, code: "
+            warning(logCategory) << Q_FUNC_INFO << "Error during birthday contact fetch request, code: "
                       << fetchRequest->error();
         } else {
             const QList<QContact> contacts = fetchRequest->contacts();
@@ -288,13 +290,13 @@ CDBirthdayController::updateBirthdays(const QList<QContact> &changedBirthdays)
 
         // Display label or birthdate was removed from the contact, so delete it from the calendar.
         if (contactDisplayLabel.isEmpty() || contactBirthday.date().isNull()) {
-            debug() << "Contact: " << contact << " removed birthday or displayLabel, so delete the calendar event";
+            debug(logCategory) << "Contact: " << contact << " removed birthday or displayLabel, so delete the calendar event";
 
             mCalendar->deleteBirthday(apiId(contact));
         // Display label or birthdate was changed on the contact, so update the calendar.
         } else if ((contactDisplayLabel != calendarBirthday.summary()) ||
                    (contactBirthday.date() != calendarBirthday.date())) {
-            debug() << "Contact with calendar birthday: " << contactBirthday.date()
+            debug(logCategory) << "Contact with calendar birthday: " << contactBirthday.date()
                     << " and calendar displayLabel: " << calendarBirthday.summary()
                     << " changed details to: " << contact << ", so update the calendar event";
 
@@ -317,7 +319,7 @@ CDBirthdayController::syncBirthdays(const QList<QContact> &birthdayContacts)
 #endif
 
         if (contactDisplayLabel.isNull()) {
-            debug() << "Contact: " << contact << " has no displayLabel, so not syncing to calendar";
+            debug(logCategory) << "Contact: " << contact << " has no displayLabel, so not syncing to calendar";
             continue;
         }
 
@@ -330,7 +332,7 @@ CDBirthdayController::syncBirthdays(const QList<QContact> &birthdayContacts)
             // Display label or birthdate was changed on the contact, so update the calendar.
             if ((contactDisplayLabel != calendarBirthday.summary()) ||
                 (contactBirthday.date() != calendarBirthday.date())) {
-                debug() << "Contact with calendar birthday: " << contactBirthday.date()
+                debug(logCategory) << "Contact with calendar birthday: " << contactBirthday.date()
                         << " and calendar displayLabel: " << calendarBirthday.summary()
                         << " changed details to: " << contact << ", so update the calendar event";
 
@@ -347,7 +349,7 @@ CDBirthdayController::syncBirthdays(const QList<QContact> &birthdayContacts)
 
     // Remaining old birthdays in the calendar db do not did not match any contact, so remove them.
     foreach (const ContactIdType &id, oldBirthdays.keys()) {
-        debug() << "Birthday with contact id" << id << "no longer has a matching contact, trashing it";
+        debug(logCategory) << "Birthday with contact id" << id << "no longer has a matching contact, trashing it";
         mCalendar->deleteBirthday(id);
     }
 }
@@ -27,6 +27,8 @@
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("birthday");
+
 CDBirthdayPlugin::CDBirthdayPlugin()
     : mController(0)
 {
@@ -39,7 +41,7 @@ CDBirthdayPlugin::~CDBirthdayPlugin()
 
 void CDBirthdayPlugin::init()
 {
-    debug() << "Initializing contactsd birthday plugin";
+    debug(logCategory) << "Initializing contactsd birthday plugin";
 
     mController = new CDBirthdayController(this);
 }
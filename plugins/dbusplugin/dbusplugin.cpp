@@ -53,5 +53,3 @@ void DbusPlugin::fakeSignals()
    Q_EMIT importEnded(QString("IM Service"),
            QString("/fake/account/"), 10, 30, 1);
 }
-
-Q_EXPORT_PLUGIN2(dbusplugin, DbusPlugin)
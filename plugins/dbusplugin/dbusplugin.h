@@ -34,6 +34,7 @@
 class DbusPlugin : public Contactsd::BasePlugin
 {
     Q_OBJECT
+    Q_PLUGIN_METADATA(IID "org.nemomobile.contactsd.dbusplugin")
 
 public:
     DbusPlugin();
@@ -41,5 +41,3 @@ FakePlugin::MetaData FakePlugin::metaData()
     MetaData data;
     return data;
 }
-
-Q_EXPORT_PLUGIN2(fakeplugin, FakePlugin)
@@ -34,6 +34,7 @@
 class FakePlugin : public Contactsd::BasePlugin
 {
     Q_OBJECT
+    Q_PLUGIN_METADATA(IID "org.nemomobile.contactsd.fakeplugin")
 
 public:
     FakePlugin();
@@ -41,8 +42,6 @@ public:
 
     void init();
     MetaData metaData();
-private Q_SLOTS:
-    void timeout();
 };
 
 #endif // FAKEPLUGIN_H
@@ -30,9 +30,6 @@ QMAKE_CXXFLAGS += -c -g  --coverage -ftest-coverage -fprofile-arcs
 LIBS += -lgcov
 }
 
-CONFIG += link_pkgconfig
-PKGCONFIG += TelepathyQt4
-
 INCLUDEPATH += $$TOP_SOURCEDIR/src
 
 HEADERS  = fakeplugin.h
@@ -40,5 +37,6 @@ HEADERS  = fakeplugin.h
 SOURCES  = fakeplugin.cpp
 
 TARGET = fakeplugin
-target.path = $$LIBDIR/contactsd-1.0/plugins
+# only used by ut_contactsd
+target.path = /opt/tests/contactsd/plugins
 INSTALLS += target
@@ -28,22 +28,27 @@
 #include <TelepathyQt/Profile>
 
 #include "cdtpaccount.h"
-#include "cdtpaccountcacheloader.h"
 #include "cdtpaccountcachewriter.h"
 #include "cdtpcontact.h"
+#include "cdtpplugin.h"
 #include "debug.h"
+#include "trace.h"
 
+// unless configured as telepathy/disconnect-grace-period
 static const int DisconnectGracePeriod = 30 * 1000; // ms
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("tp-account");
+
 CDTpAccount::CDTpAccount(const Tp::AccountPtr &account, const QStringList &toAvoid, bool newAccount, QObject *parent)
     : QObject(parent),
       mAccount(account),
       mContactsToAvoid(toAvoid),
       mHasRoster(false),
       mNewAccount(newAccount),
-      mImporting(false)
+      mImporting(false),
+      mConnectionTime(0)
 {
     // connect all signals we care about, so we can signal that the account
     // changed accordingly
@@ -66,13 +71,8 @@ CDTpAccount::CDTpAccount(const Tp::AccountPtr &account, const QStringList &toAvo
             SIGNAL(stateChanged(bool)),
             SLOT(onAccountStateChanged()));
 
-    if (not newAccount) {
-        CDTpAccountCacheLoader(this).run();
-    }
-
     setConnection(mAccount->connection());
 
-    mDisconnectTimeout.setInterval(DisconnectGracePeriod);
     mDisconnectTimeout.setSingleShot(true);
 
     connect(&mDisconnectTimeout, SIGNAL(timeout()), SLOT(onDisconnectTimeout()));
@@ -101,6 +101,10 @@ QList<CDTpContactPtr> CDTpAccount::contacts() const
 
 QHash<QString, CDTpContact::Changes> CDTpAccount::rosterChanges() const
 {
+    static Histogram *diffTime = CDTpPlugin::histogram(QLatin1String("telepathy.roster-diff-ms"));
+    HistogramTimer timer(diffTime);
+    TraceSpan span("tp.roster-diff", mRosterCache.count());
+
     QHash<QString, CDTpContact::Changes> changes;
 
     QSet<QString> cachedAddresses = mRosterCache.keys().toSet();
@@ -188,9 +192,11 @@ void CDTpAccount::onAccountConnectionChanged(const Tp::ConnectionPtr &connection
     if (not connection.isNull()) {
         mDisconnectTimeout.stop();
     } else if (not mCurrentConnection.isNull() && mCurrentConnection->status() != Tp::ConnectionStatusDisconnected) {
-        debug() << "Lost connection for account" << mAccount->objectPath()
-                << ", giving a grace period of" << DisconnectGracePeriod << "ms";
-        mDisconnectTimeout.start();
+        const int gracePeriod = CDTpPlugin::config()->intValue(
+                QLatin1String("telepathy/disconnect-grace-period"), DisconnectGracePeriod);
+        debug(logCategory) << "Lost connection for account" << mAccount->objectPath()
+                << ", giving a grace period of" << gracePeriod << "ms";
+        mDisconnectTimeout.start(gracePeriod);
         return;
     }
 
@@ -203,7 +209,7 @@ void CDTpAccount::onAccountConnectionChanged(const Tp::ConnectionPtr &connection
 
 void CDTpAccount::setConnection(const Tp::ConnectionPtr &connection)
 {
-    debug() << "Account" << mAccount->objectPath() << "- has connection:" << (connection != 0);
+    debug(logCategory) << "Account" << mAccount->objectPath() << "- has connection:" << (connection != 0);
 
     if (not mCurrentConnection.isNull()) {
         makeRosterCache();
@@ -212,11 +218,12 @@ void CDTpAccount::setConnection(const Tp::ConnectionPtr &connection)
     mContacts.clear();
     mHasRoster = false;
     mCurrentConnection = connection;
+    mConnectionTime = TraceRecorder::instance()->now();
 
     if (connection) {
         /* If the connection has no roster, no need to bother with sync signals */
         if (not (connection->actualFeatures().contains(Tp::Connection::FeatureRoster))) {
-            debug() << "Account" << mAccount->objectPath() << "has no roster, not emitting sync signals";
+            debug(logCategory) << "Account" << mAccount->objectPath() << "has no roster, not emitting sync signals";
 
             return;
         }
@@ -274,11 +281,15 @@ void CDTpAccount::setContactManager(const Tp::ContactManagerPtr &contactManager)
     }
 
     if (mHasRoster) {
-        warning() << "Account" << mAccount->objectPath() << "- already received the roster";
+        warning(logCategory) << "Account" << mAccount->objectPath() << "- already received the roster";
         return;
     }
 
-    debug() << "Account" << mAccount->objectPath() << "- received the roster";
+    debug(logCategory) << "Account" << mAccount->objectPath() << "- received the roster";
+
+    TraceRecorder *recorder = TraceRecorder::instance();
+    recorder->record("tp.account-ready", mConnectionTime, recorder->now(),
+                     contactManager->allKnownContacts().count());
 
     mHasRoster = true;
     connect(contactManager.data(),
@@ -317,14 +328,14 @@ void CDTpAccount::setRosterCache(const QHash<QString, CDTpContact::Info> &cache)
 void CDTpAccount::onAllKnownContactsChanged(const Tp::Contacts &contactsAdded,
         const Tp::Contacts &contactsRemoved)
 {
-    debug() << "Account" << mAccount->objectPath() << "roster contacts changed:";
-    debug() << " " << contactsAdded.size() << "contacts added";
-    debug() << " " << contactsRemoved.size() << "contacts removed";
+    debug(logCategory) << "Account" << mAccount->objectPath() << "roster contacts changed:";
+    debug(logCategory) << " " << contactsAdded.size() << "contacts added";
+    debug(logCategory) << " " << contactsRemoved.size() << "contacts removed";
 
     QList<CDTpContactPtr> added;
     Q_FOREACH (const Tp::ContactPtr &contact, contactsAdded) {
         if (mContacts.contains(contact->id())) {
-            warning() << "Internal error, contact was already in roster";
+            warning(logCategory) << "Internal error, contact was already in roster";
             continue;
         }
         if (mContactsToAvoid.contains(contact->id())) {
@@ -341,7 +352,7 @@ void CDTpAccount::onAllKnownContactsChanged(const Tp::Contacts &contactsAdded,
     Q_FOREACH (const Tp::ContactPtr &contact, contactsRemoved) {
         const QString id(contact->id());
         if (!mContacts.contains(id)) {
-            warning() << "Internal error, contact is not in the internal list"
+            warning(logCategory) << "Internal error, contact is not in the internal list"
                 "but was removed from roster";
             continue;
         }
@@ -363,7 +374,7 @@ void CDTpAccount::onAccountContactChanged(CDTpContactPtr contactWrapper,
     if ((changes & CDTpContact::Visibility) != 0) {
         // Visibility of this contact changed. Transform this update operation
         // to an add/remove operation
-        debug() << "Visibility changed for contact" << contactWrapper->contact()->id();
+        debug(logCategory) << "Visibility changed for contact" << contactWrapper->contact()->id();
 
         QList<CDTpContactPtr> added;
         QList<CDTpContactPtr> removed;
@@ -386,7 +397,7 @@ void CDTpAccount::onAccountContactChanged(CDTpContactPtr contactWrapper,
 
 CDTpContactPtr CDTpAccount::insertContact(const Tp::ContactPtr &contact)
 {
-    debug() << "  creating wrapper for contact" << contact->id();
+    debug(logCategory) << "  creating wrapper for contact" << contact->id();
 
     CDTpContactPtr contactWrapper = CDTpContactPtr(new CDTpContact(contact, this));
     connect(contactWrapper.data(),
@@ -399,11 +410,11 @@ CDTpContactPtr CDTpAccount::insertContact(const Tp::ContactPtr &contact)
 void CDTpAccount::maybeRequestExtraInfo(Tp::ContactPtr contact)
 {
     if (!contact->isAvatarTokenKnown()) {
-        debug() << contact->id() << "first seen: request avatar";
+        debug(logCategory) << contact->id() << "first seen: request avatar";
         contact->requestAvatarData();
     }
     if (!contact->isContactInfoKnown()) {
-        debug() << contact->id() << "first seen: refresh ContactInfo";
+        debug(logCategory) << contact->id() << "first seen: refresh ContactInfo";
         contact->refreshInfo();
     }
 }
@@ -110,6 +110,8 @@ private:
     bool mHasRoster;
     bool mNewAccount;
     bool mImporting;
+    // when the current connection was set, for tracing
+    qint64 mConnectionTime;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(CDTpAccount::Changes)
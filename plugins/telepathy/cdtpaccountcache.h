@@ -30,10 +30,14 @@
 #include "base-plugin.h"
 
 namespace CDTpAccountCache {
-    static int Version = 1;
+    static int Version = 2;
+
+    static QString cacheFilePath(QString accountPath) {
+        return Contactsd::BasePlugin::cacheDir().absoluteFilePath(accountPath.replace(QLatin1Char('/'), QLatin1Char('_')));
+    }
 
     static QString cacheFilePath(const CDTpAccount *account) {
-        return Contactsd::BasePlugin::cacheDir().absoluteFilePath(account->account()->objectPath().replace(QLatin1Char('/'), QLatin1Char('_')));
+        return cacheFilePath(account->account()->objectPath());
     }
 }
 
@@ -24,31 +24,34 @@
 #include "cdtpaccountcacheloader.h"
 
 #include "cdtpaccountcache.h"
+#include "cdtpplugin.h"
 
 #include <debug.h>
+#include <trace.h>
+
+#include <QtConcurrentRun>
 
 using namespace Contactsd;
 
-CDTpAccountCacheLoader::CDTpAccountCacheLoader(CDTpAccount *account, QObject *parent)
-    : QObject(parent)
-    , mAccount(account)
-{
-}
+static DebugCategory logCategory("tp-account");
 
-void CDTpAccountCacheLoader::run()
+CDTpAccountCacheLoader::Cache CDTpAccountCacheLoader::load(const QString &fileName)
 {
-    const QString accountPath = mAccount->account()->objectPath();
-    QFile cacheFile(CDTpAccountCache::cacheFilePath(mAccount));
+    static Histogram *loadTime = CDTpPlugin::histogram(QLatin1String("telepathy.cache-load-ms"));
+    HistogramTimer timer(loadTime);
+    TraceSpan span("tp.cache-load");
+
+    QFile cacheFile(fileName);
 
     if (not cacheFile.exists()) {
-        debug() << Q_FUNC_INFO << "Account" << accountPath << "has no cache file";
-        return;
+        debug(logCategory) << Q_FUNC_INFO << "No cache file" << fileName;
+        return Cache();
     }
 
     if (not cacheFile.open(QIODevice::ReadOnly)) {
-        warning() << Q_FUNC_INFO << "Can't open" << cacheFile.fileName() << "for reading:"
+        warning(logCategory) << Q_FUNC_INFO << "Can't open" << cacheFile.fileName() << "for reading:"
                   << cacheFile.error();
-        return;
+        return Cache();
     }
 
     QByteArray cacheData = cacheFile.readAll();
@@ -57,24 +60,30 @@ void CDTpAccountCacheLoader::run()
     QDataStream stream(cacheData);
 
     if (stream.atEnd()) {
-        debug() << Q_FUNC_INFO << "Empty cache file" << cacheFile.fileName();
+        debug(logCategory) << Q_FUNC_INFO << "Empty cache file" << cacheFile.fileName();
         cacheFile.remove();
-        return;
+        return Cache();
     }
 
     int cacheVersion;
     stream >> cacheVersion;
 
     if (cacheVersion != CDTpAccountCache::Version) {
-        warning() << "Wrong cache version for file" << cacheFile.fileName();
+        warning(logCategory) << "Wrong cache version for file" << cacheFile.fileName();
         cacheFile.remove();
+        return Cache();
     }
 
-    QHash<QString, CDTpContact::Info> cache;
+    Cache cache;
     stream >> cache;
 
-    mAccount->setRosterCache(cache);
+    debug(logCategory) << "Loaded" << cache.size() << "contacts from cache file" << fileName;
+    span.setValue(cache.size());
 
-    debug() << "Loaded" << cache.size() << "contacts from cache for account" << accountPath;
+    return cache;
 }
 
+QFuture<CDTpAccountCacheLoader::Cache> CDTpAccountCacheLoader::loadInBackground(const QString &fileName)
+{
+    return QtConcurrent::run(&CDTpAccountCacheLoader::load, fileName);
+}
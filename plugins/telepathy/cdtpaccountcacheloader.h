@@ -24,18 +24,22 @@
 #ifndef CDTPACCOUNTCACHELOADER_H
 #define CDTPACCOUNTCACHELOADER_H
 
-#include "cdtpaccount.h"
+#include <QFuture>
+#include <QHash>
+#include <QString>
 
-class CDTpAccountCacheLoader : public QObject
+#include "cdtpcontact.h"
+
+class CDTpAccountCacheLoader
 {
 public:
-    CDTpAccountCacheLoader(CDTpAccount *account, QObject *parent = 0);
-
-    void run();
+    typedef QHash<QString, CDTpContact::Info> Cache;
 
-private:
-    CDTpAccount *mAccount;
+    // Reads a roster cache file; safe to call from any thread
+    static Cache load(const QString &fileName);
 
+    // Starts reading a roster cache file in the global thread pool
+    static QFuture<Cache> loadInBackground(const QString &fileName);
 };
 
 #endif // CDTPACCOUNTCACHELOADER_H
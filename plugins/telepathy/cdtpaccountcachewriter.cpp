@@ -33,6 +33,8 @@
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("tp-account");
+
 ///////////////////////////////////////////////////////////////////////////////
 
 CDTpAccountCacheWriter::CDTpAccountCacheWriter(const CDTpAccount *account,
@@ -57,7 +59,7 @@ void CDTpAccountCacheWriter::run()
     tempFile.setAutoRemove(false);
 
     if (not tempFile.open()) {
-        warning() << "Could not open file" << tempFile.fileName()
+        warning(logCategory) << "Could not open file" << tempFile.fileName()
                   << "for writing:" << tempFile.errorString();
         tempFile.setAutoRemove(true);
         return;
@@ -75,7 +77,7 @@ void CDTpAccountCacheWriter::run()
     buffer.close();
 
     if (tempFile.write(data) != data.size()) {
-        warning() << "Could not write roster cache for account" << accountPath << ":" << tempFile.errorString();
+        warning(logCategory) << "Could not write roster cache for account" << accountPath << ":" << tempFile.errorString();
         tempFile.setAutoRemove(true);
         return;
     }
@@ -83,16 +85,16 @@ void CDTpAccountCacheWriter::run()
     if (not tempFile.flush()
      || (::fsync(tempFile.handle()) != 0)
      || (tempFile.close(), false)) {
-        warning() << "Could not finalize roster cache for account" << accountPath << ":" << tempFile.errorString();
+        warning(logCategory) << "Could not finalize roster cache for account" << accountPath << ":" << tempFile.errorString();
         tempFile.setAutoRemove(true);
         return;
     }
 
     if (::rename(tempFile.fileName().toLocal8Bit(), rosterFileName.toLocal8Bit()) != 0) {
-        warning() << "Could not write roster cache for account" << accountPath << ":" << strerror(errno);
+        warning(logCategory) << "Could not write roster cache for account" << accountPath << ":" << strerror(errno);
         tempFile.setAutoRemove(true);
         return;
     }
 
-    debug() << "Wrote" << mAccount->rosterCache().size() << "contacts to cache for account" << accountPath;
+    debug(logCategory) << "Wrote" << mAccount->rosterCache().size() << "contacts to cache for account" << accountPath;
 }
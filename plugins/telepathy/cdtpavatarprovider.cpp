@@ -0,0 +1,128 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include "cdtpavatarprovider.h"
+#include "cdtpavatarupdate.h"
+#include "debug.h"
+
+using namespace Contactsd;
+
+static DebugCategory logCategory("avatar");
+
+namespace {
+
+QList<CDTpAvatarProvider> initProviders()
+{
+    QList<CDTpAvatarProvider> providers;
+
+    CDTpAvatarProvider facebook(QLatin1String("facebook"),
+                                QLatin1String("^-(\\d+)@chat\\.facebook\\.com$"));
+    facebook.addAvatarType(CDTpAvatarUpdate::Large,
+                           QLatin1String("http://graph.facebook.com/%1/picture?type=large"));
+    facebook.addAvatarType(CDTpAvatarUpdate::Square,
+                           QLatin1String("http://graph.facebook.com/%1/picture?type=square"));
+    providers.append(facebook);
+
+    // Serves avatars for "<id>@avatars.test" contacts from a local directory,
+    // to exercise the social avatar path without network access.
+    const QString testDir = QString::fromLocal8Bit(qgetenv("CONTACTSD_TEST_AVATAR_DIR"));
+    if (not testDir.isEmpty()) {
+        debug(logCategory) << "Using test avatar provider for" << testDir;
+
+        const QString urlTemplate = QUrl::fromLocalFile(testDir).toString() + QLatin1String("/%1-");
+
+        CDTpAvatarProvider test(QLatin1String("test"), QLatin1String("^(.+)@avatars\\.test$"));
+        test.addAvatarType(CDTpAvatarUpdate::Large, urlTemplate + CDTpAvatarUpdate::Large);
+        test.addAvatarType(CDTpAvatarUpdate::Square, urlTemplate + CDTpAvatarUpdate::Square);
+        providers.append(test);
+    }
+
+    return providers;
+}
+
+}
+
+CDTpAvatarProvider::CDTpAvatarProvider(const QString &name, const QString &idPattern)
+    : mName(name)
+    , mIdPattern(idPattern)
+{
+    if (not mIdPattern.isValid()) {
+        warning(logCategory) << "Invalid contact ID pattern for avatar provider" << name << mIdPattern.errorString();
+    }
+}
+
+void CDTpAvatarProvider::addAvatarType(const QString &avatarType, const QString &urlTemplate)
+{
+    mUrlTemplates.append(qMakePair(avatarType, urlTemplate));
+}
+
+QStringList CDTpAvatarProvider::avatarTypes() const
+{
+    QStringList types;
+
+    for (int i = 0; i < mUrlTemplates.count(); ++i) {
+        types.append(mUrlTemplates.at(i).first);
+    }
+
+    return types;
+}
+
+QUrl CDTpAvatarProvider::avatarUrl(const QString &socialId, const QString &avatarType) const
+{
+    for (int i = 0; i < mUrlTemplates.count(); ++i) {
+        if (mUrlTemplates.at(i).first == avatarType) {
+            return QUrl(mUrlTemplates.at(i).second.arg(socialId));
+        }
+    }
+
+    return QUrl();
+}
+
+bool CDTpAvatarProvider::requiresNetwork() const
+{
+    for (int i = 0; i < mUrlTemplates.count(); ++i) {
+        if (not mUrlTemplates.at(i).second.startsWith(QLatin1String("file:"))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const CDTpAvatarProvider *CDTpAvatarProvider::find(const QString &contactId, QString *socialId)
+{
+    // The registry is built once, the ID patterns are compiled on first use
+    static const QList<CDTpAvatarProvider> providers(initProviders());
+
+    QList<CDTpAvatarProvider>::const_iterator it = providers.constBegin(), end = providers.constEnd();
+    for ( ; it != end; ++it) {
+        const QRegularExpressionMatch match = it->mIdPattern.match(contactId);
+
+        if (match.hasMatch()) {
+            *socialId = match.captured(1);
+            return &(*it);
+        }
+    }
+
+    return 0;
+}
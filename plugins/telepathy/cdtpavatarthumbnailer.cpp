@@ -0,0 +1,237 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QTemporaryFile>
+#include <QThreadPool>
+
+#include "cdtpavatarthumbnailer.h"
+#include "cdtpplugin.h"
+#include "debug.h"
+
+using namespace Contactsd;
+
+static DebugCategory logCategory("avatar");
+
+namespace {
+
+QThreadPool *thumbnailPool()
+{
+    // Thumbnails are produced one at a time, so that a full roster of new
+    // avatars does not compete with the main loop for more than one core
+    static QThreadPool *pool = 0;
+
+    if (pool == 0) {
+        pool = new QThreadPool(QCoreApplication::instance());
+        pool->setMaxThreadCount(1);
+    }
+
+    return pool;
+}
+
+QSize boundedSize(const QSize &size, int bound)
+{
+    // Never upscale, small avatars are only re-encoded
+    if (size.width() <= bound && size.height() <= bound) {
+        return size;
+    }
+
+    return size.scaled(bound, bound, Qt::KeepAspectRatio);
+}
+
+QHash<QString, int> &sourceReferences()
+{
+    // Only used from the main thread, like the contacts holding the references
+    static QHash<QString, int> references;
+    return references;
+}
+
+bool isThumbnailCurrent(const QString &fileName, const QFileInfo &source)
+{
+    const QFileInfo thumbnail(fileName);
+    return thumbnail.exists() && thumbnail.lastModified() >= source.lastModified();
+}
+
+}
+
+CDTpAvatarThumbnailer::CDTpAvatarThumbnailer(const QString &sourcePath)
+    : QObject()
+    , mSourcePath(sourcePath)
+    , mListPath(thumbnailPath(sourcePath, List))
+    , mGridPath(thumbnailPath(sourcePath, Grid))
+{
+    // We are deleted from the main loop once finished() was delivered
+    setAutoDelete(false);
+    connect(this, SIGNAL(finished(QString, QString, QString)), SLOT(deleteLater()));
+}
+
+CDTpAvatarThumbnailer::~CDTpAvatarThumbnailer()
+{
+}
+
+QString CDTpAvatarThumbnailer::thumbnailPath(const QString &sourcePath, Size size)
+{
+    static const QString list = QLatin1String("avatars/list/");
+    static const QString grid = QLatin1String("avatars/grid/");
+
+    // Thumbnails are named after the SHA1 hash of the original file's path, like
+    // the avatars downloaded by CDTpAvatarUpdate are named after their URL.
+    const QByteArray hash = QCryptographicHash::hash(sourcePath.toUtf8(), QCryptographicHash::Sha1);
+    return CDTpPlugin::cacheFileName((size == List ? list : grid) % QString::fromLatin1(hash.toHex()));
+}
+
+bool CDTpAvatarThumbnailer::findThumbnails(const QString &sourcePath, QString *listPath, QString *gridPath)
+{
+    const QFileInfo source(sourcePath);
+    const QString listFileName(thumbnailPath(sourcePath, List));
+    const QString gridFileName(thumbnailPath(sourcePath, Grid));
+
+    if (not isThumbnailCurrent(listFileName, source) || not isThumbnailCurrent(gridFileName, source)) {
+        return false;
+    }
+
+    *listPath = listFileName;
+    *gridPath = gridFileName;
+    return true;
+}
+
+void CDTpAvatarThumbnailer::addSourceReference(const QString &sourcePath)
+{
+    ++sourceReferences()[sourcePath];
+}
+
+void CDTpAvatarThumbnailer::removeSourceReference(const QString &sourcePath)
+{
+    QHash<QString, int>::iterator it = sourceReferences().find(sourcePath);
+    if (it != sourceReferences().end() && --(*it) <= 0) {
+        sourceReferences().erase(it);
+    }
+}
+
+int CDTpAvatarThumbnailer::removeUnusedThumbnails(const QSet<QString> &storedPaths)
+{
+    QSet<QString> usedPaths(storedPaths);
+    foreach (const QString &sourcePath, sourceReferences().keys()) {
+        usedPaths.insert(thumbnailPath(sourcePath, List));
+        usedPaths.insert(thumbnailPath(sourcePath, Grid));
+    }
+
+    int removedCount = 0;
+    const Size sizes[] = { List, Grid };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        const QDir thumbnailDir(QFileInfo(thumbnailPath(QString(), sizes[i])).path());
+
+        foreach (const QString &fileName, thumbnailDir.entryList(QDir::Files)) {
+            // Thumbnails are named by a bare hash, anything with a suffix is
+            // the temporary file of a thumbnailer that is still running
+            if (fileName.contains(QLatin1Char('.'))) {
+                continue;
+            }
+
+            const QString filePath(thumbnailDir.filePath(fileName));
+            if (!usedPaths.contains(filePath) && QFile::remove(filePath)) {
+                ++removedCount;
+            }
+        }
+    }
+
+    return removedCount;
+}
+
+void CDTpAvatarThumbnailer::start()
+{
+    thumbnailPool()->start(this);
+}
+
+void CDTpAvatarThumbnailer::run()
+{
+    QString listPath;
+    QString gridPath;
+
+    QImageReader reader(mSourcePath);
+    const QSize sourceSize = reader.size();
+
+    if (sourceSize.isValid()) {
+        // Let the image reader do the downscaling, for JPEG this avoids
+        // decoding the full size image at all.
+        const QSize gridSize = boundedSize(sourceSize, Grid);
+        if (gridSize != sourceSize) {
+            reader.setScaledSize(gridSize);
+        }
+
+        const QImage gridImage = reader.read();
+
+        if (not gridImage.isNull()) {
+            const QImage listImage = gridImage.scaled(boundedSize(gridImage.size(), List),
+                                                      Qt::IgnoreAspectRatio,
+                                                      Qt::SmoothTransformation);
+
+            gridPath = writeThumbnail(gridImage, mGridPath);
+            listPath = writeThumbnail(listImage, mListPath);
+        }
+    }
+
+    if (listPath.isEmpty() || gridPath.isEmpty()) {
+        warning(logCategory) << "Could not create avatar thumbnails for" << mSourcePath;
+    }
+
+    // Must be last, this object might be deleted as soon as it is emitted
+    Q_EMIT finished(mSourcePath, listPath, gridPath);
+}
+
+QString CDTpAvatarThumbnailer::writeThumbnail(const QImage &image, const QString &fileName) const
+{
+    const QDir thumbnailDir = QFileInfo(fileName).absoluteDir();
+
+    if (not thumbnailDir.exists() && not QDir::root().mkpath(thumbnailDir.absolutePath())) {
+        warning(logCategory) << "Could not create avatar thumbnail dir:" << thumbnailDir.path();
+        return QString();
+    }
+
+    QTemporaryFile tempFile(fileName);
+
+    // PNG keeps transparency, everything else is fine as JPEG
+    const bool alpha = image.hasAlphaChannel();
+
+    if (tempFile.open() && image.save(&tempFile, alpha ? "PNG" : "JPG", alpha ? -1 : 85)) {
+        tempFile.close();
+
+        if (QFile::exists(fileName)) {
+            QFile::remove(fileName);
+        }
+
+        if (tempFile.rename(fileName)) {
+            tempFile.setAutoRemove(false);
+            return fileName;
+        }
+    }
+
+    return QString();
+}
@@ -0,0 +1,71 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CDTPAVATARTHUMBNAILER_H
+#define CDTPAVATARTHUMBNAILER_H
+
+#include <QImage>
+#include <QObject>
+#include <QRunnable>
+#include <QSet>
+#include <QString>
+
+class CDTpAvatarThumbnailer : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    enum Size {
+        List = 96,
+        Grid = 256
+    };
+
+    explicit CDTpAvatarThumbnailer(const QString &sourcePath);
+    virtual ~CDTpAvatarThumbnailer();
+
+    static QString thumbnailPath(const QString &sourcePath, Size size);
+    static bool findThumbnails(const QString &sourcePath, QString *listPath, QString *gridPath);
+
+    // Avatar files are shared between contacts, so live contacts register the
+    // source of their thumbnails; only thumbnails neither registered nor in
+    // storedPaths are removed.
+    static void addSourceReference(const QString &sourcePath);
+    static void removeSourceReference(const QString &sourcePath);
+    static int removeUnusedThumbnails(const QSet<QString> &storedPaths);
+
+    void start();
+    void run();
+
+Q_SIGNALS:
+    void finished(const QString &sourcePath, const QString &listPath, const QString &gridPath);
+
+private:
+    QString writeThumbnail(const QImage &image, const QString &fileName) const;
+
+private:
+    const QString mSourcePath;
+    const QString mListPath;
+    const QString mGridPath;
+};
+
+#endif // CDTPAVATARTHUMBNAILER_H
@@ -26,9 +26,12 @@
 #include "cdtpavatarupdate.h"
 #include "cdtpplugin.h"
 #include "debug.h"
+#include "trace.h"
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("avatar");
+
 const QString CDTpAvatarUpdate::Large = QLatin1String("large");
 const QString CDTpAvatarUpdate::Square = QLatin1String("square");
 
@@ -38,6 +41,7 @@ CDTpAvatarUpdate::CDTpAvatarUpdate(QNetworkReply *networkReply,
                                    QObject *parent)
     : QObject(parent)
     , mNetworkReply(0)
+    , mFetchStarted(0)
     , mContactWrapper(contactWrapper)
     , mAvatarType(avatarType)
     , mCacheDir(CDTpPlugin::cacheFileName(QLatin1String("avatars/") % mAvatarType))
@@ -52,22 +56,30 @@ CDTpAvatarUpdate::~CDTpAvatarUpdate()
 
 void CDTpAvatarUpdate::setNetworkReply(QNetworkReply *networkReply)
 {
+    static Gauge *fetchesInFlight = CDTpPlugin::gauge(QLatin1String("telepathy.avatar-fetches-in-flight"));
+
     if (mNetworkReply) {
         mNetworkReply->disconnect(this);
         mNetworkReply->deleteLater();
+        fetchesInFlight->add(-1);
+
+        TraceRecorder *recorder = TraceRecorder::instance();
+        recorder->record("tp.avatar-fetch", mFetchStarted, recorder->now());
     }
 
     mNetworkReply = networkReply;
 
     if (mNetworkReply) {
         connect(mNetworkReply, SIGNAL(finished()), this, SLOT(onRequestFinished()));
+        fetchesInFlight->add(1);
+        mFetchStarted = TraceRecorder::instance()->now();
     }
 }
 
 QString CDTpAvatarUpdate::writeAvatarFile(QFile &avatarFile)
 {
     if (not mCacheDir.exists() && not QDir::root().mkpath(mCacheDir.absolutePath())) {
-        warning() << "Could not create large avatar cache dir:" << mCacheDir.path();
+        warning(logCategory) << "Could not create large avatar cache dir:" << mCacheDir.path();
         return QString();
     }
 
@@ -135,7 +147,10 @@ void CDTpAvatarUpdate::onRequestFinished()
         static const QLatin1String contentTypeImageGif = QLatin1String("image/gif");
         static const QLatin1String contentTypeImage = QLatin1String("image/");
 
-        if (contentType.startsWith(contentTypeImage) && contentType != contentTypeImageGif) {
+        // Local files, as used by the test provider, come without a content type
+        const bool localFile = mNetworkReply->url().isLocalFile() && contentType.isEmpty();
+
+        if (localFile || (contentType.startsWith(contentTypeImage) && contentType != contentTypeImageGif)) {
             mAvatarPath = writeAvatarFile(avatarFile);
         }
     }
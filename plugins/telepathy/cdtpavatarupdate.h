@@ -61,6 +61,7 @@ private:
 
 private:
     QPointer<QNetworkReply> mNetworkReply;
+    qint64 mFetchStarted;
     QPointer<CDTpContact> mContactWrapper;
     const QString mAvatarType;
     const QDir mCacheDir;
@@ -0,0 +1,70 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CDTPBUDDYOPERATION_H
+#define CDTPBUDDYOPERATION_H
+
+#include <QDBusArgument>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+#include <QStringList>
+
+// One entry of a batched com.nokia.contacts.buddymanagement call, marshalled as (sasu)
+struct CDTpBuddyOperation
+{
+    CDTpBuddyOperation() : localId(0) {}
+
+    QString accountPath;
+    QStringList imIds;
+    uint localId;
+};
+
+typedef QList<CDTpBuddyOperation> CDTpBuddyOperationList;
+
+Q_DECLARE_METATYPE(CDTpBuddyOperation)
+Q_DECLARE_METATYPE(CDTpBuddyOperationList)
+
+inline QDBusArgument &operator<<(QDBusArgument &argument, const CDTpBuddyOperation &operation)
+{
+    argument.beginStructure();
+    argument << operation.accountPath << operation.imIds << operation.localId;
+    argument.endStructure();
+    return argument;
+}
+
+inline const QDBusArgument &operator>>(const QDBusArgument &argument, CDTpBuddyOperation &operation)
+{
+    argument.beginStructure();
+    argument >> operation.accountPath >> operation.imIds >> operation.localId;
+    argument.endStructure();
+    return argument;
+}
+
+inline void registerBuddyOperationTypes()
+{
+    qDBusRegisterMetaType<CDTpBuddyOperation>();
+    qDBusRegisterMetaType<CDTpBuddyOperationList>();
+}
+
+#endif // CDTPBUDDYOPERATION_H
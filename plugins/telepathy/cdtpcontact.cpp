@@ -25,6 +25,8 @@
 #include <TelepathyQt/ContactCapabilities>
 
 #include "cdtpaccount.h"
+#include "cdtpavatarprovider.h"
+#include "cdtpavatarthumbnailer.h"
 #include "cdtpcontact.h"
 #include "debug.h"
 
@@ -43,6 +45,8 @@ public:
     QString avatarPath;
     QString largeAvatarPath;
     QString squareAvatarPath;
+    QString listThumbnailPath;
+    QString gridThumbnailPath;
     Tp::Contact::PresenceState subscriptionState;
     Tp::Contact::PresenceState publishState;
     Tp::ContactInfoFieldList infoFields;
@@ -61,32 +65,6 @@ CDTpContact::InfoData::InfoData()
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static CDTpContact::Info::Capabilities makeInfoCaps(const Tp::CapabilitiesBase &capabilities)
-{
-    CDTpContact::Info::Capabilities caps = 0;
-
-    if (capabilities.textChats()) {
-        caps |= CDTpContact::Info::TextChats;
-    }
-    if (capabilities.streamedMediaCalls()) {
-        caps |= CDTpContact::Info::StreamedMediaCalls;
-    }
-    if (capabilities.streamedMediaAudioCalls()) {
-        caps |= CDTpContact::Info::StreamedMediaAudioCalls;
-    }
-    if (capabilities.streamedMediaVideoCalls()) {
-        caps |= CDTpContact::Info::StreamedMediaAudioVideoCalls;
-    }
-    if (capabilities.upgradingStreamedMediaCalls()) {
-        caps |= CDTpContact::Info::UpgradingStreamMediaCalls;
-    }
-    if (capabilities.fileTransfers()) {
-        caps |= CDTpContact::Info::FileTransfers;
-    }
-
-    return caps;
-}
-
 CDTpContact::Info::Info()
     :d(new CDTpContact::InfoData)
 {
@@ -99,8 +77,10 @@ CDTpContact::Info::Info(const CDTpContact *contact)
 
     d->alias = c->alias();
     d->presence = c->presence();
-    d->capabilities = makeInfoCaps(c->capabilities());
+    d->capabilities = contact->capabilities();
     d->avatarPath = c->avatarData().fileName;
+    d->listThumbnailPath = contact->listThumbnailPath();
+    d->gridThumbnailPath = contact->gridThumbnailPath();
     d->subscriptionState = c->subscriptionState();
     d->publishState = c->publishState();
     d->infoFields = c->infoFields().allFields();
@@ -124,6 +104,32 @@ CDTpContact::Info::~Info()
 {
 }
 
+CDTpContact::Info::Capabilities CDTpContact::Info::makeCapabilities(const Tp::CapabilitiesBase &capabilities)
+{
+    Capabilities caps = 0;
+
+    if (capabilities.textChats()) {
+        caps |= TextChats;
+    }
+    if (capabilities.streamedMediaCalls()) {
+        caps |= StreamedMediaCalls;
+    }
+    if (capabilities.streamedMediaAudioCalls()) {
+        caps |= StreamedMediaAudioCalls;
+    }
+    if (capabilities.streamedMediaVideoCalls()) {
+        caps |= StreamedMediaAudioVideoCalls;
+    }
+    if (capabilities.upgradingStreamedMediaCalls()) {
+        caps |= UpgradingStreamMediaCalls;
+    }
+    if (capabilities.fileTransfers()) {
+        caps |= FileTransfers;
+    }
+
+    return caps;
+}
+
 CDTpContact::Changes CDTpContact::Info::diff(const CDTpContact::Info &other) const
 {
     Changes changes = 0;
@@ -148,6 +154,10 @@ CDTpContact::Changes CDTpContact::Info::diff(const CDTpContact::Info &other) con
     if (d->squareAvatarPath != other.d->squareAvatarPath)
         changes |= CDTpContact::SquareAvatar;
 
+    if (d->listThumbnailPath != other.d->listThumbnailPath
+     || d->gridThumbnailPath != other.d->gridThumbnailPath)
+        changes |= CDTpContact::ThumbnailAvatar;
+
     if (d->isSubscriptionStateKnown != other.d->isSubscriptionStateKnown
      || d->isPublishStateKnown != other.d->isPublishStateKnown
      || d->subscriptionState != other.d->subscriptionState
@@ -170,14 +180,20 @@ CDTpContact::CDTpContact(Tp::ContactPtr contact, CDTpAccount *accountWrapper)
     : QObject(),
       mContact(contact),
       mAccountWrapper(accountWrapper),
+      mAvatarProvider(0),
+      mCapabilities(Info::makeCapabilities(contact->capabilities())),
       mRemoved(false),
       mQueuedChanges(0)
 {
+    // Contact IDs never change, so the social avatar provider is only looked up once
+    mAvatarProvider = CDTpAvatarProvider::find(contact->id(), &mSocialId);
+
     mQueuedChangesTimer.setInterval(0);
     mQueuedChangesTimer.setSingleShot(true);
     connect(&mQueuedChangesTimer, SIGNAL(timeout()), SLOT(onQueuedChangesTimeout()));
 
     updateVisibility();
+    updateAvatarThumbnails(false);
 
     connect(contact.data(),
             SIGNAL(aliasChanged(const QString &)),
@@ -207,6 +223,9 @@ CDTpContact::CDTpContact(Tp::ContactPtr contact, CDTpAccount *accountWrapper)
 
 CDTpContact::~CDTpContact()
 {
+    if (!mThumbnailSourcePath.isEmpty()) {
+        CDTpAvatarThumbnailer::removeSourceReference(mThumbnailSourcePath);
+    }
 }
 
 CDTpAccountPtr CDTpContact::accountWrapper() const
@@ -244,12 +263,80 @@ void CDTpContact::setLargeAvatarPath(const QString &path)
 {
     mLargeAvatarPath = path;
     emitChanged(LargeAvatar);
+    updateAvatarThumbnails();
 }
 
 void CDTpContact::setSquareAvatarPath(const QString &path)
 {
     mSquareAvatarPath = path;
     emitChanged(SquareAvatar);
+    updateAvatarThumbnails();
+}
+
+QString CDTpContact::defaultAvatarPath() const
+{
+    const QString avatarPath = mContact->avatarData().fileName;
+    return avatarPath.isEmpty() ? mSquareAvatarPath : avatarPath;
+}
+
+void CDTpContact::updateAvatarThumbnails(bool notify)
+{
+    // Thumbnails are made from the best image we have
+    const QString sourcePath = mLargeAvatarPath.isEmpty() ? defaultAvatarPath() : mLargeAvatarPath;
+
+    if (sourcePath == mThumbnailSourcePath) {
+        return;
+    }
+
+    // Other contacts may share the replaced avatar, so its thumbnails are left
+    // for storage to remove once no contact refers to them
+    if (!mThumbnailSourcePath.isEmpty()) {
+        CDTpAvatarThumbnailer::removeSourceReference(mThumbnailSourcePath);
+    }
+
+    mThumbnailSourcePath = sourcePath;
+
+    if (!mThumbnailSourcePath.isEmpty()) {
+        CDTpAvatarThumbnailer::addSourceReference(mThumbnailSourcePath);
+    }
+
+    QString listPath;
+    QString gridPath;
+
+    if (sourcePath.isEmpty() || CDTpAvatarThumbnailer::findThumbnails(sourcePath, &listPath, &gridPath)) {
+        setAvatarThumbnailPaths(listPath, gridPath, notify);
+        return;
+    }
+
+    // Decoding and scaling takes too long for the main loop, the thumbnailer
+    // reports back once it has written the files.
+    CDTpAvatarThumbnailer *const thumbnailer = new CDTpAvatarThumbnailer(sourcePath);
+    connect(thumbnailer, SIGNAL(finished(QString, QString, QString)),
+            SLOT(onAvatarThumbnailsFinished(QString, QString, QString)));
+    thumbnailer->start();
+}
+
+void CDTpContact::setAvatarThumbnailPaths(const QString &listPath, const QString &gridPath, bool notify)
+{
+    if (listPath == mListThumbnailPath && gridPath == mGridThumbnailPath) {
+        return;
+    }
+
+    mListThumbnailPath = listPath;
+    mGridThumbnailPath = gridPath;
+
+    if (notify) {
+        emitChanged(ThumbnailAvatar);
+    }
+}
+
+void CDTpContact::onAvatarThumbnailsFinished(const QString &sourcePath, const QString &listPath, const QString &gridPath)
+{
+    // Drop results for an avatar or contact which was removed in the meantime,
+    // unused files are cleaned up by storage
+    if (sourcePath == mThumbnailSourcePath && !mRemoved) {
+        setAvatarThumbnailPaths(listPath, gridPath, true);
+    }
 }
 
 void CDTpContact::onContactAliasChanged()
@@ -264,12 +351,14 @@ void CDTpContact::onContactPresenceChanged()
 
 void CDTpContact::onContactCapabilitiesChanged()
 {
+    mCapabilities = Info::makeCapabilities(mContact->capabilities());
     emitChanged(Capabilities);
 }
 
 void CDTpContact::onContactAvatarDataChanged()
 {
     emitChanged(DefaultAvatar);
+    updateAvatarThumbnails();
 }
 
 void CDTpContact::onContactAuthorizationChanged()
@@ -330,6 +419,11 @@ void CDTpContact::setRemoved(bool value)
 {
     mRemoved = value;
     updateVisibility();
+
+    if (mRemoved && !mThumbnailSourcePath.isEmpty()) {
+        CDTpAvatarThumbnailer::removeSourceReference(mThumbnailSourcePath);
+        mThumbnailSourcePath.clear();
+    }
 }
 
 QDataStream& operator<<(QDataStream &stream, const Tp::Presence &presence)
@@ -358,6 +452,8 @@ QDataStream& operator<<(QDataStream &stream, const CDTpContact::Info &info)
     stream << info.d->avatarPath;
     stream << info.d->largeAvatarPath;
     stream << info.d->squareAvatarPath;
+    stream << info.d->listThumbnailPath;
+    stream << info.d->gridThumbnailPath;
     stream << info.d->isSubscriptionStateKnown;
     stream << uint(info.d->subscriptionState);
     stream << info.d->isPublishStateKnown;
@@ -414,6 +510,8 @@ QDataStream& operator>>(QDataStream &stream, CDTpContact::Info &info)
     stream >> info.d->avatarPath;
     stream >> info.d->largeAvatarPath;
     stream >> info.d->squareAvatarPath;
+    stream >> info.d->listThumbnailPath;
+    stream >> info.d->gridThumbnailPath;
     stream >> isSubscriptionStateKnown;
     stream >> info.d->subscriptionState;
     stream >> isPublishStateKnown;
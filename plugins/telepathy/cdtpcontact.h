@@ -32,6 +32,8 @@
 
 #include "types.h"
 
+class CDTpAvatarProvider;
+
 class CDTpContact : public QObject, public Tp::RefCounted
 {
     Q_OBJECT
@@ -48,10 +50,11 @@ public:
         Visibility    = (1 << 7),
         LargeAvatar   = (1 << 8),
         SquareAvatar  = (1 << 9),
-        All           = (1 << 10) - 1,
+        ThumbnailAvatar = (1 << 10),
+        All           = (1 << 11) - 1,
 
         // Special values
-        Avatar        = (DefaultAvatar | LargeAvatar | SquareAvatar),
+        Avatar        = (DefaultAvatar | LargeAvatar | SquareAvatar | ThumbnailAvatar),
 
         Added         = (1 << 20) - 1,
         Deleted       = (1 << 21)
@@ -87,6 +90,8 @@ public:
     public:
         CDTpContact::Changes diff(const CDTpContact::Info &other) const;
 
+        static Capabilities makeCapabilities(const Tp::CapabilitiesBase &capabilities);
+
     private:
         friend QDataStream& operator<<(QDataStream &stream, const CDTpContact::Info &info);
         friend QDataStream& operator>>(QDataStream &stream, CDTpContact::Info &info);
@@ -107,12 +112,21 @@ public:
 
     Info info() const;
 
+    Info::Capabilities capabilities() const { return mCapabilities; }
+
     void setLargeAvatarPath(const QString &path);
     const QString & largeAvatarPath() const { return mLargeAvatarPath; }
 
     void setSquareAvatarPath(const QString &path);
     const QString & squareAvatarPath() const { return mSquareAvatarPath; }
 
+    const CDTpAvatarProvider *avatarProvider() const { return mAvatarProvider; }
+    const QString & socialId() const { return mSocialId; }
+
+    QString defaultAvatarPath() const;
+    const QString & listThumbnailPath() const { return mListThumbnailPath; }
+    const QString & gridThumbnailPath() const { return mGridThumbnailPath; }
+
 Q_SIGNALS:
     void changed(CDTpContactPtr contact, CDTpContact::Changes changes);
 
@@ -125,17 +139,26 @@ private Q_SLOTS:
     void onContactInfoChanged();
     void onBlockStatusChanged();
     void onQueuedChangesTimeout();
+    void onAvatarThumbnailsFinished(const QString &sourcePath, const QString &listPath, const QString &gridPath);
 
 private:
     void emitChanged(CDTpContact::Changes changes);
     void updateVisibility();
     void setRemoved(bool value);
+    void updateAvatarThumbnails(bool notify = true);
+    void setAvatarThumbnailPaths(const QString &listPath, const QString &gridPath, bool notify);
 
     friend class CDTpAccount;
     Tp::ContactPtr mContact;
     QPointer<CDTpAccount> mAccountWrapper;
+    const CDTpAvatarProvider *mAvatarProvider;
+    QString mSocialId;
     QString mLargeAvatarPath;
     QString mSquareAvatarPath;
+    QString mThumbnailSourcePath;
+    QString mListThumbnailPath;
+    QString mGridThumbnailPath;
+    Info::Capabilities mCapabilities;
     bool mRemoved;
     bool mVisible;
     Changes mQueuedChanges;
@@ -0,0 +1,676 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QContactAddress>
+#include <QContactBirthday>
+#include <QContactEmailAddress>
+#include <QContactGender>
+#include <QContactName>
+#include <QContactNickname>
+#include <QContactNote>
+#include <QContactOrganization>
+#include <QContactPhoneNumber>
+#include <QContactUrl>
+
+#include <QHash>
+#include <QVariant>
+
+#include "cdtpcontactinfo.h"
+#include "debug.h"
+
+using namespace Contactsd;
+
+static DebugCategory logCategory("tp-storage");
+
+#ifdef USING_QTPIM
+typedef int ContextType;
+typedef QList<int> SubTypeList;
+typedef QHash<QString, int> Dictionary;
+typedef QContactDetail::DetailType DetailType;
+typedef int FieldType;
+typedef QMap<int, QVariant> ValueMap;
+#else
+typedef QString ContextType;
+typedef QStringList SubTypeList;
+typedef QHash<QString, QString> Dictionary;
+typedef QString DetailType;
+typedef QString FieldType;
+typedef QVariantMap ValueMap;
+#endif
+
+namespace {
+
+#ifdef USING_QTPIM
+const int QContactName__FieldCustomLabel = (QContactName::FieldSuffix+1);
+
+const ContextType defaultContext = QContactDetail::ContextOther;
+const ContextType homeContext = QContactDetail::ContextHome;
+const ContextType workContext = QContactDetail::ContextWork;
+#else
+const QLatin1String defaultContext("Other");
+const QLatin1String homeContext("Home");
+const QLatin1String workContext("Work");
+#endif
+
+// Parameter strings repeat across fields and contacts, so their parsed form is cached
+const int MaxCachedParameters = 256;
+
+QString asString(const Tp::ContactInfoField &field, int i)
+{
+    if (i >= field.fieldValue.count()) {
+        return QLatin1String("");
+    }
+
+    return field.fieldValue[i];
+}
+
+QStringList asStringList(const Tp::ContactInfoField &field, int i)
+{
+    QStringList rv;
+
+    while (i < field.fieldValue.count()) {
+        rv.append(field.fieldValue[i]);
+        ++i;
+    }
+
+    return rv;
+}
+
+// A single "type=..." parameter, either a context or a lower-cased subtype
+struct Parameter
+{
+    Parameter() : isContext(false), context() {}
+
+    bool isContext;
+    ContextType context;
+    QString subType;
+};
+
+// All parameters of a field
+struct FieldParameters
+{
+    FieldParameters() : hasContext(false), context() {}
+
+    bool hasContext;
+    ContextType context;
+    QStringList subTypes;
+};
+
+// Details being built up from the fields of a single contact
+struct MappingState
+{
+    QList<QContactDetail> details;
+    QContactOrganization organization;
+    QContactName name;
+};
+
+template<typename T>
+void setContext(T &detail, const FieldParameters &params)
+{
+    if (params.hasContext) {
+        detail.setContexts(params.context);
+    }
+}
+
+SubTypeList selectSubTypes(const Dictionary &types, const QStringList &subTypes)
+{
+    SubTypeList selectedTypes;
+
+    foreach (const QString &type, subTypes) {
+        Dictionary::const_iterator it = types.find(type);
+        if (it != types.constEnd()) {
+            selectedTypes.append(*it);
+        }
+    }
+
+    return selectedTypes;
+}
+
+#ifdef USING_QTPIM
+QString customLabel(const QContactName &name) { return name.value<QString>(QContactName__FieldCustomLabel); }
+void setCustomLabel(QContactName &name, const QString &label) { name.setValue(QContactName__FieldCustomLabel, label); }
+#else
+QString customLabel(const QContactName &name) { return name.customLabel(); }
+void setCustomLabel(QContactName &name, const QString &label) { name.setCustomLabel(label); }
+#endif
+
+class FieldHandler
+{
+public:
+    virtual ~FieldHandler() {}
+    virtual void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const = 0;
+};
+
+class PhoneNumberHandler : public FieldHandler
+{
+public:
+    PhoneNumberHandler()
+    {
+        mTypes.insert(QLatin1String("bbsl"), QContactPhoneNumber::SubTypeBulletinBoardSystem);
+        mTypes.insert(QLatin1String("car"), QContactPhoneNumber::SubTypeCar);
+        mTypes.insert(QLatin1String("cell"), QContactPhoneNumber::SubTypeMobile);
+        mTypes.insert(QLatin1String("fax"), QContactPhoneNumber::SubTypeFax);
+        mTypes.insert(QLatin1String("modem"), QContactPhoneNumber::SubTypeModem);
+        mTypes.insert(QLatin1String("pager"), QContactPhoneNumber::SubTypePager);
+        mTypes.insert(QLatin1String("video"), QContactPhoneNumber::SubTypeVideo);
+        mTypes.insert(QLatin1String("voice"), QContactPhoneNumber::SubTypeVoice);
+        // Not sure about these types:
+        mTypes.insert(QLatin1String("isdn"), QContactPhoneNumber::SubTypeLandline);
+        mTypes.insert(QLatin1String("pcs"), QContactPhoneNumber::SubTypeLandline);
+    }
+
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        SubTypeList selectedTypes(selectSubTypes(mTypes, params.subTypes));
+        if (selectedTypes.isEmpty()) {
+            // Assume landline
+            selectedTypes.append(QContactPhoneNumber::SubTypeLandline);
+        }
+
+        QContactPhoneNumber phoneNumberDetail;
+        phoneNumberDetail.setContexts(params.hasContext ? params.context : ContextType(defaultContext));
+        phoneNumberDetail.setNumber(asString(field, 0));
+        phoneNumberDetail.setSubTypes(selectedTypes);
+
+        state.details.append(phoneNumberDetail);
+    }
+
+private:
+    Dictionary mTypes;
+};
+
+class AddressHandler : public FieldHandler
+{
+public:
+    AddressHandler()
+    {
+        mTypes.insert(QLatin1String("dom"), QContactAddress::SubTypeDomestic);
+        mTypes.insert(QLatin1String("intl"), QContactAddress::SubTypeInternational);
+        mTypes.insert(QLatin1String("parcel"), QContactAddress::SubTypeParcel);
+        mTypes.insert(QLatin1String("postal"), QContactAddress::SubTypePostal);
+    }
+
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        const SubTypeList selectedTypes(selectSubTypes(mTypes, params.subTypes));
+
+        // QContactAddress does not support extended street address, so combine the fields
+        QString streetAddress(asString(field, 1) + QLatin1Char('\n') + asString(field, 2));
+
+        QContactAddress addressDetail;
+        setContext(addressDetail, params);
+        if (!selectedTypes.isEmpty()) {
+            addressDetail.setSubTypes(selectedTypes);
+        }
+        addressDetail.setPostOfficeBox(asString(field, 0));
+        addressDetail.setStreet(streetAddress);
+        addressDetail.setLocality(asString(field, 3));
+        addressDetail.setRegion(asString(field, 4));
+        addressDetail.setPostcode(asString(field, 5));
+        addressDetail.setCountry(asString(field, 6));
+
+        state.details.append(addressDetail);
+    }
+
+private:
+    Dictionary mTypes;
+};
+
+// Fields mapping to a single string value of a detail, like email, url and note
+template<typename T, void (T::*setter)(const QString &)>
+class SingleValueHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        T detail;
+        setContext(detail, params);
+        (detail.*setter)(asString(field, 0));
+
+        state.details.append(detail);
+    }
+};
+
+class TitleHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        state.organization.setTitle(asString(field, 0));
+        setContext(state.organization, params);
+    }
+};
+
+class RoleHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        state.organization.setRole(asString(field, 0));
+        setContext(state.organization, params);
+    }
+};
+
+class OrganizationHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        state.organization.setName(asString(field, 0));
+        state.organization.setDepartment(asStringList(field, 1));
+        setContext(state.organization, params);
+
+        state.details.append(state.organization);
+
+        // Clear out the stored details
+        state.organization = QContactOrganization();
+    }
+};
+
+class NameHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        setContext(state.name, params);
+        state.name.setLastName(asString(field, 0));
+        state.name.setFirstName(asString(field, 1));
+        state.name.setMiddleName(asString(field, 2));
+        state.name.setPrefix(asString(field, 3));
+        state.name.setSuffix(asString(field, 4));
+    }
+};
+
+class FormattedNameHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        const QString fn(asString(field, 0));
+        if (!fn.isEmpty()) {
+            setContext(state.name, params);
+            setCustomLabel(state.name, fn);
+        }
+    }
+};
+
+class NicknameHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &params) const
+    {
+        const QString nickname(asString(field, 0));
+        if (nickname.isEmpty()) {
+            return;
+        }
+
+        QContactNickname nicknameDetail;
+        nicknameDetail.setNickname(nickname);
+        setContext(nicknameDetail, params);
+
+        state.details.append(nicknameDetail);
+
+        // Use the nickname as the customLabel if we have no 'fn' data
+        if (customLabel(state.name).isEmpty()) {
+            setCustomLabel(state.name, nickname);
+        }
+    }
+};
+
+class BirthdayHandler : public FieldHandler
+{
+public:
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &) const
+    {
+        const QDate date(CDTpContactInfoMapper::parseDate(asString(field, 0)));
+
+        if (date.isValid()) {
+            QContactBirthday birthdayDetail;
+            birthdayDetail.setDate(date);
+
+            state.details.append(birthdayDetail);
+        } else {
+            debug(logCategory) << "Unsupported bday format:" << field.fieldValue[0];
+        }
+    }
+};
+
+class GenderHandler : public FieldHandler
+{
+public:
+    GenderHandler()
+    {
+        mTypes.insert(QLatin1String("f"), QContactGender::GenderFemale);
+        mTypes.insert(QLatin1String("female"), QContactGender::GenderFemale);
+        mTypes.insert(QLatin1String("m"), QContactGender::GenderMale);
+        mTypes.insert(QLatin1String("male"), QContactGender::GenderMale);
+    }
+
+    void map(MappingState &state, const Tp::ContactInfoField &field, const FieldParameters &) const
+    {
+        const QString type(field.fieldValue.at(0));
+
+        Dictionary::const_iterator it = mTypes.find(type.toLower());
+        if (it != mTypes.constEnd()) {
+            QContactGender genderDetail;
+#ifdef USING_QTPIM
+            genderDetail.setGender(static_cast<QContactGender::GenderField>(*it));
+#else
+            genderDetail.setGender(*it);
+#endif
+
+            state.details.append(genderDetail);
+        } else {
+            debug(logCategory) << "Unsupported gender type:" << type;
+        }
+    }
+
+private:
+    Dictionary mTypes;
+};
+
+#ifdef USING_QTPIM
+DetailType detailType(const QContactDetail &detail) { return detail.type(); }
+
+template<typename T>
+DetailType detailType() { return T::Type; }
+#else
+DetailType detailType(const QContactDetail &detail) { return detail.definitionName(); }
+
+template<typename T>
+DetailType detailType() { return QString::fromLatin1(T::DefinitionName.latin1()); }
+#endif
+
+bool isEmptyValue(const QVariant &value)
+{
+    if (!value.isValid()) {
+        return true;
+    }
+    if (value.type() == QVariant::String) {
+        return value.toString().isEmpty();
+    }
+    if (value.canConvert<QVariantList>()) {
+        return value.value<QVariantList>().isEmpty();
+    }
+    return false;
+}
+
+bool equalValues(const QVariant &stored, const QVariant &mapped)
+{
+    if (stored == mapped) {
+        return true;
+    }
+
+    // Backends are free to drop empty values when storing a detail
+    if (isEmptyValue(stored) && isEmptyValue(mapped)) {
+        return true;
+    }
+
+    // Lists of contexts and subtypes come back as whatever list type the backend uses
+    if (stored.type() != QVariant::String && mapped.type() != QVariant::String &&
+        stored.canConvert<QVariantList>() && mapped.canConvert<QVariantList>()) {
+        return stored.value<QVariantList>() == mapped.value<QVariantList>();
+    }
+
+    return false;
+}
+
+int parseDigits(const QChar *data, int count)
+{
+    int value = 0;
+
+    for (int i = 0; i < count; ++i) {
+        const int digit = data[i].unicode() - '0';
+        if (digit < 0 || digit > 9) {
+            return -1;
+        }
+        value = value * 10 + digit;
+    }
+
+    return value;
+}
+
+}
+
+class CDTpContactInfoMapper::Private
+{
+public:
+    Private();
+    ~Private();
+
+    const Parameter &parameter(const QString &text);
+
+    template<typename T>
+    void addFields(const QList<FieldType> &detailFields);
+
+    QHash<QString, const FieldHandler *> handlers;
+    QHash<QString, Parameter> parameters;
+    QHash<DetailType, QList<FieldType> > fields;
+};
+
+CDTpContactInfoMapper::Private::Private()
+{
+    handlers.insert(QLatin1String("tel"), new PhoneNumberHandler);
+    handlers.insert(QLatin1String("adr"), new AddressHandler);
+    handlers.insert(QLatin1String("email"),
+                    new SingleValueHandler<QContactEmailAddress, &QContactEmailAddress::setEmailAddress>);
+    handlers.insert(QLatin1String("url"),
+                    new SingleValueHandler<QContactUrl, &QContactUrl::setUrl>);
+    handlers.insert(QLatin1String("title"), new TitleHandler);
+    handlers.insert(QLatin1String("role"), new RoleHandler);
+    handlers.insert(QLatin1String("org"), new OrganizationHandler);
+    handlers.insert(QLatin1String("n"), new NameHandler);
+    handlers.insert(QLatin1String("fn"), new FormattedNameHandler);
+    handlers.insert(QLatin1String("nickname"), new NicknameHandler);
+    handlers.insert(QLatin1String("bday"), new BirthdayHandler);
+    handlers.insert(QLatin1String("x-gender"), new GenderHandler);
+
+    // Both fields end up as a note
+    const FieldHandler *const noteHandler = new SingleValueHandler<QContactNote, &QContactNote::setNote>;
+    handlers.insert(QLatin1String("note"), noteHandler);
+    handlers.insert(QLatin1String("desc"), noteHandler);
+
+    // The fields each handler may set, which is what decides whether a stored
+    // detail is still up to date; anything else is left to the backend.
+    addFields<QContactPhoneNumber>(QList<FieldType>()
+            << QContactPhoneNumber::FieldNumber
+            << QContactPhoneNumber::FieldSubTypes);
+    addFields<QContactAddress>(QList<FieldType>()
+            << QContactAddress::FieldPostOfficeBox
+            << QContactAddress::FieldStreet
+            << QContactAddress::FieldLocality
+            << QContactAddress::FieldRegion
+            << QContactAddress::FieldPostcode
+            << QContactAddress::FieldCountry
+            << QContactAddress::FieldSubTypes);
+    addFields<QContactEmailAddress>(QList<FieldType>()
+            << QContactEmailAddress::FieldEmailAddress);
+    addFields<QContactUrl>(QList<FieldType>()
+            << QContactUrl::FieldUrl);
+    addFields<QContactNote>(QList<FieldType>()
+            << QContactNote::FieldNote);
+    addFields<QContactOrganization>(QList<FieldType>()
+            << QContactOrganization::FieldName
+            << QContactOrganization::FieldDepartment
+            << QContactOrganization::FieldTitle
+            << QContactOrganization::FieldRole);
+    addFields<QContactName>(QList<FieldType>()
+            << QContactName::FieldLastName
+            << QContactName::FieldFirstName
+            << QContactName::FieldMiddleName
+            << QContactName::FieldPrefix
+            << QContactName::FieldSuffix
+#ifdef USING_QTPIM
+            << QContactName__FieldCustomLabel);
+#else
+            << QContactName::FieldCustomLabel);
+#endif
+    addFields<QContactNickname>(QList<FieldType>()
+            << QContactNickname::FieldNickname);
+    addFields<QContactBirthday>(QList<FieldType>()
+            << QContactBirthday::FieldBirthday);
+    addFields<QContactGender>(QList<FieldType>()
+            << QContactGender::FieldGender);
+}
+
+CDTpContactInfoMapper::Private::~Private()
+{
+    qDeleteAll(handlers.values().toSet());
+}
+
+template<typename T>
+void CDTpContactInfoMapper::Private::addFields(const QList<FieldType> &detailFields)
+{
+    fields.insert(detailType<T>(), QList<FieldType>(detailFields) << QContactDetail::FieldContext);
+}
+
+const Parameter &CDTpContactInfoMapper::Private::parameter(const QString &text)
+{
+    QHash<QString, Parameter>::const_iterator it = parameters.constFind(text);
+    if (it != parameters.constEnd()) {
+        return *it;
+    }
+
+    if (parameters.count() >= MaxCachedParameters) {
+        parameters.clear();
+    }
+
+    Parameter parameter;
+
+    if (text.startsWith(QLatin1String("type="))) {
+        const QString type = text.mid(5);
+        if (type == QLatin1String("home")) {
+            parameter.isContext = true;
+            parameter.context = homeContext;
+        } else if (type == QLatin1String("work")) {
+            parameter.isContext = true;
+            parameter.context = workContext;
+        } else {
+            parameter.subType = type.toLower();
+        }
+    }
+
+    return *parameters.insert(text, parameter);
+}
+
+CDTpContactInfoMapper::CDTpContactInfoMapper()
+    : d(new Private)
+{
+}
+
+CDTpContactInfoMapper::~CDTpContactInfoMapper()
+{
+    delete d;
+}
+
+QList<QContactDetail> CDTpContactInfoMapper::details(const Tp::ContactInfoFieldList &fields)
+{
+    MappingState state;
+
+    foreach (const Tp::ContactInfoField &field, fields) {
+        if (field.fieldValue.count() == 0) {
+            continue;
+        }
+
+        QHash<QString, const FieldHandler *>::const_iterator handler = d->handlers.constFind(field.fieldName);
+        if (handler == d->handlers.constEnd()) {
+            debug(logCategory) << "Unsupported contact info field" << field.fieldName;
+            continue;
+        }
+
+        // Extract field types
+        FieldParameters params;
+
+        foreach (const QString &text, field.parameters) {
+            const Parameter &parameter(d->parameter(text));
+
+            if (parameter.isContext) {
+                params.hasContext = true;
+                params.context = parameter.context;
+            } else if (!parameter.subType.isEmpty() && !params.subTypes.contains(parameter.subType)) {
+                params.subTypes.append(parameter.subType);
+            }
+        }
+
+        (*handler)->map(state, field, params);
+    }
+
+    if (!state.name.isEmpty()) {
+        state.details.append(state.name);
+    }
+
+    return state.details;
+}
+
+bool CDTpContactInfoMapper::matches(const QContactDetail &stored, const QContactDetail &mapped) const
+{
+    const DetailType type(detailType(mapped));
+    if (detailType(stored) != type) {
+        return false;
+    }
+
+    QHash<DetailType, QList<FieldType> >::const_iterator it = d->fields.constFind(type);
+    if (it == d->fields.constEnd()) {
+        return false;
+    }
+
+    const ValueMap storedValues(stored.values());
+    const ValueMap mappedValues(mapped.values());
+
+    foreach (const FieldType &field, *it) {
+        if (!equalValues(storedValues.value(field), mappedValues.value(field))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+QDate CDTpContactInfoMapper::parseDate(const QString &text)
+{
+    const QChar *const data = text.constData();
+
+    // Fast path for the yyyy-MM-dd and yyyyMMdd forms nearly everybody uses.
+    // QDate takes a negative year, so every field must have parsed.
+    int year = -1, month = -1, day = -1;
+
+    if (text.length() == 10 && data[4] == QLatin1Char('-') && data[7] == QLatin1Char('-')) {
+        year = parseDigits(data, 4);
+        month = parseDigits(data + 5, 2);
+        day = parseDigits(data + 8, 2);
+    } else if (text.length() == 8) {
+        year = parseDigits(data, 4);
+        month = parseDigits(data + 4, 2);
+        day = parseDigits(data + 6, 2);
+    }
+
+    if (year >= 0 && month >= 0 && day >= 0) {
+        const QDate date(year, month, day);
+        if (date.isValid()) {
+            return date;
+        }
+    }
+
+    /* FIXME: support more date format for compatibility */
+    return QDate::fromString(text, Qt::ISODate);
+}
@@ -0,0 +1,59 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CDTPCONTACTINFO_H
+#define CDTPCONTACTINFO_H
+
+#include <QContactDetail>
+#include <QDate>
+#include <QList>
+
+#include <TelepathyQt/Types>
+
+#ifdef USING_QTPIM
+QTCONTACTS_USE_NAMESPACE
+#else
+QTM_USE_NAMESPACE
+#endif
+
+class CDTpContactInfoMapper
+{
+public:
+    CDTpContactInfoMapper();
+    ~CDTpContactInfoMapper();
+
+    QList<QContactDetail> details(const Tp::ContactInfoFieldList &fields);
+
+    // True if a stored detail carries the same information as a mapped one
+    bool matches(const QContactDetail &stored, const QContactDetail &mapped) const;
+
+    static QDate parseDate(const QString &text);
+
+private:
+    Q_DISABLE_COPY(CDTpContactInfoMapper)
+
+    class Private;
+    Private *const d;
+};
+
+#endif // CDTPCONTACTINFO_H
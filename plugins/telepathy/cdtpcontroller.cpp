@@ -32,27 +32,45 @@
 #include <TelepathyQt/PendingContacts>
 
 #include "buddymanagementadaptor.h"
+#include "cdtpaccountcache.h"
+#include "cdtpaccountcacheloader.h"
+#include "cdtpbuddyoperation.h"
 #include "cdtpcontroller.h"
+#include "cdtpofflinerosterbuffer.h"
+#include "cdtpplugin.h"
 #include "debug.h"
 
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFuture>
+#include <QSettings>
+
 using namespace Contactsd;
 
+static DebugCategory logCategory("tp-account");
+
 const QLatin1String DBusObjectPath("/telepathy");
-static const QString offlineRemovals = QString::fromLatin1("OfflineRemovals");
-static const QString offlineInvitations = QString::fromLatin1("OfflineInvitations");
 
 CDTpController::CDTpController(QObject *parent) : QObject(parent)
 {
-    debug() << "Creating storage";
+    debug(logCategory) << "Creating storage";
     mStorage = new CDTpStorage(this);
-    mOfflineRosterBuffer = new QSettings(QSettings::IniFormat,
+
+    // The offline operations used to be kept in this settings file, keep the
+    // journal next to it and take over what it still holds
+    const QString settingsFileName = QSettings(QSettings::IniFormat,
             QSettings::UserScope, QLatin1String("Nokia"),
-            QLatin1String("Contactsd"));
+            QLatin1String("Contactsd")).fileName();
+    mOfflineRosterBuffer = new CDTpOfflineRosterBuffer(
+            QFileInfo(settingsFileName).dir().filePath(QLatin1String("Contactsd-offline-roster.journal")));
+    mOfflineRosterBuffer->importSettings(settingsFileName);
+
     connect(mStorage,
             SIGNAL(error(int, const QString &)),
             SIGNAL(error(int, const QString &)));
 
-    debug() << "Creating account manager";
+    debug(logCategory) << "Creating account manager";
     const QDBusConnection &bus = QDBusConnection::sessionBus();
     Tp::AccountFactoryPtr accountFactory = Tp::AccountFactory::create(bus,
             Tp::Features() << Tp::Account::FeatureCore
@@ -78,6 +96,7 @@ CDTpController::CDTpController(QObject *parent) : QObject(parent)
     connect(mAM->becomeReady(Tp::AccountManager::FeatureCore),
             SIGNAL(finished(Tp::PendingOperation*)),
             SLOT(onAccountManagerReady(Tp::PendingOperation*)));
+    registerBuddyOperationTypes();
     if (registerDBusObject()) {
         (void) new BuddyManagementAdaptor(this);
     }
@@ -86,20 +105,18 @@ CDTpController::CDTpController(QObject *parent) : QObject(parent)
 CDTpController::~CDTpController()
 {
     QDBusConnection::sessionBus().unregisterObject(DBusObjectPath);
-    if (mOfflineRosterBuffer) {
-        delete mOfflineRosterBuffer;
-    }
+    delete mOfflineRosterBuffer;
 }
 
 void CDTpController::onAccountManagerReady(Tp::PendingOperation *op)
 {
     if (op->isError()) {
-        debug() << "Could not make account manager ready:" <<
+        debug(logCategory) << "Could not make account manager ready:" <<
             op->errorName() << "-" << op->errorMessage();
         return;
     }
 
-    debug() << "Account manager ready";
+    debug(logCategory) << "Account manager ready";
 
     Tp::AccountPropertyFilterPtr propFilter;
     Tp::AccountFilterPtr notFilter;
@@ -134,17 +151,38 @@ void CDTpController::onAccountManagerReady(Tp::PendingOperation *op)
             SIGNAL(accountRemoved(const Tp::AccountPtr &)),
              SLOT(onAccountRemoved(const Tp::AccountPtr &)));
 
-    Q_FOREACH (const Tp::AccountPtr &account, mAccountSet->accounts()) {
+    const QList<Tp::AccountPtr> accounts = mAccountSet->accounts();
+
+    // Read the roster caches in the thread pool while the wrappers are set up
+    QList<QFuture<CDTpAccountCacheLoader::Cache> > caches;
+    Q_FOREACH (const Tp::AccountPtr &account, accounts) {
+        caches.append(CDTpAccountCacheLoader::loadInBackground(
+                CDTpAccountCache::cacheFilePath(account->objectPath())));
+    }
+
+    QElapsedTimer t;
+    t.start();
+
+    Q_FOREACH (const Tp::AccountPtr &account, accounts) {
         insertAccount(account, false);
     }
 
+    // insertAccount() may already have set up a ready roster, but rosters are
+    // only compared to their cache by syncAccounts() below, so every wrapper
+    // has its cache by then
+    for (int i = 0; i < accounts.count(); ++i) {
+        mAccounts.value(accounts.at(i)->objectPath())->setRosterCache(caches.at(i).result());
+    }
+
+    debug(logCategory) << "Created" << accounts.count() << "account wrappers - elapsed:" << t.elapsed();
+
     mStorage->syncAccounts(mAccounts.values());
 }
 
 void CDTpController::onAccountAdded(const Tp::AccountPtr &account)
 {
     if (mAccounts.contains(account->objectPath())) {
-        warning() << "Internal error, account was already in controller";
+        warning(logCategory) << "Internal error, account was already in controller";
         return;
     }
 
@@ -156,33 +194,22 @@ void CDTpController::onAccountRemoved(const Tp::AccountPtr &account)
 {
     CDTpAccountPtr accountWrapper(mAccounts.take(account->objectPath()));
     if (not accountWrapper) {
-        warning() << "Internal error, account was not in controller";
+        warning(logCategory) << "Internal error, account was not in controller";
         return;
     }
     mStorage->removeAccount(accountWrapper);
 
     // Drop pending offline operations
-    QString accountPath = accountWrapper->account()->objectPath();
-
-    mOfflineRosterBuffer->beginGroup(offlineRemovals);
-    mOfflineRosterBuffer->remove(accountPath);
-    mOfflineRosterBuffer->endGroup();
-
-    mOfflineRosterBuffer->beginGroup(offlineInvitations);
-    mOfflineRosterBuffer->remove(accountPath);
-    mOfflineRosterBuffer->endGroup();
-
-    mOfflineRosterBuffer->sync();
+    mOfflineRosterBuffer->removeAccount(accountWrapper->account()->objectPath());
+    mOfflineRosterBuffer->commit();
 }
 
 CDTpAccountPtr CDTpController::insertAccount(const Tp::AccountPtr &account, bool newAccount)
 {
-    debug() << "Creating wrapper for account" << account->objectPath();
+    debug(logCategory) << "Creating wrapper for account" << account->objectPath();
 
     // Get the list of contact ids waiting to be removed from server
-    mOfflineRosterBuffer->beginGroup(offlineRemovals);
-    QStringList idsToRemove = mOfflineRosterBuffer->value(account->objectPath()).toStringList();
-    mOfflineRosterBuffer->endGroup();
+    const QStringList idsToRemove = mOfflineRosterBuffer->contactIds(CDTpOfflineRosterBuffer::Removal, account->objectPath());
 
     CDTpAccountPtr accountWrapper = CDTpAccountPtr(new CDTpAccount(account, idsToRemove, newAccount, this));
     mAccounts.insert(account->objectPath(), accountWrapper);
@@ -245,23 +272,16 @@ void CDTpController::maybeStartOfflineOperations(CDTpAccountPtr accountWrapper)
     Tp::AccountPtr account = accountWrapper->account();
 
     // Start removal operation
-    mOfflineRosterBuffer->beginGroup(offlineRemovals);
-    QStringList idsToRemove = mOfflineRosterBuffer->value(account->objectPath()).toStringList();
-    mOfflineRosterBuffer->endGroup();
+    const QStringList idsToRemove = mOfflineRosterBuffer->contactIds(CDTpOfflineRosterBuffer::Removal, account->objectPath());
     if (!idsToRemove.isEmpty()) {
-        CDTpRemovalOperation *op = new CDTpRemovalOperation(accountWrapper, idsToRemove);
-        connect(op,
-                SIGNAL(finished(Tp::PendingOperation *)),
-                SLOT(onRemovalFinished(Tp::PendingOperation *)));
+        startRemovalOperation(accountWrapper, idsToRemove);
     }
 
     // Start invitation operation
-    mOfflineRosterBuffer->beginGroup(offlineInvitations);
-    QStringList idsToInvite = mOfflineRosterBuffer->value(account->objectPath()).toStringList();
-    mOfflineRosterBuffer->endGroup();
+    const QStringList idsToInvite = mOfflineRosterBuffer->contactIds(CDTpOfflineRosterBuffer::Invitation, account->objectPath());
     if (!idsToInvite.isEmpty()) {
         // FIXME: We should also save the localId for offline operations
-        CDTpInvitationOperation *op = new CDTpInvitationOperation(mStorage, accountWrapper, idsToInvite, 0);
+        CDTpInvitationOperation *op = new CDTpInvitationOperation(mStorage, accountWrapper, idsToInvite, false);
         connect(op,
                 SIGNAL(finished(Tp::PendingOperation *)),
                 SLOT(onInvitationFinished(Tp::PendingOperation *)));
@@ -275,24 +295,86 @@ void CDTpController::inviteBuddies(const QString &accountPath, const QStringList
 
 void CDTpController::inviteBuddiesOnContact(const QString &accountPath, const QStringList &imIds, uint localId)
 {
-    debug() << "InviteBuddies:" << accountPath << imIds.join(QLatin1String(", "));
+    debug(logCategory) << "InviteBuddies:" << accountPath << imIds.join(QLatin1String(", "));
 
     // Add ids to offlineInvitations, in case operation does not succeed now
-    updateOfflineRosterBuffer(offlineInvitations, accountPath, imIds, QStringList());
+    mOfflineRosterBuffer->addContactIds(CDTpOfflineRosterBuffer::Invitation, accountPath, imIds);
+    mOfflineRosterBuffer->commit();
 
     CDTpAccountPtr accountWrapper = mAccounts[accountPath];
     if (!accountWrapper) {
-        debug() << "Account not found";
+        debug(logCategory) << "Account not found";
         return;
     }
 
     // Start invitation operation
     if (accountWrapper->hasRoster()) {
-        CDTpInvitationOperation *op = new CDTpInvitationOperation(mStorage, accountWrapper, imIds, localId);
+        CDTpInvitationOperation *op = new CDTpInvitationOperation(mStorage, accountWrapper, imIds, localId != 0, localId);
+        connect(op,
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(onInvitationFinished(Tp::PendingOperation *)));
+    }
+}
+
+QList<bool> CDTpController::inviteBuddiesBatch(const CDTpBuddyOperationList &operations)
+{
+    debug(logCategory) << "InviteBuddiesBatch:" << operations.count() << "operations";
+
+    // Record every invitation first, so the journal is only committed once
+    foreach (const CDTpBuddyOperation &operation, operations) {
+        mOfflineRosterBuffer->addContactIds(CDTpOfflineRosterBuffer::Invitation, operation.accountPath, operation.imIds);
+    }
+    mOfflineRosterBuffer->commit();
+
+    // Merge the ids of each account, keeping those to create on an existing
+    // contact apart from those which are only invited. The local id itself is
+    // not used by storage, so the ids of different contacts can be merged.
+    typedef QPair<QString, bool> InvitationKey;
+    QList<InvitationKey> keys;
+    QHash<InvitationKey, QStringList> accountContactIds;
+
+    QList<bool> results;
+    foreach (const CDTpBuddyOperation &operation, operations) {
+        CDTpAccountPtr accountWrapper = mAccounts.value(operation.accountPath);
+        results.append(!accountWrapper.isNull());
+        if (!accountWrapper) {
+            debug(logCategory) << "Account not found:" << operation.accountPath;
+            continue;
+        }
+
+        if (!accountWrapper->hasRoster()) {
+            continue;
+        }
+
+        const InvitationKey key(operation.accountPath, operation.localId != 0);
+        if (!accountContactIds.contains(key)) {
+            keys.append(key);
+        }
+
+        QStringList &ids = accountContactIds[key];
+        foreach (const QString &id, operation.imIds) {
+            if (!ids.contains(id)) {
+                ids.append(id);
+            }
+        }
+    }
+
+    if (keys.isEmpty()) {
+        return results;
+    }
+
+    // One operation per account and kind, whose contacts are created together
+    CDTpInvitationBatch *batch = new CDTpInvitationBatch(mStorage, keys.count(), this);
+
+    foreach (const InvitationKey &key, keys) {
+        CDTpInvitationOperation *op = new CDTpInvitationOperation(mStorage, mAccounts.value(key.first),
+                accountContactIds.value(key), key.second, 0, batch);
         connect(op,
                 SIGNAL(finished(Tp::PendingOperation *)),
                 SLOT(onInvitationFinished(Tp::PendingOperation *)));
     }
+
+    return results;
 }
 
 void CDTpController::onInvitationFinished(Tp::PendingOperation *op)
@@ -300,28 +382,30 @@ void CDTpController::onInvitationFinished(Tp::PendingOperation *op)
     // If an error happend, ids stay in the OfflineRosterBuffer and operation
     // will be retried next time account connects.
     if (op->isError()) {
-        debug() << "Error" << op->errorName() << ":" << op->errorMessage();
+        debug(logCategory) << "Error" << op->errorName() << ":" << op->errorMessage();
         return;
     }
 
     CDTpInvitationOperation *iop = qobject_cast<CDTpInvitationOperation *>(op);
-    debug() << "Contacts invited:" << iop->contactIds().join(QLatin1String(", "));
+    debug(logCategory) << "Contacts invited:" << iop->contactIds().join(QLatin1String(", "));
 
     CDTpAccountPtr accountWrapper = iop->accountWrapper();
     const QString accountPath = accountWrapper->account()->objectPath();
-    updateOfflineRosterBuffer(offlineInvitations, accountPath, QStringList(), iop->contactIds());
+    mOfflineRosterBuffer->removeContactIds(CDTpOfflineRosterBuffer::Invitation, accountPath, iop->contactIds());
+    mOfflineRosterBuffer->commit();
 }
 
 void CDTpController::removeBuddies(const QString &accountPath, const QStringList &imIds)
 {
-    debug() << "RemoveBuddies:" << accountPath << imIds.join(QLatin1String(", "));
+    debug(logCategory) << "RemoveBuddies:" << accountPath << imIds.join(QLatin1String(", "));
 
     // Add ids to offlineRemovals, in case it does not get removed right now from server
-    QStringList currentList = updateOfflineRosterBuffer(offlineRemovals, accountPath, imIds, QStringList());
+    const QStringList currentList = mOfflineRosterBuffer->addContactIds(CDTpOfflineRosterBuffer::Removal, accountPath, imIds);
+    mOfflineRosterBuffer->commit();
 
     CDTpAccountPtr accountWrapper = mAccounts[accountPath];
     if (!accountWrapper) {
-        debug() << "Account not found";
+        debug(logCategory) << "Account not found";
         return;
     }
 
@@ -333,67 +417,111 @@ void CDTpController::removeBuddies(const QString &accountPath, const QStringList
 
     // Start removal operation
     if (accountWrapper->hasRoster()) {
-        CDTpRemovalOperation *op = new CDTpRemovalOperation(accountWrapper, imIds);
-        connect(op,
-                SIGNAL(finished(Tp::PendingOperation *)),
-                SLOT(onRemovalFinished(Tp::PendingOperation *)));
+        startRemovalOperation(accountWrapper, imIds);
     }
 }
 
+QList<bool> CDTpController::removeBuddiesBatch(const CDTpBuddyOperationList &operations)
+{
+    debug(logCategory) << "RemoveBuddiesBatch:" << operations.count() << "operations";
+
+    // Merge the ids of each account, and record them all before committing once
+    QHash<QString, QStringList> accountContactIds;
+    foreach (const CDTpBuddyOperation &operation, operations) {
+        mOfflineRosterBuffer->addContactIds(CDTpOfflineRosterBuffer::Removal, operation.accountPath, operation.imIds);
+
+        QStringList &ids = accountContactIds[operation.accountPath];
+        foreach (const QString &id, operation.imIds) {
+            if (!ids.contains(id)) {
+                ids.append(id);
+            }
+        }
+    }
+    mOfflineRosterBuffer->commit();
+
+    QList<bool> results;
+    foreach (const CDTpBuddyOperation &operation, operations) {
+        results.append(!mAccounts.value(operation.accountPath).isNull());
+    }
+
+    QHash<QString, QStringList>::iterator it = accountContactIds.begin();
+    while (it != accountContactIds.end()) {
+        if (mAccounts.value(it.key()).isNull()) {
+            debug(logCategory) << "Account not found:" << it.key();
+            it = accountContactIds.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Remove ids of all accounts from storage at once
+    if (!accountContactIds.isEmpty()) {
+        mStorage->removeAccountContacts(accountContactIds);
+    }
+
+    for (it = accountContactIds.begin(); it != accountContactIds.end(); ++it) {
+        CDTpAccountPtr accountWrapper = mAccounts.value(it.key());
+
+        // Add contacts to account's avoid list
+        accountWrapper->setContactsToAvoid(mOfflineRosterBuffer->contactIds(CDTpOfflineRosterBuffer::Removal, it.key()));
+
+        if (accountWrapper->hasRoster()) {
+            startRemovalOperation(accountWrapper, it.value());
+        }
+    }
+
+    return results;
+}
+
+void CDTpController::startRemovalOperation(CDTpAccountPtr accountWrapper, const QStringList &contactIds)
+{
+    CDTpRemovalOperation *op = new CDTpRemovalOperation(accountWrapper, contactIds);
+    connect(op,
+            SIGNAL(progress(int, int)),
+            SLOT(onRemovalProgress(int, int)));
+    connect(op,
+            SIGNAL(finished(Tp::PendingOperation *)),
+            SLOT(onRemovalFinished(Tp::PendingOperation *)));
+}
+
+void CDTpController::onRemovalProgress(int removed, int total)
+{
+    CDTpRemovalOperation *rop = qobject_cast<CDTpRemovalOperation *>(sender());
+    debug(logCategory) << "Removed" << removed << "of" << total << "contacts from server for account"
+            << rop->accountWrapper()->account()->objectPath();
+}
+
 void CDTpController::onRemovalFinished(Tp::PendingOperation *op)
 {
     // If an error happend, ids stay in the OfflineRosterBuffer and operation
     // will be retried next time account connects.
     if (op->isError()) {
-        debug() << "Error" << op->errorName() << ":" << op->errorMessage();
+        debug(logCategory) << "Error" << op->errorName() << ":" << op->errorMessage();
         return;
     }
 
     CDTpRemovalOperation *rop = qobject_cast<CDTpRemovalOperation *>(op);
-    debug() << "Contacts removed from server:" << rop->contactIds().join(QLatin1String(", "));
+    debug(logCategory) << "Contacts removed from server:" << rop->contactIds().join(QLatin1String(", "));
 
     CDTpAccountPtr accountWrapper = rop->accountWrapper();
     const QString accountPath = accountWrapper->account()->objectPath();
-    QStringList currentList = updateOfflineRosterBuffer(offlineRemovals, accountPath, QStringList(), rop->contactIds());
+    const QStringList currentList = mOfflineRosterBuffer->removeContactIds(CDTpOfflineRosterBuffer::Removal, accountPath, rop->contactIds());
+    mOfflineRosterBuffer->commit();
 
     // Update account's avoid list, in case they get added back
     accountWrapper->setContactsToAvoid(currentList);
 }
 
-QStringList CDTpController::updateOfflineRosterBuffer(const QString group, const QString accountPath,
-        const QStringList idsToAdd, const QStringList idsToRemove)
-{
-    mOfflineRosterBuffer->beginGroup(group);
-    QStringList currentList = mOfflineRosterBuffer->value(accountPath).toStringList();
-    Q_FOREACH (const QString &id, idsToAdd) {
-        if (!currentList.contains(id)) {
-            currentList << id;
-        }
-    }
-    Q_FOREACH (const QString id, idsToRemove) {
-        currentList.removeOne(id);
-    }
-    if (currentList.isEmpty()) {
-        mOfflineRosterBuffer->remove(accountPath);
-    } else {
-        mOfflineRosterBuffer->setValue(accountPath, currentList);
-    }
-    mOfflineRosterBuffer->endGroup();
-    mOfflineRosterBuffer->sync();
-
-    return currentList;
-}
-
 bool CDTpController::registerDBusObject()
 {
     QDBusConnection connection = QDBusConnection::sessionBus();
     if (!connection.isConnected()) {
-        warning() << "Could not connect to DBus:" << connection.lastError();
+        warning(logCategory) << "Could not connect to DBus:" << connection.lastError();
         return false;
     }
 
     if (!connection.registerObject(DBusObjectPath, this)) {
-        warning() << "Could not register DBus object '/':" <<
+        warning(logCategory) << "Could not register DBus object '/':" <<
             connection.lastError();
         return false;
     }
@@ -402,9 +530,9 @@ bool CDTpController::registerDBusObject()
 
 CDTpRemovalOperation::CDTpRemovalOperation(CDTpAccountPtr accountWrapper,
         const QStringList &contactIds) : PendingOperation(accountWrapper),
-        mContactIds(contactIds), mAccountWrapper(accountWrapper)
+        mContactIds(contactIds), mAccountWrapper(accountWrapper), mRemovedCount(0), mChunkSize(0)
 {
-    debug() << "CDTpRemovalOperation: start";
+    debug(logCategory) << "CDTpRemovalOperation: start";
 
     if (accountWrapper->account()->connection().isNull()) {
         // If the connection is null, we make up an error and emit it
@@ -414,17 +542,35 @@ CDTpRemovalOperation::CDTpRemovalOperation(CDTpAccountPtr accountWrapper,
         return;
     }
 
-    Tp::ContactManagerPtr manager = accountWrapper->account()->connection()->contactManager();
-    QList<Tp::ContactPtr> contactsToRemove;
-    Q_FOREACH(const QString contactId, mContactIds) {
-        Q_FOREACH(const Tp::ContactPtr tpcontact, manager->allKnownContacts()) {
-            if (tpcontact->id() == contactId) {
-                contactsToRemove << tpcontact;
-            }
+    mManager = accountWrapper->account()->connection()->contactManager();
+
+    // Contacts being removed are kept out of the account's own roster, so
+    // index everything the connection knows about once
+    QHash<QString, Tp::ContactPtr> knownContacts;
+    Q_FOREACH (const Tp::ContactPtr &tpcontact, mManager->allKnownContacts()) {
+        knownContacts.insert(tpcontact->id(), tpcontact);
+    }
+
+    Q_FOREACH (const QString &contactId, mContactIds) {
+        QHash<QString, Tp::ContactPtr>::const_iterator it = knownContacts.constFind(contactId);
+        if (it != knownContacts.constEnd()) {
+            mContactsToRemove << *it;
         }
     }
 
-    Tp::PendingOperation *call = manager->removeContacts(contactsToRemove);
+    removeNextChunk();
+}
+
+void CDTpRemovalOperation::removeNextChunk()
+{
+    if (mRemovedCount >= mContactsToRemove.count()) {
+        setFinished();
+        return;
+    }
+
+    mChunkSize = qMin<int>(RemovalChunkSize, mContactsToRemove.count() - mRemovedCount);
+
+    Tp::PendingOperation *call = mManager->removeContacts(mContactsToRemove.mid(mRemovedCount, mChunkSize));
     connect(call,
             SIGNAL(finished(Tp::PendingOperation *)),
             SLOT(onContactsRemoved(Tp::PendingOperation *)));
@@ -437,22 +583,34 @@ void CDTpRemovalOperation::onContactsRemoved(Tp::PendingOperation *op)
         return;
     }
 
-    setFinished();
+    static Counter *removedContacts = CDTpPlugin::counter(QLatin1String("telepathy.contacts-removed-from-server"));
+    removedContacts->add(mChunkSize);
+
+    mRemovedCount += mChunkSize;
+    Q_EMIT progress(mRemovedCount, mContactsToRemove.count());
+
+    removeNextChunk();
 }
 
 CDTpInvitationOperation::CDTpInvitationOperation(CDTpStorage *storage,
                                                  CDTpAccountPtr accountWrapper,
                                                  const QStringList &contactIds,
-                                                 uint contactLocalId)
+                                                 bool createsContacts,
+                                                 uint contactLocalId,
+                                                 CDTpInvitationBatch *batch)
     : PendingOperation(accountWrapper)
     , mStorage(storage)
     , mContactIds(contactIds)
     , mAccountWrapper(accountWrapper)
+    , mCreatesContacts(createsContacts)
     , mContactLocalId(contactLocalId)
+    , mBatch(batch)
 {
-    debug() << "CDTpInvitationOperation: start";
+    debug(logCategory) << "CDTpInvitationOperation: start";
 
     if (accountWrapper->account()->connection().isNull()) {
+        createContacts(QStringList());
+
         // If the connection is null, we make up an error and emit it
         // setFinishedWithError takes care of going through the event loop
         setFinishedWithError(QString::fromLatin1("nullConnection"),
@@ -472,9 +630,7 @@ void CDTpInvitationOperation::onContactsRetrieved(Tp::PendingOperation *op)
     if (op->isError()) {
         // We still create the IMAddress on the contact if the request fails, so
         // that user has a feedback
-        if (mContactLocalId != 0) {
-            mStorage->createAccountContacts(mAccountWrapper, mContactIds, mContactLocalId);
-        }
+        createContacts(mCreatesContacts ? mContactIds : QStringList());
 
         setFinishedWithError(op->errorName(), op->errorMessage());
         return;
@@ -482,9 +638,9 @@ void CDTpInvitationOperation::onContactsRetrieved(Tp::PendingOperation *op)
 
     Tp::PendingContacts *pcontacts = qobject_cast<Tp::PendingContacts *>(op);
 
-    if (mContactLocalId != 0) {
-        QStringList resolvedIds;
+    QStringList resolvedIds;
 
+    if (mCreatesContacts) {
         foreach (const Tp::ContactPtr &c, pcontacts->contacts()) {
             resolvedIds.append(c->id());
         }
@@ -493,10 +649,10 @@ void CDTpInvitationOperation::onContactsRetrieved(Tp::PendingOperation *op)
         foreach (const QString &id, pcontacts->invalidIdentifiers().keys()) {
             resolvedIds.append(id);
         }
-
-        mStorage->createAccountContacts(mAccountWrapper, resolvedIds, mContactLocalId);
     }
 
+    createContacts(resolvedIds);
+
     PendingOperation *call = pcontacts->manager()->requestPresenceSubscription(pcontacts->contacts());
     connect(call,
             SIGNAL(finished(Tp::PendingOperation *)),
@@ -512,3 +668,36 @@ void CDTpInvitationOperation::onPresenceSubscriptionRequested(Tp::PendingOperati
 
     setFinished();
 }
+
+void CDTpInvitationOperation::createContacts(const QStringList &contactIds)
+{
+    if (mBatch) {
+        mBatch->addResolvedContacts(mAccountWrapper, contactIds);
+    } else if (mCreatesContacts) {
+        mStorage->createAccountContacts(mAccountWrapper, contactIds, mContactLocalId);
+    }
+}
+
+CDTpInvitationBatch::CDTpInvitationBatch(CDTpStorage *storage, int operationCount, QObject *parent)
+    : QObject(parent)
+    , mStorage(storage)
+    , mPendingCount(operationCount)
+{
+}
+
+void CDTpInvitationBatch::addResolvedContacts(CDTpAccountPtr accountWrapper, const QStringList &contactIds)
+{
+    if (!contactIds.isEmpty()) {
+        mContactIds[accountWrapper] += contactIds;
+    }
+
+    if (--mPendingCount > 0) {
+        return;
+    }
+
+    if (!mContactIds.isEmpty()) {
+        mStorage->createAccountContacts(mContactIds);
+    }
+
+    deleteLater();
+}
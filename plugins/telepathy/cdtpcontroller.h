@@ -25,6 +25,7 @@
 #define CDTPCONTROLLER_H
 
 #include "cdtpaccount.h"
+#include "cdtpbuddyoperation.h"
 #include "cdtpcontact.h"
 #include "cdtpstorage.h"
 
@@ -32,8 +33,9 @@
 
 #include <QList>
 #include <QObject>
-#include <QSettings>
 
+class CDTpInvitationBatch;
+class CDTpOfflineRosterBuffer;
 class PendingOfflineRemoval;
 
 class CDTpController : public QObject
@@ -53,6 +55,8 @@ public Q_SLOTS:
     void inviteBuddies(const QString &accountPath, const QStringList &imIds);
     void inviteBuddiesOnContact(const QString &accountPath, const QStringList &imIds, uint localId);
     void removeBuddies(const QString &accountPath, const QStringList &imIds);
+    QList<bool> inviteBuddiesBatch(const CDTpBuddyOperationList &operations);
+    QList<bool> removeBuddiesBatch(const CDTpBuddyOperationList &operations);
     void onRosterChanged(CDTpAccountPtr accountWrapper);
 
 private Q_SLOTS:
@@ -62,14 +66,14 @@ private Q_SLOTS:
     void onSyncStarted(Tp::AccountPtr account);
     void onSyncEnded(Tp::AccountPtr account, int contactsAdded, int contactsRemoved);
     void onInvitationFinished(Tp::PendingOperation *op);
+    void onRemovalProgress(int removed, int total);
     void onRemovalFinished(Tp::PendingOperation *op);
 
 private:
     CDTpAccountPtr insertAccount(const Tp::AccountPtr &account, bool newAccount);
     void removeAccount(const QString &accountObjectPath);
     void maybeStartOfflineOperations(CDTpAccountPtr accountWrapper);
-    QStringList updateOfflineRosterBuffer(const QString group, const QString accountPath,
-        const QStringList idsToAdd, const QStringList idsToRemove);
+    void startRemovalOperation(CDTpAccountPtr accountWrapper, const QStringList &contactIds);
     bool registerDBusObject();
 
 private:
@@ -77,7 +81,7 @@ private:
     Tp::AccountManagerPtr mAM;
     Tp::AccountSetPtr mAccountSet;
     QHash<QString, CDTpAccountPtr> mAccounts;
-    QSettings *mOfflineRosterBuffer;
+    CDTpOfflineRosterBuffer *mOfflineRosterBuffer;
 };
 
 class CDTpRemovalOperation : public Tp::PendingOperation
@@ -85,16 +89,28 @@ class CDTpRemovalOperation : public Tp::PendingOperation
     Q_OBJECT
 
 public:
+    // Large removals are split over several requests to the server
+    enum { RemovalChunkSize = 100 };
+
     CDTpRemovalOperation(CDTpAccountPtr accountWrapper, const QStringList &contactIds);
     QStringList contactIds() const { return mContactIds; }
     CDTpAccountPtr accountWrapper() const { return mAccountWrapper; }
 
+Q_SIGNALS:
+    void progress(int removed, int total);
+
 private Q_SLOTS:
     void onContactsRemoved(Tp::PendingOperation *op);
 
 private:
+    void removeNextChunk();
+
     QStringList mContactIds;
     CDTpAccountPtr mAccountWrapper;
+    Tp::ContactManagerPtr mManager;
+    QList<Tp::ContactPtr> mContactsToRemove;
+    int mRemovedCount;
+    int mChunkSize;
 };
 
 class CDTpInvitationOperation : public Tp::PendingOperation
@@ -102,10 +118,14 @@ class CDTpInvitationOperation : public Tp::PendingOperation
     Q_OBJECT
 
 public:
+    // Contacts are only created for the invited ids if createsContacts is
+    // set; with a batch, they are created by the batch instead of storage
     CDTpInvitationOperation(CDTpStorage *storage,
                             CDTpAccountPtr accountWrapper,
                             const QStringList &contactIds,
-                            uint contactLocalId);
+                            bool createsContacts,
+                            uint contactLocalId = 0,
+                            CDTpInvitationBatch *batch = 0);
     QStringList contactIds() const { return mContactIds; }
     CDTpAccountPtr accountWrapper() const { return mAccountWrapper; }
 
@@ -114,10 +134,33 @@ private Q_SLOTS:
     void onPresenceSubscriptionRequested(Tp::PendingOperation *op);
 
 private:
+    void createContacts(const QStringList &contactIds);
+
     CDTpStorage *mStorage;
     QStringList mContactIds;
     CDTpAccountPtr mAccountWrapper;
+    bool mCreatesContacts;
     uint mContactLocalId;
+    CDTpInvitationBatch *mBatch;
+};
+
+// Collects the contacts resolved by the invitation operations of one
+// inviteBuddiesBatch() call, and creates them in a single storage update once
+// every operation has resolved its identifiers
+class CDTpInvitationBatch : public QObject
+{
+    Q_OBJECT
+
+public:
+    CDTpInvitationBatch(CDTpStorage *storage, int operationCount, QObject *parent = 0);
+
+    // called exactly once by each operation, with no ids if it creates none
+    void addResolvedContacts(CDTpAccountPtr accountWrapper, const QStringList &contactIds);
+
+private:
+    CDTpStorage *mStorage;
+    int mPendingCount;
+    QHash<CDTpAccountPtr, QStringList> mContactIds;
 };
 
 #endif // CDTPCONTROLLER_H
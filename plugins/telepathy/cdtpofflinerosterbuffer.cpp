@@ -0,0 +1,385 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include "cdtpofflinerosterbuffer.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QTemporaryFile>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+
+using namespace Contactsd;
+
+static DebugCategory logCategory("tp-account");
+
+namespace {
+
+const quint32 Magic = 0x43445452; // "CDTR"
+const qint32 Version = 1;
+
+// Once the journal holds this many records, it is rewritten with just the current state
+const int CompactThreshold = 512;
+
+const QString legacyInvitationsGroup = QString::fromLatin1("OfflineInvitations");
+const QString legacyRemovalsGroup = QString::fromLatin1("OfflineRemovals");
+
+QByteArray header()
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << Magic << Version;
+    return data;
+}
+
+// Records are length prefixed, so that an interrupted write can be detected
+QByteArray record(int type, int operation, const QString &accountPath, const QStringList &contactIds)
+{
+    QByteArray content;
+    QDataStream contentStream(&content, QIODevice::WriteOnly);
+    contentStream << qint8(type) << qint8(operation) << accountPath << contactIds;
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << content;
+    return data;
+}
+
+bool syncFile(QFile &file)
+{
+    return file.flush() && (::fsync(file.handle()) == 0);
+}
+
+// A rename is only durable once the directory holding the file is synced
+bool syncDirectory(const QString &fileName)
+{
+    const QByteArray dirName(QFile::encodeName(QFileInfo(fileName).absolutePath()));
+    const int fd = ::open(dirName.constData(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+
+    const bool synced = (::fsync(fd) == 0);
+    ::close(fd);
+    return synced;
+}
+
+bool ensureDirectory(const QString &fileName)
+{
+    const QDir dir(QFileInfo(fileName).absoluteDir());
+    return dir.exists() || QDir::root().mkpath(dir.path());
+}
+
+}
+
+CDTpOfflineRosterBuffer::CDTpOfflineRosterBuffer(const QString &fileName)
+    : mFileName(fileName)
+    , mRecordCount(0)
+{
+    load();
+}
+
+CDTpOfflineRosterBuffer::~CDTpOfflineRosterBuffer()
+{
+    commit();
+}
+
+QStringList CDTpOfflineRosterBuffer::contactIds(Operation operation, const QString &accountPath) const
+{
+    return mEntries.value(Key(operation, accountPath)).ids;
+}
+
+QStringList CDTpOfflineRosterBuffer::addContactIds(Operation operation, const QString &accountPath,
+                                                   const QStringList &contactIds)
+{
+    append(AddRecord, operation, accountPath, contactIds);
+    return this->contactIds(operation, accountPath);
+}
+
+QStringList CDTpOfflineRosterBuffer::removeContactIds(Operation operation, const QString &accountPath,
+                                                      const QStringList &contactIds)
+{
+    append(RemoveRecord, operation, accountPath, contactIds);
+    return this->contactIds(operation, accountPath);
+}
+
+void CDTpOfflineRosterBuffer::removeAccount(const QString &accountPath)
+{
+    append(ClearRecord, Invitation, accountPath, QStringList());
+}
+
+void CDTpOfflineRosterBuffer::importSettings(const QString &settingsFileName)
+{
+    if (not QFile::exists(settingsFileName)) {
+        return;
+    }
+
+    QSettings settings(settingsFileName, QSettings::IniFormat);
+    bool imported = false;
+
+    for (int i = 0; i < 2; ++i) {
+        const QString &group(i == 0 ? legacyInvitationsGroup : legacyRemovalsGroup);
+        const Operation operation(i == 0 ? Invitation : Removal);
+
+        settings.beginGroup(group);
+        foreach (const QString &key, settings.allKeys()) {
+            // QSettings drops the leading slash of the account path
+            QString accountPath(key);
+            if (not accountPath.startsWith(QLatin1Char('/'))) {
+                accountPath.prepend(QLatin1Char('/'));
+            }
+            addContactIds(operation, accountPath, settings.value(key).toStringList());
+            imported = true;
+        }
+        settings.endGroup();
+    }
+
+    if (not imported) {
+        return;
+    }
+
+    if (commit()) {
+        debug(logCategory) << "Imported offline roster operations from" << settingsFileName;
+
+        settings.remove(legacyInvitationsGroup);
+        settings.remove(legacyRemovalsGroup);
+        settings.sync();
+    }
+}
+
+bool CDTpOfflineRosterBuffer::commit()
+{
+    if (mRecordCount > CompactThreshold) {
+        return compact();
+    }
+
+    if (mPending.isEmpty()) {
+        return true;
+    }
+
+    if (not ensureDirectory(mFileName)) {
+        warning(logCategory) << "Could not create directory for" << mFileName;
+        return false;
+    }
+
+    QFile file(mFileName);
+    if (not file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        warning(logCategory) << "Could not open file" << mFileName << "for writing:" << file.errorString();
+        return false;
+    }
+
+    QByteArray data;
+    if (file.size() == 0) {
+        data = header();
+    }
+    data.append(mPending);
+
+    if (file.write(data) != data.size() || not syncFile(file)) {
+        warning(logCategory) << "Could not write offline roster operations to" << mFileName << ":" << file.errorString();
+        // Part of the data may have been written, so rewrite the whole file next time
+        mRecordCount = CompactThreshold + 1;
+        return false;
+    }
+
+    mPending.clear();
+    return true;
+}
+
+void CDTpOfflineRosterBuffer::load()
+{
+    QFile file(mFileName);
+    if (not file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+
+    quint32 magic = 0;
+    qint32 version = 0;
+    stream >> magic >> version;
+
+    if (stream.status() != QDataStream::Ok || magic != Magic || version != Version) {
+        warning(logCategory) << "Ignoring invalid offline roster journal" << mFileName;
+        // Have the next commit replace the file
+        mRecordCount = CompactThreshold + 1;
+        return;
+    }
+
+    qint64 validSize = file.pos();
+
+    while (not stream.atEnd()) {
+        QByteArray content;
+        stream >> content;
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+
+        QDataStream recordStream(content);
+        qint8 type;
+        qint8 operation;
+        QString accountPath;
+        QStringList contactIds;
+        recordStream >> type >> operation >> accountPath >> contactIds;
+        if (recordStream.status() != QDataStream::Ok) {
+            break;
+        }
+
+        apply(type, static_cast<Operation>(operation), accountPath, contactIds);
+        ++mRecordCount;
+
+        validSize = file.pos();
+    }
+
+    if (validSize < file.size()) {
+        // The last write was interrupted; drop the partial record so that
+        // new records are not appended after it
+        warning(logCategory) << "Discarding" << (file.size() - validSize) << "bytes of incomplete records in" << mFileName;
+        file.close();
+
+        if (not QFile::resize(mFileName, validSize)) {
+            mRecordCount = CompactThreshold + 1;
+        }
+    }
+
+    debug(logCategory) << "Loaded" << mRecordCount << "offline roster records from" << mFileName;
+}
+
+bool CDTpOfflineRosterBuffer::compact()
+{
+    if (not ensureDirectory(mFileName)) {
+        warning(logCategory) << "Could not create directory for" << mFileName;
+        return false;
+    }
+
+    QByteArray data(header());
+    int recordCount = 0;
+
+    QHash<Key, Entry>::const_iterator it = mEntries.constBegin(), end = mEntries.constEnd();
+    for ( ; it != end; ++it) {
+        data.append(record(AddRecord, it.key().first, it.key().second, it->ids));
+        ++recordCount;
+    }
+
+    QTemporaryFile tempFile(mFileName);
+    tempFile.setAutoRemove(false);
+
+    if (not tempFile.open()) {
+        warning(logCategory) << "Could not open file" << tempFile.fileName() << "for writing:" << tempFile.errorString();
+        tempFile.setAutoRemove(true);
+        return false;
+    }
+
+    if (tempFile.write(data) != data.size() || not syncFile(tempFile)) {
+        warning(logCategory) << "Could not write offline roster operations to" << tempFile.fileName() << ":" << tempFile.errorString();
+        tempFile.setAutoRemove(true);
+        return false;
+    }
+
+    tempFile.close();
+
+    if (::rename(tempFile.fileName().toLocal8Bit(), mFileName.toLocal8Bit()) != 0) {
+        warning(logCategory) << "Could not replace" << mFileName << ":" << strerror(errno);
+        tempFile.setAutoRemove(true);
+        return false;
+    }
+
+    // The new journal is complete either way, only its durability is at stake
+    if (not syncDirectory(mFileName)) {
+        warning(logCategory) << "Could not sync directory of" << mFileName << ":" << strerror(errno);
+    }
+
+    mPending.clear();
+    mRecordCount = recordCount;
+    return true;
+}
+
+void CDTpOfflineRosterBuffer::apply(int type, Operation operation, const QString &accountPath,
+                                    const QStringList &contactIds)
+{
+    if (type == ClearRecord) {
+        mEntries.remove(Key(Invitation, accountPath));
+        mEntries.remove(Key(Removal, accountPath));
+        return;
+    }
+
+    const Key key(operation, accountPath);
+
+    if (type == AddRecord) {
+        Entry &entry(mEntries[key]);
+        foreach (const QString &id, contactIds) {
+            if (not entry.index.contains(id)) {
+                entry.index.insert(id);
+                entry.ids.append(id);
+            }
+        }
+        if (entry.ids.isEmpty()) {
+            mEntries.remove(key);
+        }
+    } else if (type == RemoveRecord) {
+        QHash<Key, Entry>::iterator it = mEntries.find(key);
+        if (it == mEntries.end()) {
+            return;
+        }
+
+        Entry &entry(*it);
+        foreach (const QString &id, contactIds) {
+            entry.index.remove(id);
+        }
+
+        if (entry.index.isEmpty()) {
+            mEntries.erase(it);
+        } else if (entry.index.count() != entry.ids.count()) {
+            // Filter the ordered list in a single pass
+            QStringList ids;
+            ids.reserve(entry.index.count());
+            foreach (const QString &id, entry.ids) {
+                if (entry.index.contains(id)) {
+                    ids.append(id);
+                }
+            }
+            entry.ids = ids;
+        }
+    }
+}
+
+void CDTpOfflineRosterBuffer::append(int type, Operation operation, const QString &accountPath,
+                                     const QStringList &contactIds)
+{
+    if (type != ClearRecord && contactIds.isEmpty()) {
+        return;
+    }
+
+    apply(type, operation, accountPath, contactIds);
+
+    mPending.append(record(type, operation, accountPath, contactIds));
+    ++mRecordCount;
+}
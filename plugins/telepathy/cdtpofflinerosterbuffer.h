@@ -0,0 +1,91 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CDTPOFFLINEROSTERBUFFER_H
+#define CDTPOFFLINEROSTERBUFFER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+// Roster operations requested while an account could not carry them out,
+// kept until the server confirms them. Changes are appended to a journal
+// file and only made durable by commit(), so a batch of changes costs a
+// single write and fsync.
+class CDTpOfflineRosterBuffer
+{
+public:
+    enum Operation {
+        Invitation = 0,
+        Removal    = 1
+    };
+
+    CDTpOfflineRosterBuffer(const QString &fileName);
+    ~CDTpOfflineRosterBuffer();
+
+    const QString &fileName() const { return mFileName; }
+
+    QStringList contactIds(Operation operation, const QString &accountPath) const;
+
+    // Both return the ids pending for the account after the change
+    QStringList addContactIds(Operation operation, const QString &accountPath, const QStringList &contactIds);
+    QStringList removeContactIds(Operation operation, const QString &accountPath, const QStringList &contactIds);
+
+    void removeAccount(const QString &accountPath);
+
+    // Imports the operations stored in the QSettings file used by older versions
+    void importSettings(const QString &settingsFileName);
+
+    bool commit();
+
+private:
+    Q_DISABLE_COPY(CDTpOfflineRosterBuffer)
+
+    enum RecordType {
+        AddRecord    = 0,
+        RemoveRecord = 1,
+        ClearRecord  = 2
+    };
+
+    struct Entry {
+        QStringList ids;
+        QSet<QString> index;
+    };
+
+    typedef QPair<int, QString> Key;
+
+    void load();
+    bool compact();
+    void apply(int type, Operation operation, const QString &accountPath, const QStringList &contactIds);
+    void append(int type, Operation operation, const QString &accountPath, const QStringList &contactIds);
+
+    QString mFileName;
+    QHash<Key, Entry> mEntries;
+    QByteArray mPending;
+    int mRecordCount;
+};
+
+#endif // CDTPOFFLINEROSTERBUFFER_H
@@ -21,6 +21,7 @@
  ** conditions contained in a signed written agreement between you and Nokia.
  **/
 
+#include <TelepathyQt/Constants>
 #include <TelepathyQt/Debug>
 
 #include "cdtpcontroller.h"
@@ -29,6 +30,8 @@
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("tp-account");
+
 CDTpPlugin::CDTpPlugin()
     : mController(0)
 {
@@ -43,13 +46,13 @@ CDTpPlugin::~CDTpPlugin()
 
 void CDTpPlugin::init()
 {
-    debug() << "Initializing contactsd telepathy plugin";
+    debug(logCategory) << "Initializing contactsd telepathy plugin";
 
     Tp::registerTypes();
     Tp::enableDebug(isDebugEnabled());
     Tp::enableWarnings(isWarningsEnabled());
 
-    debug() << "Creating controller";
+    debug(logCategory) << "Creating controller";
     mController = new CDTpController(this);
     // relay signals
     connect(mController,
@@ -69,6 +72,9 @@ CDTpPlugin::MetaData CDTpPlugin::metaData()
     data[metaDataKeyName]    = QVariant(QString::fromLatin1("telepathy"));
     data[metaDataKeyVersion] = QVariant(QString::fromLatin1("0.2"));
     data[metaDataKeyComment] = QVariant(QString::fromLatin1("contactsd telepathy plugin"));
+    // Nothing to do until an account manager runs or buddies are managed
+    data[metaDataKeyActivationServices] = QVariant(QStringList() << TP_QT_ACCOUNT_MANAGER_BUS_NAME);
+    data[metaDataKeyActivationObjectPaths] = QVariant(QStringList() << QString::fromLatin1("/telepathy"));
     return data;
 }
 
@@ -56,29 +56,30 @@
 #include <QContactUrl>
 
 #include "cdtpstorage.h"
+#include "cdtpavatarprovider.h"
+#include "cdtpavatarthumbnailer.h"
 #include "cdtpavatarupdate.h"
+#include "cdtpcontactinfo.h"
+#include "cdtpplugin.h"
 #include "debug.h"
+#include "trace.h"
 
 #include <QElapsedTimer>
+#include <QVector>
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("tp-storage");
+
 // Uncomment for masses of debug output:
 //#define DEBUG_OVERLOAD
 
 // The longer a single batch takes to write, the longer we are locking out other
 // writers (readers should be unaffected).  Using a semaphore write mutex, we should
 // at least have FIFO semantics on lock release.
+// Configured as telepathy/batch-store-size.
 #define BATCH_STORE_SIZE 5
 
-#ifdef USING_QTPIM
-typedef QContactId ContactIdType;
-typedef QList<QContactDetail::DetailType> DetailList;
-#else
-typedef QContactLocalId ContactIdType;
-typedef QStringList DetailList;
-#endif
-
 namespace {
 
 template<int N>
@@ -96,27 +97,6 @@ QString asString(bool f)
     return QLatin1String(f ? "true" : "false");
 }
 
-QString asString(const Tp::ContactInfoField &field, int i)
-{
-    if (i >= field.fieldValue.count()) {
-        return QLatin1String("");
-    }
-
-    return field.fieldValue[i];
-}
-
-QStringList asStringList(const Tp::ContactInfoField &field, int i)
-{
-    QStringList rv;
-
-    while (i < field.fieldValue.count()) {
-        rv.append(field.fieldValue[i]);
-        ++i;
-    }
-
-    return rv;
-}
-
 QString asString(CDTpContact::Info::Capability c)
 {
     switch (c) {
@@ -232,14 +212,17 @@ Q_DEFINE_LATIN1_CONSTANT(QContactTpMetadata::FieldAccountEnabled, "AccountEnable
 
 namespace {
 
+// defaults of telepathy/update-timeout and telepathy/update-threshold
 const int UPDATE_TIMEOUT = 150; // ms
 const int UPDATE_THRESHOLD = 50; // contacts
+const int ACCOUNT_UPDATE_TIMEOUT = 150; // ms
+const int THUMBNAIL_CLEANUP_TIMEOUT = 30000; // ms
 
 #ifdef USING_QTPIM
 const int QContactDetail__ContextDefault = (QContactDetail::ContextOther+1);
 const int QContactDetail__ContextLarge = (QContactDetail::ContextOther+2);
-
-const int QContactName__FieldCustomLabel = (QContactName::FieldSuffix+1);
+const int QContactDetail__ContextListThumbnail = (QContactDetail::ContextOther+3);
+const int QContactDetail__ContextGridThumbnail = (QContactDetail::ContextOther+4);
 
 const int QContactOnlineAccount__FieldAccountPath = (QContactOnlineAccount::FieldSubTypes+1);
 const int QContactOnlineAccount__FieldAccountIconPath = (QContactOnlineAccount::FieldSubTypes+2);
@@ -247,6 +230,8 @@ const int QContactOnlineAccount__FieldEnabled = (QContactOnlineAccount::FieldSub
 #else
 const QLatin1String QContactDetail__ContextDefault("Default");
 const QLatin1String QContactDetail__ContextLarge("Large");
+const QLatin1String QContactDetail__ContextListThumbnail("ListThumbnail");
+const QLatin1String QContactDetail__ContextGridThumbnail("GridThumbnail");
 
 const QLatin1String QContactOnlineAccount__FieldAccountPath("AccountPath");
 const QLatin1String QContactOnlineAccount__FieldAccountIconPath("AccountIconPath");
@@ -287,6 +272,14 @@ DetailList::value_type detailType()
 #endif
 }
 
+DetailList selfContactDetailTypes()
+{
+    // For the self contact, we only care about accounts/presence/avatars
+    return DetailList() << detailType<QContactOnlineAccount>()
+                        << detailType<QContactPresence>()
+                        << detailType<QContactAvatar>();
+}
+
 QContactFetchHint contactFetchHint(bool selfContact = false)
 {
     QContactFetchHint hint;
@@ -297,15 +290,11 @@ QContactFetchHint contactFetchHint(bool selfContact = false)
                               QContactFetchHint::NoBinaryBlobs);
 
     if (selfContact) {
-        // For the self contact, we only care about accounts/presence/avatars
 #ifdef USING_QTPIM
-        hint.setDetailTypesHint(DetailList()
+        hint.setDetailTypesHint(selfContactDetailTypes());
 #else
-        hint.setDetailDefinitionsHint(DetailList()
+        hint.setDetailDefinitionsHint(selfContactDetailTypes());
 #endif
-            << detailType<QContactOnlineAccount>()
-            << detailType<QContactPresence>()
-            << detailType<QContactAvatar>());
     }
 
     return hint;
@@ -343,87 +332,135 @@ ContactIdType selfContactLocalId()
     QList<ContactIdType> selfContactIds = mgr->contactIds(selfFilter);
     if (selfContactIds.count() > 0) {
         if (selfContactIds.count() > 1) {
-            warning() << "Invalid number of telepathy self contacts!" << selfContactIds.count();
+            warning(logCategory) << "Invalid number of telepathy self contacts!" << selfContactIds.count();
         }
         return selfContactIds.first();
     }
 
     // Create a new self contact for telepathy
-    debug() << "Creating self contact";
+    debug(logCategory) << "Creating self contact";
     QContact tpSelf;
 
     QContactSyncTarget syncTarget;
     syncTarget.setSyncTarget(QLatin1String("telepathy"));
 
     if (!tpSelf.saveDetail(&syncTarget)) {
-        warning() << SRC_LOC << "Unable to add sync target to self contact";
-    } else {
-        if (!mgr->saveContact(&tpSelf)) {
-            warning() << "Unable to save empty contact as self contact - error:" << mgr->error();
-        } else {
-            // Now connect our contact to the real self contact
-            QContactRelationship relationship;
+        warning(logCategory) << SRC_LOC << "Unable to add sync target to self contact";
+        return ContactIdType();
+    }
+    if (!mgr->saveContact(&tpSelf)) {
+        warning(logCategory) << "Unable to save empty contact as self contact - error:" << mgr->error();
+        return ContactIdType();
+    }
+
+    // Now connect our contact to the real self contact
+    QContactRelationship relationship;
 #ifdef USING_QTPIM
-            relationship.setRelationshipType(QContactRelationship::Aggregates());
-            relatedContact.setId(selfId);
-            relationship.setFirst(relatedContact);
-            relationship.setSecond(tpSelf);
+    relationship.setRelationshipType(QContactRelationship::Aggregates());
+    relationship.setFirst(relatedContact);
+    relationship.setSecond(tpSelf);
 #else
-            relationship.setRelationshipType(QContactRelationship::Aggregates);
-            relationship.setFirst(selfId);
-            relationship.setSecond(tpSelf.id());
+    relationship.setRelationshipType(QContactRelationship::Aggregates);
+    relationship.setFirst(selfId);
+    relationship.setSecond(tpSelf.id());
 #endif
 
-            if (!mgr->saveRelationship(&relationship)) {
-                warning() << "Unable to save relationship for self contact - error:" << mgr->error();
-                qFatal("Cannot proceed with invalid self contact!");
-            }
+    if (!mgr->saveRelationship(&relationship)) {
+        warning(logCategory) << "Unable to save relationship for self contact - error:" << mgr->error();
+
+        // Don't leave an unlinked self contact behind, the next attempt creates a new one
+        if (!mgr->removeContact(apiId(tpSelf))) {
+            warning(logCategory) << "Unable to remove unlinked self contact - error:" << mgr->error();
+        }
+        return ContactIdType();
+    }
 
-            // Find the aggregate contact created by saving our self contact
+    // Saving our self contact also created an aggregate for it; removing the
+    // relationships to it removes that childless aggregate
+    QList<QContactRelationship> obsoleteRelationships;
 #ifdef USING_QTPIM
-            relationshipFilter.setRelationshipType(QContactRelationship::Aggregates());
-            relatedContact.setId(tpSelf.id());
-            relationshipFilter.setRelatedContact(relatedContact);
+    foreach (const QContactRelationship &aggregation, mgr->relationships(QContactRelationship::Aggregates(), tpSelf, QContactRelationship::Second)) {
+        if (aggregation.first().id() != selfId) {
+            obsoleteRelationships.append(aggregation);
+        }
+    }
 #else
-            relationshipFilter.setRelationshipType(QContactRelationship::Aggregates);
-            relationshipFilter.setRelatedContactId(tpSelf.id());
+    foreach (const QContactRelationship &aggregation, mgr->relationships(QContactRelationship::Aggregates, tpSelf.id(), QContactRelationship::Second)) {
+        if (aggregation.first() != selfId) {
+            obsoleteRelationships.append(aggregation);
+        }
+    }
 #endif
-            relationshipFilter.setRelatedContactRole(QContactRelationship::Second);
 
-            foreach (const QContact &aggregator, mgr->contacts(relationshipFilter)) {
-                if (aggregator.id() == tpSelf.id())
-                    continue;
+    if (!obsoleteRelationships.isEmpty() && !mgr->removeRelationships(obsoleteRelationships)) {
+        warning(logCategory) << "Unable to remove relationships for self contact - error:" << mgr->error();
+    }
 
-                // Remove the relationship between these contacts (which removes the childless aggregate)
-                QContactRelationship relationship;
+    return apiId(tpSelf);
+}
+
+QString selfContactStampPath()
+{
+    return CDTpPlugin::cacheFileName(QLatin1String("telepathy-self-contact"));
+}
+
+ContactIdType readSelfContactStamp()
+{
+    QFile file(selfContactStampPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return ContactIdType();
+    }
+
+    // The stamp names the real self contact, then the telepathy one it aggregates
+    const QStringList values(QString::fromLatin1(file.readAll()).split(QLatin1Char('\n'), QString::SkipEmptyParts));
+    if (values.count() != 2 || values.at(0) != asString(manager()->selfContactId())) {
+        debug(logCategory) << "Discarding self contact stamp of another self contact";
+        file.remove();
+        return ContactIdType();
+    }
+
+    const QString value(values.at(1));
 #ifdef USING_QTPIM
-                relationship.setRelationshipType(QContactRelationship::Aggregates());
-                relationship.setFirst(aggregator);
-                relationship.setSecond(tpSelf);
+    const ContactIdType id(QContactId::fromString(value));
 #else
-                relationship.setRelationshipType(QContactRelationship::Aggregates);
-                relationship.setFirst(aggregator.id());
-                relationship.setSecond(tpSelf.id());
+    const ContactIdType id(value.toUInt());
 #endif
+    if (id == ContactIdType()) {
+        return id;
+    }
 
-                if (!mgr->removeRelationship(relationship)) {
-                    warning() << "Unable to remove relationship for self contact - error:" << mgr->error();
-                }
-            }
+    // The database may have been reset since the stamp was written; the
+    // relationship query is what the stamp saves, so it isn't repeated here
+#ifdef USING_QTPIM
+    QContactIdFilter idFilter;
+#else
+    QContactLocalIdFilter idFilter;
+#endif
+    idFilter.setIds(QList<ContactIdType>() << id);
 
-            return apiId(tpSelf);
-        }
+    QContactIntersectionFilter filter;
+    filter << idFilter;
+    filter << matchTelepathyFilter();
+
+    if (manager()->contactIds(filter).isEmpty()) {
+        debug(logCategory) << "Discarding stale self contact stamp:" << value;
+        file.remove();
+        return ContactIdType();
     }
 
-    return ContactIdType();
+    return id;
 }
 
-QContact selfContact()
+void writeSelfContactStamp(const ContactIdType &id)
 {
-    static ContactIdType selfLocalId(selfContactLocalId());
-    static QContactFetchHint hint(contactFetchHint(true));
+    // A damaged stamp only costs a relationship query on the next start
+    QFile file(selfContactStampPath());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        warning(logCategory) << "Unable to write self contact stamp" << file.fileName() << "error:" << file.errorString();
+        return;
+    }
 
-    return manager()->contact(selfLocalId, hint);
+    file.write(asString(manager()->selfContactId()).toLatin1() + '\n' + asString(id).toLatin1() + '\n');
 }
 
 template<typename Debug>
@@ -462,14 +499,14 @@ Debug output(Debug debug, const QContact &contact)
 bool storeContactDetail(QContact &contact, QContactDetail &detail, const QString &location)
 {
 #ifdef DEBUG_OVERLOAD
-    debug() << "  Storing" << detailType(detail) << "from:" << location;
-    output(debug(), detail);
+    debug(logCategory) << "  Storing" << detailType(detail) << "from:" << location;
+    output(debug(logCategory), detail);
 #endif
 
     if (!contact.saveDetail(&detail)) {
-        debug() << "  Failed storing" << detailType(detail) << "from:" << location;
+        debug(logCategory) << "  Failed storing" << detailType(detail) << "from:" << location;
 #ifndef DEBUG_OVERLOAD
-        output(debug(), detail);
+        output(debug(logCategory), detail);
 #endif
         return false;
     }
@@ -508,24 +545,24 @@ bool storeContact(QContact &contact, const QString &location, CDTpContact::Chang
     }
 
 #ifdef DEBUG_OVERLOAD
-    debug() << "Storing contact" << asString(apiId(contact)) << "from:" << location;
-    output(debug(), contact);
+    debug(logCategory) << "Storing contact" << asString(apiId(contact)) << "from:" << location;
+    output(debug(logCategory), contact);
 #endif
 
     if (minimizedUpdate) {
         if (!manager()->saveContacts(&contacts, contactChangesList(changes))) {
-            warning() << "Failed minimized storing contact" << asString(apiId(contact)) << "from:" << location << "error:" << manager()->error();
+            warning(logCategory) << "Failed minimized storing contact" << asString(apiId(contact)) << "from:" << location << "error:" << manager()->error();
 #ifndef DEBUG_OVERLOAD
-            output(debug(), contact);
+            output(debug(logCategory), contact);
 #endif
-            debug() << "Updates" << updates;
+            debug(logCategory) << "Updates" << updates;
             return false;
         }
     } else {
         if (!manager()->saveContact(&contact)) {
-            warning() << "Failed storing contact" << asString(apiId(contact)) << "from:" << location;
+            warning(logCategory) << "Failed storing contact" << asString(apiId(contact)) << "from:" << location;
 #ifndef DEBUG_OVERLOAD
-            output(debug(), contact);
+            output(debug(logCategory), contact);
 #endif
             return false;
         }
@@ -533,43 +570,81 @@ bool storeContact(QContact &contact, const QString &location, CDTpContact::Chang
     return true;
 }
 
-void updateContacts(const QString &location, QList<QContact> *saveList, QList<ContactIdType> *removeList)
+bool saveContactBatch(QList<QContact> *batch, const DetailList &types, QMap<int, QContactManager::Error> *errorMap)
+{
+    if (types.isEmpty()) {
+        return manager()->saveContacts(batch, errorMap);
+    }
+
+    return manager()->saveContacts(batch, types, errorMap);
+}
+
+void updateContacts(const QString &location, ContactSaveList *saveList, QList<ContactIdType> *removeList)
 {
     if (saveList && !saveList->isEmpty()) {
         QElapsedTimer t;
         t.start();
 
-        // Try to store contacts in batches
-        int storedCount = 0;
-        while (storedCount < saveList->count()) {
-            QList<QContact> batch(saveList->mid(storedCount, BATCH_STORE_SIZE));
-            storedCount += BATCH_STORE_SIZE;
-
-            do {
-                QMap<int, QContactManager::Error> errorMap;
-                if (manager()->saveContacts(&batch, &errorMap)) {
-                    // We could copy the updated contacts back into saveList here, but it doesn't seem warranted
-                    break;
-                }
+        // Group the contacts by the detail types they need written, so that each
+        // batch can be restricted to those types
+        QList<DetailList> groupTypes;
+        QList<QList<QContact> > groupContacts;
+
+        ContactSaveList::const_iterator sit = saveList->constBegin(), send = saveList->constEnd();
+        for ( ; sit != send; ++sit) {
+            int index = groupTypes.indexOf(sit->second);
+            if (index == -1) {
+                index = groupTypes.count();
+                groupTypes.append(sit->second);
+                groupContacts.append(QList<QContact>());
+            }
+            groupContacts[index].append(sit->first);
+        }
 
-                const int errorCount = errorMap.count();
-                if (!errorCount) {
-                    break;
-                }
+        const int batchSize = CDTpPlugin::config()->intValue(
+                QLatin1String("telepathy/batch-store-size"), BATCH_STORE_SIZE, 1);
+
+        for (int group = 0; group < groupTypes.count(); ++group) {
+            const DetailList &types(groupTypes.at(group));
+            const QList<QContact> &contacts(groupContacts.at(group));
+
+            // Try to store contacts in batches
+            int storedCount = 0;
+            while (storedCount < contacts.count()) {
+                QList<QContact> batch(contacts.mid(storedCount, batchSize));
+                storedCount += batchSize;
 
-                // Remove the problematic contacts
-                QList<int> indices = errorMap.keys();
-                QList<int>::const_iterator begin = indices.begin(), it = begin + errorCount;
                 do {
-                    int errorIndex = (*--it);
-                    const QContact &badContact(batch.at(errorIndex));
-                    warning() << "Failed storing contact" << asString(apiId(badContact)) << "from:" << location;
-                    output(debug(), badContact);
-                    batch.removeAt(errorIndex);
-                } while (it != begin);
-            } while (true);
+                    TraceSpan span("tp.batch-save", batch.count());
+
+                    QMap<int, QContactManager::Error> errorMap;
+                    if (saveContactBatch(&batch, types, &errorMap)) {
+                        // We could copy the updated contacts back into saveList here, but it doesn't seem warranted
+                        break;
+                    }
+
+                    const int errorCount = errorMap.count();
+                    if (!errorCount) {
+                        break;
+                    }
+
+                    // Remove the problematic contacts
+                    QList<int> indices = errorMap.keys();
+                    QList<int>::const_iterator begin = indices.begin(), it = begin + errorCount;
+                    do {
+                        int errorIndex = (*--it);
+                        const QContact &badContact(batch.at(errorIndex));
+                        warning(logCategory) << "Failed storing contact" << asString(apiId(badContact)) << "from:" << location;
+                        output(debug(logCategory), badContact);
+                        batch.removeAt(errorIndex);
+                    } while (it != begin);
+                } while (true);
+            }
         }
-        debug() << "Updated" << saveList->count() << "batched contacts - elapsed:" << t.elapsed();
+        debug(logCategory) << "Updated" << saveList->count() << "batched contacts in" << groupTypes.count() << "groups - elapsed:" << t.elapsed();
+
+        static Counter *contactsWritten = CDTpPlugin::counter(QLatin1String("telepathy.contacts-written"));
+        contactsWritten->add(saveList->count());
     }
 
     if (removeList && !removeList->isEmpty()) {
@@ -579,10 +654,10 @@ void updateContacts(const QString &location, QList<QContact> *saveList, QList<Co
         QList<ContactIdType>::iterator it = removeList->begin(), end = removeList->end();
         for ( ; it != end; ++it) {
             if (!manager()->removeContact(*it)) {
-                warning() << "Unable to remove contact";
+                warning(logCategory) << "Unable to remove contact";
             }
         }
-        debug() << "Removed" << removeList->count() << "individual contacts - elapsed:" << t.elapsed();
+        debug(logCategory) << "Removed" << removeList->count() << "individual contacts - elapsed:" << t.elapsed();
     }
 }
 
@@ -594,6 +669,21 @@ QList<ContactIdType> findContactIdsForAccount(const QString &accountPath)
     return manager()->contactIds(filter);
 }
 
+QList<QContact> findContactsForAccount(const QString &accountPath, const DetailList &detailTypes)
+{
+    QContactFetchHint hint(contactFetchHint());
+#ifdef USING_QTPIM
+    hint.setDetailTypesHint(detailTypes);
+#else
+    hint.setDetailDefinitionsHint(detailTypes);
+#endif
+
+    QContactIntersectionFilter filter;
+    filter << QContactTpMetadata::matchAccountId(accountPath);
+    filter << matchTelepathyFilter();
+    return manager()->contacts(filter, QList<QContactSortOrder>(), hint);
+}
+
 QHash<QString, QContact> findExistingContacts(const QStringList &contactAddresses)
 {
     static QContactFetchHint hint(contactFetchHint());
@@ -662,10 +752,50 @@ QContact findExistingContact(const QString &contactAddress)
         return contact;
     }
 
-    debug() << "No matching contact:" << contactAddress;
+    debug(logCategory) << "No matching contact:" << contactAddress;
     return QContact();
 }
 
+QList<ContactIdType> findContactIdsForAddresses(const QStringList &contactAddresses)
+{
+    QList<ContactIdType> ids;
+
+    // The contact IDs are all we need, so only fetch the metadata detail
+    QContactFetchHint hint(contactFetchHint());
+#ifdef USING_QTPIM
+    hint.setDetailTypesHint(DetailList() << QContactTpMetadata::Type);
+#else
+    hint.setDetailDefinitionsHint(DetailList() << QContactTpMetadata::DefinitionName);
+#endif
+
+    // A large union filter costs more than scanning the metadata of all contacts
+    const int maxDirectMatches = 10;
+    if (contactAddresses.count() > maxDirectMatches) {
+        const QSet<QString> addressSet(contactAddresses.toSet());
+
+        foreach (const QContact &contact, manager()->contacts(matchTelepathyFilter(), QList<QContactSortOrder>(), hint)) {
+            if (addressSet.contains(contact.detail<QContactTpMetadata>().contactId())) {
+                ids.append(apiId(contact));
+            }
+        }
+    } else {
+        QContactIntersectionFilter filter;
+        filter << matchTelepathyFilter();
+
+        QContactUnionFilter addressFilter;
+        foreach (const QString &address, contactAddresses) {
+            addressFilter << QContactTpMetadata::matchContactId(address);
+        }
+        filter << addressFilter;
+
+        foreach (const QContact &contact, manager()->contacts(filter, QList<QContactSortOrder>(), hint)) {
+            ids.append(apiId(contact));
+        }
+    }
+
+    return ids;
+}
+
 template<typename T>
 T findLinkedDetail(const QContact &owner, const QContactDetail &link)
 {
@@ -774,7 +904,7 @@ QContactPresence::PresenceState qContactPresenceState(Tp::ConnectionPresenceType
         break;
 
     default:
-        warning() << "Unknown telepathy presence status" << presenceType;
+        warning(logCategory) << "Unknown telepathy presence status" << presenceType;
         break;
     }
 
@@ -800,84 +930,80 @@ bool isOnlinePresence(Tp::ConnectionPresenceType presenceType, Tp::AccountPtr ac
     return true;
 }
 
-QStringList currentCapabilites(const Tp::CapabilitiesBase &capabilities, Tp::ConnectionPresenceType presenceType, Tp::AccountPtr account)
+QVector<QStringList> initCapabilityNames()
 {
-    QStringList current;
+    // One entry for each combination of the CDTpContact::Info::Capability flags
+    QVector<QStringList> names(1 << 8);
 
-    if (capabilities.textChats()) {
-        current << asString(CDTpContact::Info::TextChats);
-    }
-
-    if (isOnlinePresence(presenceType, account)) {
-        if (capabilities.streamedMediaCalls()) {
-            current << asString(CDTpContact::Info::StreamedMediaCalls);
-        }
-        if (capabilities.streamedMediaAudioCalls()) {
-            current << asString(CDTpContact::Info::StreamedMediaAudioCalls);
-        }
-        if (capabilities.streamedMediaVideoCalls()) {
-            current << asString(CDTpContact::Info::StreamedMediaAudioVideoCalls);
-        }
-        if (capabilities.upgradingStreamedMediaCalls()) {
-            current << asString(CDTpContact::Info::UpgradingStreamMediaCalls);
-        }
-        if (capabilities.fileTransfers()) {
-            current << asString(CDTpContact::Info::FileTransfers);
+    for (int caps = 0; caps < names.count(); ++caps) {
+        for (int bit = 0; bit < 8; ++bit) {
+            if (caps & (1 << bit)) {
+                names[caps] << asString(static_cast<CDTpContact::Info::Capability>(1 << bit));
+            }
         }
     }
 
-    return current;
+    return names;
 }
 
-void updateContactAvatars(QContact &contact, const QString &defaultAvatarPath, const QString &largeAvatarPath, const QContactOnlineAccount &qcoa)
+const QStringList &capabilityNames(CDTpContact::Info::Capabilities caps)
 {
-    QContactAvatar defaultAvatar;
-    QContactAvatar largeAvatar;
+    static const QVector<QStringList> names(initCapabilityNames());
+    return names.at(caps & (names.count() - 1));
+}
+
+QStringList currentCapabilites(CDTpContact::Info::Capabilities capabilities, Tp::ConnectionPresenceType presenceType, Tp::AccountPtr account)
+{
+    if (!isOnlinePresence(presenceType, account)) {
+        // Only text chats are possible while offline
+        capabilities &= CDTpContact::Info::TextChats;
+    }
+
+    return capabilityNames(capabilities);
+}
 
-    foreach (const QContactAvatar &detail, contact.details<QContactAvatar>()) {
 #ifdef USING_QTPIM
-        const QList<int> &contexts(detail.contexts());
+typedef int ContextType;
 #else
-        const QStringList &contexts(detail.contexts());
+typedef QString ContextType;
 #endif
-        if (contexts.contains(QContactDetail__ContextDefault)) {
-            defaultAvatar = detail;
-        } else if (contexts.contains(QContactDetail__ContextLarge)) {
-            largeAvatar = detail;
-        }
-    }
 
-    if (defaultAvatarPath.isEmpty()) {
-        if (!defaultAvatar.isEmpty()) {
-            if (!contact.removeDetail(&defaultAvatar)) {
-                warning() << SRC_LOC << "Unable to remove default avatar from contact:" << contact.id();
-            }
-        }
-    } else {
-        defaultAvatar.setImageUrl(QUrl::fromLocalFile(defaultAvatarPath));
-        defaultAvatar.setContexts(QContactDetail__ContextDefault);
-        defaultAvatar.setLinkedDetailUris(qcoa.detailUri());
-        if (!storeContactDetail(contact, defaultAvatar, SRC_LOC)) {
-            warning() << SRC_LOC << "Unable to save default avatar for contact:" << contact.id();
+void updateContactAvatar(QContact &contact, const ContextType &context, const QString &avatarPath, const QContactOnlineAccount &qcoa)
+{
+    QContactAvatar avatar;
+
+    foreach (const QContactAvatar &detail, contact.details<QContactAvatar>()) {
+        if (detail.contexts().contains(context)) {
+            avatar = detail;
         }
     }
 
-    if (largeAvatarPath.isEmpty()) {
-        if (!largeAvatar.isEmpty()) {
-            if (!contact.removeDetail(&largeAvatar)) {
-                warning() << SRC_LOC << "Unable to remove large avatar from contact:" << contact.id();
+    if (avatarPath.isEmpty()) {
+        if (!avatar.isEmpty()) {
+            if (!contact.removeDetail(&avatar)) {
+                warning(logCategory) << SRC_LOC << "Unable to remove avatar from contact:" << contact.id() << "context:" << context;
             }
         }
     } else {
-        largeAvatar.setImageUrl(QUrl::fromLocalFile(largeAvatarPath));
-        largeAvatar.setContexts(QContactDetail__ContextLarge);
-        largeAvatar.setLinkedDetailUris(qcoa.detailUri());
-        if (!storeContactDetail(contact, largeAvatar, SRC_LOC)) {
-            warning() << SRC_LOC << "Unable to save large avatar for contact:" << contact.id();
+        avatar.setImageUrl(QUrl::fromLocalFile(avatarPath));
+        avatar.setContexts(context);
+        avatar.setLinkedDetailUris(qcoa.detailUri());
+        if (!storeContactDetail(contact, avatar, SRC_LOC)) {
+            warning(logCategory) << SRC_LOC << "Unable to save avatar for contact:" << contact.id() << "context:" << context;
         }
     }
 }
 
+void updateContactAvatars(QContact &contact, CDTpContactPtr contactWrapper, const QContactOnlineAccount &qcoa)
+{
+    updateContactAvatar(contact, QContactDetail__ContextDefault, contactWrapper->defaultAvatarPath(), qcoa);
+    updateContactAvatar(contact, QContactDetail__ContextLarge, contactWrapper->largeAvatarPath(), qcoa);
+
+    // Downscaled copies, so that clients don't need to decode the full image for lists and grids
+    updateContactAvatar(contact, QContactDetail__ContextListThumbnail, contactWrapper->listThumbnailPath(), qcoa);
+    updateContactAvatar(contact, QContactDetail__ContextGridThumbnail, contactWrapper->gridThumbnailPath(), qcoa);
+}
+
 QString saveAccountAvatar(CDTpAccountPtr accountWrapper)
 {
     const Tp::Avatar &avatar = accountWrapper->account()->avatar();
@@ -893,7 +1019,7 @@ QString saveAccountAvatar(CDTpAccountPtr accountWrapper)
 
     QFile avatarFile(fileName);
     if (!avatarFile.open(QIODevice::WriteOnly)) {
-        warning() << "Unable to save account avatar: error opening avatar file" << fileName << "for writing";
+        warning(logCategory) << "Unable to save account avatar: error opening avatar file" << fileName << "for writing";
         return QString();
     }
     avatarFile.write(avatar.avatarData);
@@ -902,11 +1028,8 @@ QString saveAccountAvatar(CDTpAccountPtr accountWrapper)
     return fileName;
 }
 
-void updateFacebookAvatar(QNetworkAccessManager &network, CDTpContactPtr contactWrapper, const QString &facebookId, const QString &avatarType)
+void updateSocialAvatar(QNetworkAccessManager &network, CDTpContactPtr contactWrapper, const QUrl &avatarUrl, const QString &avatarType)
 {
-    const QUrl avatarUrl(QLatin1String("http://graph.facebook.com/") % facebookId %
-                         QLatin1String("/picture?type=") % avatarType);
-
     // CDTpAvatarUpdate keeps a weak reference to CDTpContact, since the contact is
     // also its parent. If we'd pass a CDTpContactPtr to the update, it'd keep a ref that
     // keeps the CDTpContact alive. Then, if the update is the last object to hold
@@ -924,20 +1047,19 @@ void updateFacebookAvatar(QNetworkAccessManager &network, CDTpContactPtr contact
 
 void updateSocialAvatars(QNetworkAccessManager &network, CDTpContactPtr contactWrapper)
 {
-    if (network.networkAccessible() == QNetworkAccessManager::NotAccessible) {
+    const CDTpAvatarProvider *const provider = contactWrapper->avatarProvider();
+
+    if (provider == 0) {
         return;
     }
 
-    QRegExp facebookIdPattern(QLatin1String("-(\\d+)@chat\\.facebook\\.com"));
-
-    if (not facebookIdPattern.exactMatch(contactWrapper->contact()->id())) {
-        return; // only supporting Facebook avatars right now
+    if (provider->requiresNetwork() && network.networkAccessible() == QNetworkAccessManager::NotAccessible) {
+        return;
     }
 
-    const QString socialId = facebookIdPattern.cap(1);
-
-    updateFacebookAvatar(network, contactWrapper, socialId, CDTpAvatarUpdate::Large);
-    updateFacebookAvatar(network, contactWrapper, socialId, CDTpAvatarUpdate::Square);
+    foreach (const QString &avatarType, provider->avatarTypes()) {
+        updateSocialAvatar(network, contactWrapper, provider->avatarUrl(contactWrapper->socialId(), avatarType), avatarType);
+    }
 }
 
 CDTpContact::Changes updateAccountDetails(QContact &self, QContactOnlineAccount &qcoa, QContactPresence &presence, CDTpAccountPtr accountWrapper, CDTpAccount::Changes changes)
@@ -945,7 +1067,7 @@ CDTpContact::Changes updateAccountDetails(QContact &self, QContactOnlineAccount
     CDTpContact::Changes selfChanges = 0;
 
     const QString accountPath(imAccount(accountWrapper));
-    debug() << "Update account" << accountPath;
+    debug(logCategory) << "Update account" << accountPath;
 
     Tp::AccountPtr account = accountWrapper->account();
 
@@ -982,7 +1104,7 @@ CDTpContact::Changes updateAccountDetails(QContact &self, QContactOnlineAccount
         if (avatarPath.isEmpty()) {
             if (!avatar.isEmpty()) {
                 if (!self.removeDetail(&avatar)) {
-                    warning() << SRC_LOC << "Unable to remove avatar for account:" << accountPath;
+                    warning(logCategory) << SRC_LOC << "Unable to remove avatar for account:" << accountPath;
                 }
             }
         } else {
@@ -990,7 +1112,7 @@ CDTpContact::Changes updateAccountDetails(QContact &self, QContactOnlineAccount
             avatar.setContexts(QContactDetail__ContextDefault);
 
             if (!storeContactDetail(self, avatar, SRC_LOC)) {
-                warning() << SRC_LOC << "Unable to save avatar for account:" << accountPath;
+                warning(logCategory) << SRC_LOC << "Unable to save avatar for account:" << accountPath;
             }
         }
 
@@ -1000,96 +1122,25 @@ CDTpContact::Changes updateAccountDetails(QContact &self, QContactOnlineAccount
     if (selfChanges & CDTpContact::Capabilities) {
         // The account has changed
         if (!storeContactDetail(self, qcoa, SRC_LOC)) {
-            warning() << SRC_LOC << "Unable to save details for self account:" << accountPath;
+            warning(logCategory) << SRC_LOC << "Unable to save details for self account:" << accountPath;
         }
     }
 
     if (selfChanges & CDTpContact::Presence) {
         if (!storeContactDetail(self, presence, SRC_LOC)) {
-            warning() << SRC_LOC << "Unable to save presence for self account:" << accountPath;
+            warning(logCategory) << SRC_LOC << "Unable to save presence for self account:" << accountPath;
         }
     }
 
     return selfChanges;
 }
 
-template<typename DetailType>
-void deleteContactDetails(QContact &existing)
-{
-    foreach (DetailType detail, existing.details<DetailType>()) {
-        if (!existing.removeDetail(&detail)) {
-            warning() << SRC_LOC << "Unable to remove obsolete detail:" << detail.detailUri();
-        }
-    }
-}
-
 #ifdef USING_QTPIM
 typedef QHash<QString, int> Dictionary;
 #else
 typedef QHash<QString, QString> Dictionary;
 #endif
 
-Dictionary initPhoneTypes()
-{
-    Dictionary types;
-
-    types.insert(QLatin1String("bbsl"), QContactPhoneNumber::SubTypeBulletinBoardSystem);
-    types.insert(QLatin1String("car"), QContactPhoneNumber::SubTypeCar);
-    types.insert(QLatin1String("cell"), QContactPhoneNumber::SubTypeMobile);
-    types.insert(QLatin1String("fax"), QContactPhoneNumber::SubTypeFax);
-    types.insert(QLatin1String("modem"), QContactPhoneNumber::SubTypeModem);
-    types.insert(QLatin1String("pager"), QContactPhoneNumber::SubTypePager);
-    types.insert(QLatin1String("video"), QContactPhoneNumber::SubTypeVideo);
-    types.insert(QLatin1String("voice"), QContactPhoneNumber::SubTypeVoice);
-    // Not sure about these types:
-    types.insert(QLatin1String("isdn"), QContactPhoneNumber::SubTypeLandline);
-    types.insert(QLatin1String("pcs"), QContactPhoneNumber::SubTypeLandline);
-
-    return types;
-}
-
-const Dictionary &phoneTypes()
-{
-    static Dictionary types(initPhoneTypes());
-    return types;
-}
-
-Dictionary initAddressTypes()
-{
-    Dictionary types;
-
-    types.insert(QLatin1String("dom"), QContactAddress::SubTypeDomestic);
-    types.insert(QLatin1String("intl"), QContactAddress::SubTypeInternational);
-    types.insert(QLatin1String("parcel"), QContactAddress::SubTypeParcel);
-    types.insert(QLatin1String("postal"), QContactAddress::SubTypePostal);
-
-    return types;
-}
-
-const Dictionary &addressTypes()
-{
-    static Dictionary types(initAddressTypes());
-    return types;
-}
-
-Dictionary initGenderTypes()
-{
-    Dictionary types;
-
-    types.insert(QLatin1String("f"), QContactGender::GenderFemale);
-    types.insert(QLatin1String("female"), QContactGender::GenderFemale);
-    types.insert(QLatin1String("m"), QContactGender::GenderMale);
-    types.insert(QLatin1String("male"), QContactGender::GenderMale);
-
-    return types;
-}
-
-const Dictionary &genderTypes()
-{
-    static Dictionary types(initGenderTypes());
-    return types;
-}
-
 #ifdef USING_QTPIM
 Dictionary initProtocolTypes()
 {
@@ -1125,10 +1176,64 @@ const QString &protocolType(const QString &protocol)
 }
 #endif
 
-void updateContactDetails(QNetworkAccessManager &network, QContact &existing, CDTpContactPtr contactWrapper, CDTpContact::Changes changes)
+CDTpContactInfoMapper &contactInfoMapper()
+{
+    static CDTpContactInfoMapper mapper;
+    return mapper;
+}
+
+template<typename DetailType>
+void updateInfoDetails(QContact &existing, const QList<QContactDetail> &mapped, DetailList *updates)
+{
+    const DetailList::value_type type(detailType<DetailType>());
+
+    QList<DetailType> obsolete(existing.details<DetailType>());
+    QList<QContactDetail> added;
+
+    // Keep the stored details that still match, so that only real changes are written
+    foreach (const QContactDetail &detail, mapped) {
+        if (detailType(detail) != type) {
+            continue;
+        }
+
+        bool found = false;
+        for (int i = 0; i < obsolete.count(); ++i) {
+            if (contactInfoMapper().matches(obsolete.at(i), detail)) {
+                obsolete.removeAt(i);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            added.append(detail);
+        }
+    }
+
+    if (obsolete.isEmpty() && added.isEmpty()) {
+        return;
+    }
+
+    foreach (DetailType detail, obsolete) {
+        if (!existing.removeDetail(&detail)) {
+            warning(logCategory) << SRC_LOC << "Unable to remove obsolete detail:" << detail.detailUri();
+        }
+    }
+    for (QList<QContactDetail>::iterator it = added.begin(); it != added.end(); ++it) {
+        if (!storeContactDetail(existing, *it, SRC_LOC)) {
+            warning(logCategory) << SRC_LOC << "Unable to save contact info to contact:" << asString(apiId(existing));
+        }
+    }
+
+    if (!updates->contains(type)) {
+        updates->append(type);
+    }
+}
+
+// Returns the detail types that were modified in the contact
+DetailList updateContactDetails(QNetworkAccessManager &network, QContact &existing, CDTpContactPtr contactWrapper, CDTpContact::Changes changes)
 {
     const QString contactAddress(imAddress(contactWrapper));
-    debug() << "Update contact" << contactAddress;
+    debug(logCategory) << "Update contact" << contactAddress;
 
     Tp::ContactPtr contact = contactWrapper->contact();
 
@@ -1138,7 +1243,7 @@ void updateContactDetails(QNetworkAccessManager &network, QContact &existing, CD
         nickname.setNickname(contact->alias().trimmed());
 
         if (!storeContactDetail(existing, nickname, SRC_LOC)) {
-            warning() << SRC_LOC << "Unable to save alias to contact for:" << contactAddress;
+            warning(logCategory) << SRC_LOC << "Unable to save alias to contact for:" << contactAddress;
         }
 
         // The alias is also reflected in the presence
@@ -1154,7 +1259,7 @@ void updateContactDetails(QNetworkAccessManager &network, QContact &existing, CD
         presence.setNickname(contact->alias().trimmed());
 
         if (!storeContactDetail(existing, presence, SRC_LOC)) {
-            warning() << SRC_LOC << "Unable to save presence to contact for:" << contactAddress;
+            warning(logCategory) << SRC_LOC << "Unable to save presence to contact for:" << contactAddress;
         }
 
         // Since we use static account capabilities as fallback, each presence also implies
@@ -1164,302 +1269,50 @@ void updateContactDetails(QNetworkAccessManager &network, QContact &existing, CD
     }
     if (changes & CDTpContact::Capabilities) {
         QContactOnlineAccount qcoa = existing.detail<QContactOnlineAccount>();
-        qcoa.setCapabilities(currentCapabilites(contact->capabilities(), contact->presence().type(), contactWrapper->accountWrapper()->account()));
+        qcoa.setCapabilities(currentCapabilites(contactWrapper->capabilities(), contact->presence().type(), contactWrapper->accountWrapper()->account()));
 
         if (!storeContactDetail(existing, qcoa, SRC_LOC)) {
-            warning() << SRC_LOC << "Unable to save capabilities to contact for:" << contactAddress;
+            warning(logCategory) << SRC_LOC << "Unable to save capabilities to contact for:" << contactAddress;
         }
     }
-    if (changes & CDTpContact::Information) {
-        if (contactWrapper->isInformationKnown()) {
-            // Delete any existing info we have for this contact
-            deleteContactDetails<QContactAddress>(existing);
-            deleteContactDetails<QContactBirthday>(existing);
-            deleteContactDetails<QContactEmailAddress>(existing);
-            deleteContactDetails<QContactGender>(existing);
-            deleteContactDetails<QContactName>(existing);
-            deleteContactDetails<QContactNickname>(existing);
-            deleteContactDetails<QContactNote>(existing);
-            deleteContactDetails<QContactOrganization>(existing);
-            deleteContactDetails<QContactPhoneNumber>(existing);
-            deleteContactDetails<QContactUrl>(existing);
-
-            Tp::ContactInfoFieldList listContactInfo = contact->infoFields().allFields();
-            if (listContactInfo.count() != 0) {
-#ifdef USING_QTPIM
-                const int defaultContext(QContactDetail::ContextOther);
-                const int homeContext(QContactDetail::ContextHome);
-                const int workContext(QContactDetail::ContextWork);
-#else
-                const QLatin1String defaultContext("Other");
-                const QLatin1String homeContext("Home");
-                const QLatin1String workContext("Work");
-#endif
-
-                QContactOrganization organizationDetail;
-                QContactName nameDetail;
 
-                // Add any information reported by telepathy
-                foreach (const Tp::ContactInfoField &field, listContactInfo) {
-                    if (field.fieldValue.count() == 0) {
-                        continue;
-                    }
+    DetailList updates(contactChangesList(changes));
 
-                    // Extract field types
-                    QStringList subTypes;
-#ifdef USING_QTPIM
-                    int detailContext = -1;
-                    const int invalidContext = -1;
-#else
-                    QString detailContext;
-                    const QString invalidContext;
-#endif
-
-                    foreach (const QString &param, field.parameters) {
-                        if (!param.startsWith(QLatin1String("type="))) {
-                            continue;
-                        }
-                        const QString type = param.mid(5);
-                        if (type == QLatin1String("home")) {
-                            detailContext = homeContext;
-                        } else if (type == QLatin1String("work")) {
-                            detailContext = workContext;
-                        } else if (!subTypes.contains(type)){
-                            subTypes << type;
-                        }
-                    }
-
-                    if (field.fieldName == QLatin1String("tel")) {
-#ifdef USING_QTPIM
-                        QList<int> selectedTypes;
-#else
-                        QStringList selectedTypes;
-#endif
-                        foreach (const QString &type, subTypes) {
-                            Dictionary::const_iterator it = phoneTypes().find(type.toLower());
-                            if (it != phoneTypes().constEnd()) {
-                                selectedTypes.append(*it);
-                            }
-                        }
-                        if (selectedTypes.isEmpty()) {
-                            // Assume landline
-                            selectedTypes.append(QContactPhoneNumber::SubTypeLandline);
-                        }
-
-                        QContactPhoneNumber phoneNumberDetail;
-                        phoneNumberDetail.setContexts(detailContext == invalidContext ? defaultContext : detailContext);
-                        phoneNumberDetail.setNumber(asString(field, 0));
-                        phoneNumberDetail.setSubTypes(selectedTypes);
-
-                        if (!storeContactDetail(existing, phoneNumberDetail, SRC_LOC)) {
-                            warning() << SRC_LOC << "Unable to save phone number to contact";
-                        }
-                    } else if (field.fieldName == QLatin1String("adr")) {
-#ifdef USING_QTPIM
-                        QList<int> selectedTypes;
-#else
-                        QStringList selectedTypes;
-#endif
-                        foreach (const QString &type, subTypes) {
-                            Dictionary::const_iterator it = addressTypes().find(type.toLower());
-                            if (it != addressTypes().constEnd()) {
-                                selectedTypes.append(*it);
-                            }
-                        }
-
-                        // QContactAddress does not support extended street address, so combine the fields
-                        QString streetAddress(asString(field, 1) + QLatin1Char('\n') + asString(field, 2));
-
-                        QContactAddress addressDetail;
-                        if (detailContext != invalidContext) {
-                            addressDetail.setContexts(detailContext);
-                        }
-                        if (selectedTypes.isEmpty()) {
-                            addressDetail.setSubTypes(selectedTypes);
-                        }
-                        addressDetail.setPostOfficeBox(asString(field, 0));
-                        addressDetail.setStreet(streetAddress);
-                        addressDetail.setLocality(asString(field, 3));
-                        addressDetail.setRegion(asString(field, 4));
-                        addressDetail.setPostcode(asString(field, 5));
-                        addressDetail.setCountry(asString(field, 6));
-
-                        if (!storeContactDetail(existing, addressDetail, SRC_LOC)) {
-                            warning() << SRC_LOC << "Unable to save address to contact";
-                        }
-                    } else if (field.fieldName == QLatin1String("email")) {
-                        QContactEmailAddress emailDetail;
-                        if (detailContext != invalidContext) {
-                            emailDetail.setContexts(detailContext);
-                        }
-                        emailDetail.setEmailAddress(asString(field, 0));
-
-                        if (!storeContactDetail(existing, emailDetail, SRC_LOC)) {
-                            warning() << SRC_LOC << "Unable to save email address to contact";
-                        }
-                    } else if (field.fieldName == QLatin1String("url")) {
-                        QContactUrl urlDetail;
-                        if (detailContext != invalidContext) {
-                            urlDetail.setContexts(detailContext);
-                        }
-                        urlDetail.setUrl(asString(field, 0));
-
-                        if (!storeContactDetail(existing, urlDetail, SRC_LOC)) {
-                            warning() << SRC_LOC << "Unable to save URL to contact";
-                        }
-                    } else if (field.fieldName == QLatin1String("title")) {
-                        organizationDetail.setTitle(asString(field, 0));
-                        if (detailContext != invalidContext) {
-                            organizationDetail.setContexts(detailContext);
-                        }
-                    } else if (field.fieldName == QLatin1String("role")) {
-                        organizationDetail.setRole(asString(field, 0));
-                        if (detailContext != invalidContext) {
-                            organizationDetail.setContexts(detailContext);
-                        }
-                    } else if (field.fieldName == QLatin1String("org")) {
-                        organizationDetail.setName(asString(field, 0));
-                        organizationDetail.setDepartment(asStringList(field, 1));
-                        if (detailContext != invalidContext) {
-                            organizationDetail.setContexts(detailContext);
-                        }
-
-                        if (!storeContactDetail(existing, organizationDetail, SRC_LOC)) {
-                            warning() << SRC_LOC << "Unable to save organization to contact";
-                        }
-
-                        // Clear out the stored details
-                        organizationDetail = QContactOrganization();
-                    } else if (field.fieldName == QLatin1String("n")) {
-                        if (detailContext != invalidContext) {
-                            nameDetail.setContexts(detailContext);
-                        }
-                        nameDetail.setLastName(asString(field, 0));
-                        nameDetail.setFirstName(asString(field, 1));
-                        nameDetail.setMiddleName(asString(field, 2));
-                        nameDetail.setPrefix(asString(field, 3));
-                        nameDetail.setSuffix(asString(field, 4));
-                    } else if (field.fieldName == QLatin1String("fn")) {
-                        const QString fn(asString(field, 0));
-                        if (!fn.isEmpty()) {
-                            if (detailContext != invalidContext) {
-                                nameDetail.setContexts(detailContext);
-                            }
-#ifdef USING_QTPIM
-                            nameDetail.setValue(QContactName__FieldCustomLabel, fn);
-#else
-                            nameDetail.setCustomLabel(fn);
-#endif
-                        }
-                    } else if (field.fieldName == QLatin1String("nickname")) {
-                        const QString nickname(asString(field, 0));
-                        if (!nickname.isEmpty()) {
-                            QContactNickname nicknameDetail;
-                            nicknameDetail.setNickname(nickname);
-                            if (detailContext != invalidContext) {
-                                nicknameDetail.setContexts(detailContext);
-                            }
-
-                            if (!storeContactDetail(existing, nicknameDetail, SRC_LOC)) {
-                                warning() << SRC_LOC << "Unable to save nickname to contact";
-                            }
-
-                            // Use the nickname as the customLabel if we have no 'fn' data
-#ifdef USING_QTPIM
-                            if (stringValue(nameDetail, QContactName__FieldCustomLabel).isEmpty()) {
-                                nameDetail.setValue(QContactName__FieldCustomLabel, nickname);
-                            }
-#else
-                            if (nameDetail.customLabel().isEmpty()) {
-                                nameDetail.setCustomLabel(nickname);
-                            }
-#endif
-                        }
-                    } else if (field.fieldName == QLatin1String("note") ||
-                             field.fieldName == QLatin1String("desc")) {
-                        QContactNote noteDetail;
-                        if (detailContext != invalidContext) {
-                            noteDetail.setContexts(detailContext);
-                        }
-                        noteDetail.setNote(asString(field, 0));
-
-                        if (!storeContactDetail(existing, noteDetail, SRC_LOC)) {
-                            warning() << SRC_LOC << "Unable to save note to contact";
-                        }
-                    } else if (field.fieldName == QLatin1String("bday")) {
-                        /* FIXME: support more date format for compatibility */
-                        const QString dateText(asString(field, 0));
-
-                        QDate date = QDate::fromString(dateText, QLatin1String("yyyy-MM-dd"));
-                        if (!date.isValid()) {
-                            date = QDate::fromString(dateText, QLatin1String("yyyyMMdd"));
-                        }
-                        if (!date.isValid()) {
-                            date = QDate::fromString(dateText, Qt::ISODate);
-                        }
-
-                        if (date.isValid()) {
-                            QContactBirthday birthdayDetail;
-                            birthdayDetail.setDate(date);
-
-                            if (!storeContactDetail(existing, birthdayDetail, SRC_LOC)) {
-                                warning() << SRC_LOC << "Unable to save birthday to contact";
-                            }
-                        } else {
-                            debug() << "Unsupported bday format:" << field.fieldValue[0];
-                        }
-                    } else if (field.fieldName == QLatin1String("x-gender")) {
-                        const QString type(field.fieldValue.at(0));
-
-                        Dictionary::const_iterator it = genderTypes().find(type.toLower());
-                        if (it != addressTypes().constEnd()) {
-                            QContactGender genderDetail;
-#ifdef USING_QTPIM
-                            genderDetail.setGender(static_cast<QContactGender::GenderField>(*it));
-#else
-                            genderDetail.setGender(*it);
-#endif
-
-                            if (!storeContactDetail(existing, genderDetail, SRC_LOC)) {
-                                warning() << SRC_LOC << "Unable to save gender to contact";
-                            }
-                        } else {
-                            debug() << "Unsupported gender type:" << type;
-                        }
-                    } else {
-                        debug() << "Unsupported contact info field" << field.fieldName;
-                    }
-                }
-
-                if (!nameDetail.isEmpty()) {
-                    if (!storeContactDetail(existing, nameDetail, SRC_LOC)) {
-                        warning() << SRC_LOC << "Unable to save name details to contact";
-                    }
-                }
-            }
+    if (changes & CDTpContact::Information) {
+        if (contactWrapper->isInformationKnown()) {
+            // Replace only the details that differ from what telepathy now reports
+            const QList<QContactDetail> details(contactInfoMapper().details(contact->infoFields().allFields()));
+
+            updateInfoDetails<QContactAddress>(existing, details, &updates);
+            updateInfoDetails<QContactBirthday>(existing, details, &updates);
+            updateInfoDetails<QContactEmailAddress>(existing, details, &updates);
+            updateInfoDetails<QContactGender>(existing, details, &updates);
+            updateInfoDetails<QContactName>(existing, details, &updates);
+            updateInfoDetails<QContactNickname>(existing, details, &updates);
+            updateInfoDetails<QContactNote>(existing, details, &updates);
+            updateInfoDetails<QContactOrganization>(existing, details, &updates);
+            updateInfoDetails<QContactPhoneNumber>(existing, details, &updates);
+            updateInfoDetails<QContactUrl>(existing, details, &updates);
         }
     }
     if (changes & CDTpContact::Avatar) {
-        QString defaultAvatarPath = contact->avatarData().fileName;
-        if (defaultAvatarPath.isEmpty()) {
-            defaultAvatarPath = contactWrapper->squareAvatarPath();
-        }
-
         QContactOnlineAccount qcoa = existing.detail<QContactOnlineAccount>();
-        updateContactAvatars(existing, defaultAvatarPath, contactWrapper->largeAvatarPath(), qcoa);
+        updateContactAvatars(existing, contactWrapper, qcoa);
     }
     if (changes & CDTpContact::DefaultAvatar) {
         updateSocialAvatars(network, contactWrapper);
     }
     /* What is this about?
     if (changes & CDTpContact::Authorization) {
-        debug() << "  authorization changed";
+        debug(logCategory) << "  authorization changed";
         g.addPattern(imAddress, nco::imAddressAuthStatusFrom::resource(),
                 presenceState(contact->subscriptionState()));
         g.addPattern(imAddress, nco::imAddressAuthStatusTo::resource(),
                 presenceState(contact->publishState()));
     }
     */
+
+    return updates;
 }
 
 template<typename T, typename R>
@@ -1495,17 +1348,170 @@ void addIconPath(QContactOnlineAccount &qcoa, Tp::AccountPtr account)
 
 
 CDTpStorage::CDTpStorage(QObject *parent) : QObject(parent),
-    mUpdateRunning(false)
+    mUpdateRunning(false),
+    mUpdateThreshold(UPDATE_THRESHOLD),
+    mSelfContactId()
 {
-    mUpdateTimer.setInterval(UPDATE_TIMEOUT);
     mUpdateTimer.setSingleShot(true);
     connect(&mUpdateTimer, SIGNAL(timeout()), SLOT(onUpdateQueueTimeout()));
+
+    mAccountUpdateTimer.setInterval(ACCOUNT_UPDATE_TIMEOUT);
+    mAccountUpdateTimer.setSingleShot(true);
+    connect(&mAccountUpdateTimer, SIGNAL(timeout()), SLOT(onAccountUpdateQueueTimeout()));
+
+    mThumbnailCleanupTimer.setInterval(THUMBNAIL_CLEANUP_TIMEOUT);
+    mThumbnailCleanupTimer.setSingleShot(true);
+    connect(&mThumbnailCleanupTimer, SIGNAL(timeout()), SLOT(onThumbnailCleanupTimeout()));
+
+    // Nobody else writes to our self contact, so the cached copy only goes
+    // stale if it is removed or the whole database changes
+#ifdef USING_QTPIM
+    connect(manager(), SIGNAL(contactsRemoved(QList<QContactId>)), SLOT(onContactsRemoved(QList<QContactId>)));
+#else
+    connect(manager(), SIGNAL(contactsRemoved(QList<QContactLocalId>)), SLOT(onContactsRemoved(QList<QContactLocalId>)));
+#endif
+    connect(manager(), SIGNAL(dataChanged()), SLOT(onDataChanged()));
+
+    onConfigChanged();
+    connect(CDTpPlugin::config(), SIGNAL(changed()), SLOT(onConfigChanged()));
 }
 
 CDTpStorage::~CDTpStorage()
 {
 }
 
+QContact CDTpStorage::selfContact()
+{
+    if (mSelfContact.isEmpty()) {
+        static QContactFetchHint hint(contactFetchHint(true));
+
+        if (mSelfContactId == ContactIdType()) {
+            // After the first start, the stamp saves us the relationship queries
+            mSelfContactId = readSelfContactStamp();
+        }
+        if (mSelfContactId == ContactIdType()) {
+            mSelfContactId = selfContactLocalId();
+            if (mSelfContactId == ContactIdType()) {
+                warning(logCategory) << SRC_LOC << "Unable to find or create self contact";
+                return QContact();
+            }
+            writeSelfContactStamp(mSelfContactId);
+        }
+        mSelfContact = manager()->contact(mSelfContactId, hint);
+        if (mSelfContact.isEmpty()) {
+            // Removed without us being told, look it up again next time
+            mSelfContactId = ContactIdType();
+        }
+    }
+
+    return mSelfContact;
+}
+
+bool CDTpStorage::storeSelfContact(QContact &self, const QString &location, CDTpContact::Changes changes)
+{
+    // Only the details in the self contact fetch hint can be written back
+    const DetailList updates(changes == CDTpContact::All ? selfContactDetailTypes() : contactChangesList(changes));
+    if (updates.isEmpty()) {
+        return true;
+    }
+
+    // Skip the write if the details are still those of the stored copy
+    if (!mSelfContact.isEmpty() && apiId(self) == apiId(mSelfContact)) {
+        bool modified = false;
+        foreach (const DetailList::value_type &type, updates) {
+            if (self.details(type) != mSelfContact.details(type)) {
+                modified = true;
+                break;
+            }
+        }
+        if (!modified) {
+            return true;
+        }
+    }
+
+#ifdef DEBUG_OVERLOAD
+    debug(logCategory) << "Storing self contact" << asString(apiId(self)) << "from:" << location;
+    output(debug(logCategory), self);
+#endif
+
+    QList<QContact> contacts;
+    contacts << self;
+
+    if (!manager()->saveContacts(&contacts, updates)) {
+        warning(logCategory) << "Failed storing self contact" << asString(apiId(self)) << "from:" << location << "error:" << manager()->error();
+
+        // Look the self contact up again the next time it is needed, it
+        // may have been removed
+        mSelfContactId = ContactIdType();
+        mSelfContact = QContact();
+        return false;
+    }
+
+    self = contacts.first();
+    mSelfContact = self;
+    return true;
+}
+
+#ifdef USING_QTPIM
+void CDTpStorage::onContactsRemoved(const QList<QContactId> &contactIds)
+#else
+void CDTpStorage::onContactsRemoved(const QList<QContactLocalId> &contactIds)
+#endif
+{
+    if (contactIds.contains(mSelfContactId)) {
+        debug(logCategory) << "Self contact removed";
+        mSelfContactId = ContactIdType();
+        mSelfContact = QContact();
+    }
+
+    // The removed contacts may have been the last users of some thumbnails
+    scheduleThumbnailCleanup();
+}
+
+void CDTpStorage::scheduleThumbnailCleanup()
+{
+    // Measured from the first change, a stream of changes doesn't postpone it
+    if (!mThumbnailCleanupTimer.isActive()) {
+        mThumbnailCleanupTimer.start();
+    }
+}
+
+void CDTpStorage::onThumbnailCleanupTimeout()
+{
+    QContactFetchHint hint(contactFetchHint());
+#ifdef USING_QTPIM
+    hint.setDetailTypesHint(DetailList() << detailType<QContactAvatar>());
+#else
+    hint.setDetailDefinitionsHint(DetailList() << detailType<QContactAvatar>());
+#endif
+
+    // Thumbnails are still needed while any stored contact refers to them,
+    // including contacts of accounts which are offline now
+    QSet<QString> storedPaths;
+    foreach (const QContact &contact, manager()->contacts(matchTelepathyFilter(), QList<QContactSortOrder>(), hint)) {
+        foreach (const QContactAvatar &avatar, contact.details<QContactAvatar>()) {
+            storedPaths.insert(avatar.imageUrl().toLocalFile());
+        }
+    }
+
+    const int removedCount = CDTpAvatarThumbnailer::removeUnusedThumbnails(storedPaths);
+    debug(logCategory) << "Removed" << removedCount << "unused avatar thumbnails";
+}
+
+void CDTpStorage::onDataChanged()
+{
+    mSelfContactId = ContactIdType();
+    mSelfContact = QContact();
+}
+
+void CDTpStorage::onConfigChanged()
+{
+    Config *config = CDTpPlugin::config();
+
+    mUpdateTimer.setInterval(config->intValue(QLatin1String("telepathy/update-timeout"), UPDATE_TIMEOUT));
+    mUpdateThreshold = config->intValue(QLatin1String("telepathy/update-threshold"), UPDATE_THRESHOLD, 1);
+}
+
 void CDTpStorage::addNewAccount(QContact &self, CDTpAccountPtr accountWrapper)
 {
     Tp::AccountPtr account = accountWrapper->account();
@@ -1514,7 +1520,7 @@ void CDTpStorage::addNewAccount(QContact &self, CDTpAccountPtr accountWrapper)
     const QString accountAddress(imAddress(account));
     const QString accountPresence(imPresence(account));
 
-    debug() << "Creating new self account - account:" << accountPath << "address:" << accountAddress;
+    debug(logCategory) << "Creating new self account - account:" << accountPath << "address:" << accountAddress;
 
     // Create a new QCOA for this account
     QContactOnlineAccount newAccount;
@@ -1532,7 +1538,7 @@ void CDTpStorage::addNewAccount(QContact &self, CDTpAccountPtr accountWrapper)
 
     // Add the new account to the self contact
     if (!storeContactDetail(self, newAccount, SRC_LOC)) {
-        warning() << SRC_LOC << "Unable to add account to self contact for:" << accountPath;
+        warning(logCategory) << SRC_LOC << "Unable to add account to self contact for:" << accountPath;
         return;
     }
 
@@ -1544,14 +1550,14 @@ void CDTpStorage::addNewAccount(QContact &self, CDTpAccountPtr accountWrapper)
     presence.setPresenceState(qContactPresenceState(Tp::ConnectionPresenceTypeUnknown));
 
     if (!storeContactDetail(self, presence, SRC_LOC)) {
-        warning() << SRC_LOC << "Unable to add presence to self contact for:" << accountPath;
+        warning(logCategory) << SRC_LOC << "Unable to add presence to self contact for:" << accountPath;
         return;
     }
 
     // Store any information from the account
     CDTpContact::Changes selfChanges = updateAccountDetails(self, newAccount, presence, accountWrapper, CDTpAccount::All);
 
-    storeContact(self, SRC_LOC, selfChanges);
+    storeSelfContact(self, SRC_LOC, selfChanges | CDTpContact::Capabilities);
 }
 
 void CDTpStorage::removeExistingAccount(QContact &self, QContactOnlineAccount &existing)
@@ -1560,7 +1566,7 @@ void CDTpStorage::removeExistingAccount(QContact &self, QContactOnlineAccount &e
 
     // Remove any contacts derived from this account
     if (!manager()->removeContacts(findContactIdsForAccount(accountPath))) {
-        warning() << SRC_LOC << "Unable to remove linked contacts for account:" << accountPath << "error:" << manager()->error();
+        warning(logCategory) << SRC_LOC << "Unable to remove linked contacts for account:" << accountPath << "error:" << manager()->error();
     }
 
     // Remove any details linked from the account
@@ -1571,14 +1577,14 @@ void CDTpStorage::removeExistingAccount(QContact &self, QContactOnlineAccount &e
         if (!uri.isEmpty()) {
             if (linkedUris.contains(uri)) {
                 if (!self.removeDetail(&detail)) {
-                    warning() << SRC_LOC << "Unable to remove linked detail with URI:" << uri;
+                    warning(logCategory) << SRC_LOC << "Unable to remove linked detail with URI:" << uri;
                 }
             }
         }
     }
 
     if (!self.removeDetail(&existing)) {
-        warning() << SRC_LOC << "Unable to remove obsolete account:" << accountPath;
+        warning(logCategory) << SRC_LOC << "Unable to remove obsolete account:" << accountPath;
     }
 }
 
@@ -1590,13 +1596,13 @@ bool CDTpStorage::initializeNewContact(QContact &newContact, CDTpAccountPtr acco
     const QString contactAddress(imAddress(account, contactId));
     const QString contactPresence(imPresence(account, contactId));
 
-    debug() << "Creating new contact - address:" << contactAddress;
+    debug(logCategory) << "Creating new contact - address:" << contactAddress;
 
     // This contact is synchronized with telepathy
     QContactSyncTarget syncTarget;
     syncTarget.setSyncTarget(QLatin1String("telepathy"));
     if (!storeContactDetail(newContact, syncTarget, SRC_LOC)) {
-        warning() << SRC_LOC << "Unable to add sync target to contact:" << contactAddress;
+        warning(logCategory) << SRC_LOC << "Unable to add sync target to contact:" << contactAddress;
         return false;
     }
 
@@ -1606,7 +1612,7 @@ bool CDTpStorage::initializeNewContact(QContact &newContact, CDTpAccountPtr acco
     metadata.setAccountId(imAccount(account));
     metadata.setAccountEnabled(true);
     if (!storeContactDetail(newContact, metadata, SRC_LOC)) {
-        warning() << SRC_LOC << "Unable to add metadata to contact:" << contactAddress;
+        warning(logCategory) << SRC_LOC << "Unable to add metadata to contact:" << contactAddress;
         return false;
     }
 
@@ -1626,7 +1632,7 @@ bool CDTpStorage::initializeNewContact(QContact &newContact, CDTpAccountPtr acco
 
     // Add the new account to the contact
     if (!storeContactDetail(newContact, newAccount, SRC_LOC)) {
-        warning() << SRC_LOC << "Unable to save account to contact for:" << contactAddress;
+        warning(logCategory) << SRC_LOC << "Unable to save account to contact for:" << contactAddress;
         return false;
     }
 
@@ -1638,7 +1644,7 @@ bool CDTpStorage::initializeNewContact(QContact &newContact, CDTpAccountPtr acco
     presence.setPresenceState(qContactPresenceState(Tp::ConnectionPresenceTypeUnknown));
 
     if (!storeContactDetail(newContact, presence, SRC_LOC)) {
-        warning() << SRC_LOC << "Unable to save presence to contact for:" << contactAddress;
+        warning(logCategory) << SRC_LOC << "Unable to save presence to contact for:" << contactAddress;
         return false;
     }
     return true;
@@ -1646,7 +1652,7 @@ bool CDTpStorage::initializeNewContact(QContact &newContact, CDTpAccountPtr acco
 
 void CDTpStorage::updateContactChanges(CDTpContactPtr contactWrapper, CDTpContact::Changes changes)
 {
-    QList<QContact> saveList;
+    ContactSaveList saveList;
     QList<ContactIdType> removeList;
 
     QContact existing = findExistingContact(imAddress(contactWrapper));
@@ -1655,7 +1661,7 @@ void CDTpStorage::updateContactChanges(CDTpContactPtr contactWrapper, CDTpContac
     updateContacts(SRC_LOC, &saveList, &removeList);
 }
 
-void CDTpStorage::updateContactChanges(CDTpContactPtr contactWrapper, CDTpContact::Changes changes, QContact &existing, QList<QContact> *saveList, QList<ContactIdType> *removeList)
+void CDTpStorage::updateContactChanges(CDTpContactPtr contactWrapper, CDTpContact::Changes changes, QContact &existing, ContactSaveList *saveList, QList<ContactIdType> *removeList)
 {
     const QString accountPath(imAccount(contactWrapper));
     const QString contactAddress(imAddress(contactWrapper));
@@ -1666,16 +1672,22 @@ void CDTpStorage::updateContactChanges(CDTpContactPtr contactWrapper, CDTpContac
             removeList->append(apiId(existing));
         }
     } else {
-        if (existing.isEmpty()) {
+        const bool newContact(existing.isEmpty());
+        if (newContact) {
             if (!initializeNewContact(existing, contactWrapper->accountWrapper(), contactWrapper->contact()->id())) {
-                warning() << SRC_LOC << "Unable to create contact for account:" << accountPath << contactAddress;
+                warning(logCategory) << SRC_LOC << "Unable to create contact for account:" << accountPath << contactAddress;
                 return;
             }
         }
 
-        updateContactDetails(mNetwork, existing, contactWrapper, changes);
+        const DetailList updates(updateContactDetails(mNetwork, existing, contactWrapper, changes));
 
-        saveList->append(existing);
+        if (newContact) {
+            saveList->append(qMakePair(existing, DetailList()));
+        } else if (!updates.isEmpty()) {
+            // Only write the detail types we modified
+            saveList->append(qMakePair(existing, updates));
+        }
     }
 }
 
@@ -1683,7 +1695,7 @@ void CDTpStorage::updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountP
 {
     QContact self(selfContact());
     if (self.isEmpty()) {
-        warning() << SRC_LOC << "Unable to retrieve self contact - error:" << manager()->error();
+        warning(logCategory) << SRC_LOC << "Unable to retrieve self contact - error:" << manager()->error();
         return;
     }
 
@@ -1692,16 +1704,22 @@ void CDTpStorage::updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountP
     const QString accountPath(imAccount(account));
     const QString accountAddress(imAddress(account));
 
-    debug() << "Synchronizing self account - account:" << accountPath << "address:" << accountAddress;
+    debug(logCategory) << "Synchronizing self account - account:" << accountPath << "address:" << accountAddress;
 
     QContactPresence presence(findPresenceForAccount(self, qcoa));
     if (presence.isEmpty()) {
-        warning() << SRC_LOC << "Unable to find presence to match account:" << accountPath;
+        warning(logCategory) << SRC_LOC << "Unable to find presence to match account:" << accountPath;
     }
     CDTpContact::Changes selfChanges = updateAccountDetails(self, qcoa, presence, accountWrapper, changes);
 
-    if (!storeContact(self, SRC_LOC, selfChanges)) {
-        warning() << SRC_LOC << "Unable to save self contact - error:" << manager()->error();
+    if (!storeSelfContact(self, SRC_LOC, selfChanges)) {
+        warning(logCategory) << SRC_LOC << "Unable to save self contact - error:" << manager()->error();
+    }
+
+    // Changes to our own name, presence or avatar don't affect the contacts; only
+    // enabling/disabling the account or (dis)connecting it does
+    if ((changes & CDTpAccount::Enabled) == 0) {
+        return;
     }
 
     if (account->isEnabled() && accountWrapper->hasRoster()) {
@@ -1713,7 +1731,8 @@ void CDTpStorage::updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountP
         for ( ; it != end; ++it) {
             const QString address = imAddress(accountPath, it.key());
 
-            // We always update contact presence since this method is called after a presence change
+            // The stored presence was reset while the account was offline, so it
+            // always needs updating even if the roster cache has the same one
             allChanges.insert(address, it.value() | CDTpContact::Presence);
         }
 
@@ -1726,7 +1745,7 @@ void CDTpStorage::updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountP
         // Retrieve the existing contacts in a single batch
         QHash<QString, QContact> existingContacts = findExistingContacts(contactAddresses);
 
-        QList<QContact> saveList;
+        ContactSaveList saveList;
         QList<ContactIdType> removeList;
 
         foreach (CDTpContactPtr contactWrapper, accountWrapper->contacts()) {
@@ -1734,13 +1753,13 @@ void CDTpStorage::updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountP
 
             QHash<QString, QContact>::Iterator existing = existingContacts.find(address);
             if (existing == existingContacts.end()) {
-                warning() << SRC_LOC << "No contact found for address:" << address;
+                warning(logCategory) << SRC_LOC << "No contact found for address:" << address;
                 existing = existingContacts.insert(address, QContact());
             }
 
             QHash<QString, CDTpContact::Changes>::Iterator changes = allChanges.find(address);
             if (changes == allChanges.end()) {
-                warning() << SRC_LOC << "No changes found for contact:" << address;
+                warning(logCategory) << SRC_LOC << "No changes found for contact:" << address;
                 continue;
             }
 
@@ -1754,30 +1773,49 @@ void CDTpStorage::updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountP
                     *changes ^= CDTpContact::DefaultAvatar;
                 }
             }
+            // Same for the thumbnails, which are not known until the avatar is
+            if (*changes & CDTpContact::ThumbnailAvatar) {
+                if (*changes != CDTpContact::Added
+                  && contactWrapper->listThumbnailPath().isEmpty()) {
+                    *changes ^= CDTpContact::ThumbnailAvatar;
+                }
+            }
 
             updateContactChanges(contactWrapper, *changes, *existing, &saveList, &removeList);
         }
 
         updateContacts(SRC_LOC, &saveList, &removeList);
     } else {
-        // Set presence to unknown for all contacts of this account
-        foreach (const ContactIdType &contactId, findContactIdsForAccount(accountPath)) {
-            QContact existing = manager()->contact(contactId);
+        // Every contact of the account ends up with the same offline capabilities
+        const QStringList offlineCapabilities(currentCapabilites(CDTpContact::Info::makeCapabilities(account->capabilities()),
+                                                                 Tp::ConnectionPresenceTypeUnknown, account));
+        const QDateTime timestamp(QDateTime::currentDateTime());
+
+        DetailList updates;
+        updates << detailType<QContactPresence>() << detailType<QContactOnlineAccount>();
+        if (!account->isEnabled()) {
+            updates << detailType<QContactTpMetadata>();
+        }
 
+        // Fetch only the details we modify, and write them back in batches
+        ContactSaveList saveList;
+
+        foreach (QContact existing, findContactsForAccount(accountPath, updates)) {
+            // Set presence to unknown for all contacts of this account
             QContactPresence presence = existing.detail<QContactPresence>();
             presence.setPresenceState(qContactPresenceState(Tp::ConnectionPresenceTypeUnknown));
-            presence.setTimestamp(QDateTime::currentDateTime());
+            presence.setTimestamp(timestamp);
 
             if (!storeContactDetail(existing, presence, SRC_LOC)) {
-                warning() << SRC_LOC << "Unable to save unknown presence to contact for:" << contactId;
+                warning(logCategory) << SRC_LOC << "Unable to save unknown presence to contact for:" << asString(apiId(existing));
             }
 
             // Also reset the capabilities
             QContactOnlineAccount qcoa = existing.detail<QContactOnlineAccount>();
-            qcoa.setCapabilities(currentCapabilites(account->capabilities(), Tp::ConnectionPresenceTypeUnknown, account));
+            qcoa.setCapabilities(offlineCapabilities);
 
             if (!storeContactDetail(existing, qcoa, SRC_LOC)) {
-                warning() << SRC_LOC << "Unable to save capabilities to contact for:" << contactId;
+                warning(logCategory) << SRC_LOC << "Unable to save capabilities to contact for:" << asString(apiId(existing));
             }
 
             if (!account->isEnabled()) {
@@ -1786,12 +1824,14 @@ void CDTpStorage::updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountP
                 metadata.setAccountEnabled(false);
 
                 if (!storeContactDetail(existing, metadata, SRC_LOC)) {
-                    warning() << SRC_LOC << "Unable to un-enable contact for:" << contactId;
+                    warning(logCategory) << SRC_LOC << "Unable to un-enable contact for:" << asString(apiId(existing));
                 }
             }
 
-            storeContact(existing, SRC_LOC, CDTpContact::Presence | CDTpContact::Capabilities);
+            saveList.append(qMakePair(existing, updates));
         }
+
+        updateContacts(SRC_LOC, &saveList, 0);
     }
 }
 
@@ -1799,7 +1839,7 @@ void CDTpStorage::syncAccounts(const QList<CDTpAccountPtr> &accounts)
 {
     QContact self(selfContact());
     if (self.isEmpty()) {
-        warning() << SRC_LOC << "Unable to retrieve self contact - error:" << manager()->error();
+        warning(logCategory) << SRC_LOC << "Unable to retrieve self contact - error:" << manager()->error();
         return;
     }
 
@@ -1812,7 +1852,7 @@ void CDTpStorage::syncAccounts(const QList<CDTpAccountPtr> &accounts)
     foreach (QContactOnlineAccount existingAccount, self.details<QContactOnlineAccount>()) {
         const QString existingPath(stringValue(existingAccount, QContactOnlineAccount__FieldAccountPath));
         if (existingPath.isEmpty()) {
-            warning() << SRC_LOC << "No path for existing account:" << existingPath;
+            warning(logCategory) << SRC_LOC << "No path for existing account:" << existingPath;
             continue;
         }
 
@@ -1821,7 +1861,7 @@ void CDTpStorage::syncAccounts(const QList<CDTpAccountPtr> &accounts)
             existingIndices.insert(index);
             updateAccountChanges(existingAccount, accounts.at(index), CDTpAccount::All);
         } else {
-            debug() << SRC_LOC << "Remove obsolete account:" << existingPath;
+            debug(logCategory) << SRC_LOC << "Remove obsolete account:" << existingPath;
 
             // This account is no longer valid
             removalPaths.insert(existingPath);
@@ -1846,26 +1886,26 @@ void CDTpStorage::syncAccounts(const QList<CDTpAccountPtr> &accounts)
         }
     }
 
-    storeContact(self, SRC_LOC);
+    storeSelfContact(self, SRC_LOC);
 }
 
 void CDTpStorage::createAccount(CDTpAccountPtr accountWrapper)
 {
     QContact self(selfContact());
     if (self.isEmpty()) {
-        warning() << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
+        warning(logCategory) << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
         return;
     }
 
     const QString accountPath(imAccount(accountWrapper));
 
-    debug() << SRC_LOC << "Create account:" << accountPath;
+    debug(logCategory) << SRC_LOC << "Create account:" << accountPath;
 
     // Ensure this account does not already exist
     foreach (const QContactOnlineAccount &existingAccount, self.details<QContactOnlineAccount>()) {
         const QString existingPath(stringValue(existingAccount, QContactOnlineAccount__FieldAccountPath));
         if (existingPath == accountPath) {
-            warning() << SRC_LOC << "Path already exists for create account:" << existingPath;
+            warning(logCategory) << SRC_LOC << "Path already exists for create account:" << existingPath;
             return;
         }
     }
@@ -1882,7 +1922,7 @@ void CDTpStorage::createAccount(CDTpAccountPtr accountWrapper)
     // Retrieve the existing contacts in a single batch
     QHash<QString, QContact> existingContacts = findExistingContacts(contactAddresses);
 
-    QList<QContact> saveList;
+    ContactSaveList saveList;
     QList<ContactIdType> removeList;
 
     // Add any contacts already present for this account
@@ -1891,7 +1931,7 @@ void CDTpStorage::createAccount(CDTpAccountPtr accountWrapper)
 
         QHash<QString, QContact>::Iterator existing = existingContacts.find(address);
         if (existing == existingContacts.end()) {
-            warning() << SRC_LOC << "No contact found for address:" << address;
+            warning(logCategory) << SRC_LOC << "No contact found for address:" << address;
             continue;
         }
 
@@ -1903,15 +1943,43 @@ void CDTpStorage::createAccount(CDTpAccountPtr accountWrapper)
 
 void CDTpStorage::updateAccount(CDTpAccountPtr accountWrapper, CDTpAccount::Changes changes)
 {
+    // Account changes tend to come in bursts (e.g. presence and status
+    // message), merge them so that each account is only updated once. The
+    // delay counts from the first change, so a steady stream of changes
+    // can't postpone the update indefinitely.
+    mAccountUpdateQueue[accountWrapper] |= changes;
+    if (!mAccountUpdateTimer.isActive()) {
+        mAccountUpdateTimer.start();
+    }
+}
+
+void CDTpStorage::onAccountUpdateQueueTimeout()
+{
+    debug(logCategory) << "Update" << mAccountUpdateQueue.count() << "accounts";
+
+    const QHash<CDTpAccountPtr, CDTpAccount::Changes> queue(mAccountUpdateQueue);
+    mAccountUpdateQueue.clear();
+
+    QHash<CDTpAccountPtr, CDTpAccount::Changes>::const_iterator it = queue.constBegin(), end = queue.constEnd();
+    for ( ; it != end; ++it) {
+        updateAccountNow(it.key(), it.value());
+    }
+}
+
+void CDTpStorage::updateAccountNow(CDTpAccountPtr accountWrapper, CDTpAccount::Changes changes)
+{
+    static Counter *accountUpdates = CDTpPlugin::counter(QLatin1String("telepathy.account-updates"));
+    accountUpdates->add();
+
     QContact self(selfContact());
     if (self.isEmpty()) {
-        warning() << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
+        warning(logCategory) << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
         return;
     }
 
     const QString accountPath(imAccount(accountWrapper));
 
-    debug() << SRC_LOC << "Update account:" << accountPath;
+    debug(logCategory) << SRC_LOC << "Update account:" << accountPath;
 
     foreach (QContactOnlineAccount existingAccount, self.details<QContactOnlineAccount>()) {
         const QString existingPath(stringValue(existingAccount, QContactOnlineAccount__FieldAccountPath));
@@ -1921,34 +1989,35 @@ void CDTpStorage::updateAccount(CDTpAccountPtr accountWrapper, CDTpAccount::Chan
         }
     }
 
-    warning() << SRC_LOC << "Account not found for update account:" << accountPath;
+    warning(logCategory) << SRC_LOC << "Account not found for update account:" << accountPath;
 }
 
 void CDTpStorage::removeAccount(CDTpAccountPtr accountWrapper)
 {
+    mAccountUpdateQueue.remove(accountWrapper);
     cancelQueuedUpdates(accountWrapper->contacts());
 
     QContact self(selfContact());
     if (self.isEmpty()) {
-        warning() << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
+        warning(logCategory) << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
         return;
     }
 
     const QString accountPath(imAccount(accountWrapper));
 
-    debug() << SRC_LOC << "Remove account:" << accountPath;
+    debug(logCategory) << SRC_LOC << "Remove account:" << accountPath;
 
     foreach (QContactOnlineAccount existingAccount, self.details<QContactOnlineAccount>()) {
         const QString existingPath(stringValue(existingAccount, QContactOnlineAccount__FieldAccountPath));
         if (existingPath == accountPath) {
             removeExistingAccount(self, existingAccount);
 
-            storeContact(self, SRC_LOC);
+            storeSelfContact(self, SRC_LOC);
             return;
         }
     }
 
-    warning() << SRC_LOC << "Account not found for remove account:" << accountPath;
+    warning(logCategory) << SRC_LOC << "Account not found for remove account:" << accountPath;
 }
 
 // This is called when account goes online/offline
@@ -1956,13 +2025,13 @@ void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper)
 {
     QContact self(selfContact());
     if (self.isEmpty()) {
-        warning() << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
+        warning(logCategory) << SRC_LOC << "Unable to retrieve self contact:" << manager()->error();
         return;
     }
 
     const QString accountPath(imAccount(accountWrapper));
 
-    debug() << SRC_LOC << "Sync contacts account:" << accountPath;
+    debug(logCategory) << SRC_LOC << "Sync contacts account:" << accountPath;
 
     foreach (QContactOnlineAccount existingAccount, self.details<QContactOnlineAccount>()) {
         const QString existingPath(stringValue(existingAccount, QContactOnlineAccount__FieldAccountPath));
@@ -1972,7 +2041,7 @@ void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper)
         }
     }
 
-    warning() << SRC_LOC << "Account not found for sync account:" << accountPath;
+    warning(logCategory) << SRC_LOC << "Account not found for sync account:" << accountPath;
 }
 
 void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper, const QList<CDTpContactPtr> &contactsAdded, const QList<CDTpContactPtr> &contactsRemoved)
@@ -1983,7 +2052,7 @@ void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper, const QList
     foreach (const CDTpContactPtr &contactWrapper, contactsAdded) {
         // This contact must be for the specified account
         if (imAccount(contactWrapper) != accountPath) {
-            warning() << SRC_LOC << "Unable to add contact from wrong account:" << imAccount(contactWrapper) << accountPath;
+            warning(logCategory) << SRC_LOC << "Unable to add contact from wrong account:" << imAccount(contactWrapper) << accountPath;
             continue;
         }
 
@@ -1992,7 +2061,7 @@ void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper, const QList
     }
     foreach (const CDTpContactPtr &contactWrapper, contactsRemoved) {
         if (imAccount(contactWrapper) != accountPath) {
-            warning() << SRC_LOC << "Unable to remove contact from wrong account:" << imAccount(contactWrapper) << accountPath;
+            warning(logCategory) << SRC_LOC << "Unable to remove contact from wrong account:" << imAccount(contactWrapper) << accountPath;
             continue;
         }
 
@@ -2003,7 +2072,7 @@ void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper, const QList
     // Retrieve the existing contacts in a single batch
     QHash<QString, QContact> existingContacts = findExistingContacts(contactAddresses);
 
-    QList<QContact> saveList;
+    ContactSaveList saveList;
     QList<ContactIdType> removeList;
 
     foreach (const CDTpContactPtr &contactWrapper, contactsAdded) {
@@ -2011,7 +2080,7 @@ void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper, const QList
 
         QHash<QString, QContact>::Iterator existing = existingContacts.find(address);
         if (existing == existingContacts.end()) {
-            warning() << SRC_LOC << "No contact found for address:" << address;
+            warning(logCategory) << SRC_LOC << "No contact found for address:" << address;
             continue;
         }
 
@@ -2022,7 +2091,7 @@ void CDTpStorage::syncAccountContacts(CDTpAccountPtr accountWrapper, const QList
 
         QHash<QString, QContact>::Iterator existing = existingContacts.find(address);
         if (existing == existingContacts.end()) {
-            warning() << SRC_LOC << "No contact found for address:" << address;
+            warning(logCategory) << SRC_LOC << "No contact found for address:" << address;
             continue;
         }
 
@@ -2036,60 +2105,88 @@ void CDTpStorage::createAccountContacts(CDTpAccountPtr accountWrapper, const QSt
 {
     Q_UNUSED(localId) // ???
 
-    const QString accountPath(imAccount(accountWrapper));
+    QHash<CDTpAccountPtr, QStringList> accountContactIds;
+    accountContactIds.insert(accountWrapper, imIds);
+    createAccountContacts(accountContactIds);
+}
+
+void CDTpStorage::createAccountContacts(const QHash<CDTpAccountPtr, QStringList> &accountContactIds)
+{
+    ContactSaveList saveList;
 
-    debug() << SRC_LOC << "Create contacts account:" << accountPath;
+    QHash<CDTpAccountPtr, QStringList>::const_iterator it = accountContactIds.constBegin(), end = accountContactIds.constEnd();
+    for ( ; it != end; ++it) {
+        CDTpAccountPtr accountWrapper = it.key();
+        const QString accountPath(imAccount(accountWrapper));
 
-    QList<QContact> saveList;
+        debug(logCategory) << SRC_LOC << "Create contacts account:" << accountPath;
 
-    foreach (const QString &id, imIds) {
-        QContact newContact;
-        if (!initializeNewContact(newContact, accountWrapper, id)) {
-            warning() << SRC_LOC << "Unable to create contact for account:" << accountPath << id;
-        } else {
-            saveList.append(newContact);
+        foreach (const QString &id, it.value()) {
+            QContact newContact;
+            if (!initializeNewContact(newContact, accountWrapper, id)) {
+                warning(logCategory) << SRC_LOC << "Unable to create contact for account:" << accountPath << id;
+            } else {
+                saveList.append(qMakePair(newContact, DetailList()));
+            }
         }
     }
 
+    // Save the contacts of all accounts at once
     updateContacts(SRC_LOC, &saveList, 0);
 }
 
 /* Use this only in offline mode - use syncAccountContacts in online mode */
 void CDTpStorage::removeAccountContacts(CDTpAccountPtr accountWrapper, const QStringList &contactIds)
 {
-    const QString accountPath(imAccount(accountWrapper));
-
-    debug() << SRC_LOC << "Remove contacts account:" << accountPath;
+    QHash<QString, QStringList> accountContactIds;
+    accountContactIds.insert(imAccount(accountWrapper), contactIds);
+    removeAccountContacts(accountContactIds);
+}
 
+void CDTpStorage::removeAccountContacts(const QHash<QString, QStringList> &accountContactIds)
+{
     QStringList imAddressList;
-    foreach (const QString &id, contactIds) {
-        imAddressList.append(imAddress(accountPath, id));
-    }
 
-    QList<ContactIdType> removeIds;
+    QHash<QString, QStringList>::const_iterator it = accountContactIds.constBegin(), end = accountContactIds.constEnd();
+    for ( ; it != end; ++it) {
+        debug(logCategory) << SRC_LOC << "Remove contacts account:" << it.key();
 
-    // Find any contacts matching the supplied ID list
-    foreach (const QContact &existing, manager()->contacts(findContactIdsForAccount(accountPath))) {
-        QContactTpMetadata metadata = existing.detail<QContactTpMetadata>();
-        if (imAddressList.contains(metadata.contactId())) {
-            removeIds.append(apiId(existing));
+        foreach (const QString &id, it.value()) {
+            imAddressList.append(imAddress(it.key(), id));
         }
     }
 
-    if (!manager()->removeContacts(removeIds)) {
-        warning() << SRC_LOC << "Unable to remove contacts for account:" << accountPath << "error:" << manager()->error();
+    if (imAddressList.isEmpty()) {
+        return;
+    }
+
+    // Find any contacts matching the supplied ID lists, and remove them together
+    const QList<ContactIdType> removeIds = findContactIdsForAddresses(imAddressList);
+    if (!removeIds.isEmpty() && !manager()->removeContacts(removeIds)) {
+        warning(logCategory) << SRC_LOC << "Unable to remove contacts for accounts:" << accountContactIds.keys() << "error:" << manager()->error();
     }
 }
 
+static Gauge *updateQueueDepth()
+{
+    static Gauge *gauge = CDTpPlugin::gauge(QLatin1String("telepathy.update-queue-depth"));
+    return gauge;
+}
+
 void CDTpStorage::updateContact(CDTpContactPtr contactWrapper, CDTpContact::Changes changes)
 {
     mUpdateQueue[contactWrapper] |= changes;
+    updateQueueDepth()->set(mUpdateQueue.count());
+
+    if (changes & CDTpContact::ThumbnailAvatar) {
+        scheduleThumbnailCleanup();
+    }
 
     if (!mUpdateRunning) {
         // Only update IM contacts in tracker after queuing 50 contacts or after
         // not receiving an update notifiction for 150 ms. This dramatically reduces
         // system but also keeps update latency within acceptable bounds.
-        if (!mUpdateTimer.isActive() || mUpdateQueue.count() < UPDATE_THRESHOLD) {
+        if (!mUpdateTimer.isActive() || mUpdateQueue.count() < mUpdateThreshold) {
             mUpdateTimer.start();
         }
     }
@@ -2097,7 +2194,11 @@ void CDTpStorage::updateContact(CDTpContactPtr contactWrapper, CDTpContact::Chan
 
 void CDTpStorage::onUpdateQueueTimeout()
 {
-    debug() << "Update" << mUpdateQueue.count() << "contacts";
+    static Histogram *flushLatency = CDTpPlugin::histogram(QLatin1String("telepathy.update-flush-ms"));
+    HistogramTimer timer(flushLatency);
+    TraceSpan span("tp.update-flush", mUpdateQueue.count());
+
+    debug(logCategory) << "Update" << mUpdateQueue.count() << "contacts";
 
     QStringList contactAddresses;
 
@@ -2110,7 +2211,7 @@ void CDTpStorage::onUpdateQueueTimeout()
     // Retrieve the existing contacts in a single batch
     QHash<QString, QContact> existingContacts = findExistingContacts(contactAddresses);
 
-    QList<QContact> saveList;
+    ContactSaveList saveList;
     QList<ContactIdType> removeList;
 
     for (it = mUpdateQueue.constBegin(); it != end; ++it) {
@@ -2128,7 +2229,7 @@ void CDTpStorage::onUpdateQueueTimeout()
         const QString address(imAddress(contactWrapper));
         QHash<QString, QContact>::Iterator existing = existingContacts.find(address);
         if (existing == existingContacts.end()) {
-            warning() << SRC_LOC << "No contact found for address:" << address;
+            warning(logCategory) << SRC_LOC << "No contact found for address:" << address;
             continue;
         }
 
@@ -2136,6 +2237,7 @@ void CDTpStorage::onUpdateQueueTimeout()
     }
 
     mUpdateQueue.clear();
+    updateQueueDepth()->set(0);
 
     updateContacts(SRC_LOC, &saveList, &removeList);
 }
@@ -2145,5 +2247,6 @@ void CDTpStorage::cancelQueuedUpdates(const QList<CDTpContactPtr> &contacts)
     foreach (const CDTpContactPtr &contactWrapper, contacts) {
         mUpdateQueue.remove(contactWrapper);
     }
+    updateQueueDepth()->set(mUpdateQueue.count());
 }
 
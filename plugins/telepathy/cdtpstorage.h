@@ -29,6 +29,7 @@
 
 #include <QByteArray>
 #include <QObject>
+#include <QPair>
 #include <QString>
 #include <QUrl>
 #include <QNetworkAccessManager>
@@ -42,6 +43,18 @@ QTCONTACTS_USE_NAMESPACE
 QTM_USE_NAMESPACE
 #endif
 
+#ifdef USING_QTPIM
+typedef QContactId ContactIdType;
+typedef QList<QContactDetail::DetailType> DetailList;
+#else
+typedef QContactLocalId ContactIdType;
+typedef QStringList DetailList;
+#endif
+
+// Contacts to be saved, each with the detail types that need writing;
+// an empty type list means the whole contact is written
+typedef QList<QPair<QContact, DetailList> > ContactSaveList;
+
 class CDTpStorage : public QObject
 {
     Q_OBJECT
@@ -66,25 +79,37 @@ public Q_SLOTS:
 
 public:
     void createAccountContacts(CDTpAccountPtr accountWrapper, const QStringList &imIds, uint localId);
+    void createAccountContacts(const QHash<CDTpAccountPtr, QStringList> &accountContactIds);
     void removeAccountContacts(CDTpAccountPtr accountWrapper, const QStringList &contactIds);
+    void removeAccountContacts(const QHash<QString, QStringList> &accountContactIds);
 
 private Q_SLOTS:
     void onUpdateQueueTimeout();
+    void onAccountUpdateQueueTimeout();
+    void onThumbnailCleanupTimeout();
+#ifdef USING_QTPIM
+    void onContactsRemoved(const QList<QContactId> &contactIds);
+#else
+    void onContactsRemoved(const QList<QContactLocalId> &contactIds);
+#endif
+    void onDataChanged();
+    void onConfigChanged();
 
 private:
     void cancelQueuedUpdates(const QList<CDTpContactPtr> &contacts);
+    void scheduleThumbnailCleanup();
+
+    QContact selfContact();
+    bool storeSelfContact(QContact &self, const QString &location, CDTpContact::Changes changes = CDTpContact::All);
 
     void addNewAccount(QContact &self, CDTpAccountPtr accountWrapper);
     void removeExistingAccount(QContact &self, QContactOnlineAccount &existing);
 
+    void updateAccountNow(CDTpAccountPtr accountWrapper, CDTpAccount::Changes changes);
     void updateAccountChanges(QContactOnlineAccount &qcoa, CDTpAccountPtr accountWrapper, CDTpAccount::Changes changes);
 
     bool initializeNewContact(QContact &newContact, CDTpAccountPtr accountWrapper, const QString &contactId);
-#ifdef USING_QTPIM
-    void updateContactChanges(CDTpContactPtr contactWrapper, CDTpContact::Changes changes, QContact &existing, QList<QContact> *saveList, QList<QContactId> *removeList);
-#else
-    void updateContactChanges(CDTpContactPtr contactWrapper, CDTpContact::Changes changes, QContact &existing, QList<QContact> *saveList, QList<QContactLocalId> *removeList);
-#endif
+    void updateContactChanges(CDTpContactPtr contactWrapper, CDTpContact::Changes changes, QContact &existing, ContactSaveList *saveList, QList<ContactIdType> *removeList);
     void updateContactChanges(CDTpContactPtr contactWrapper, CDTpContact::Changes changes);
 
 private:
@@ -92,6 +117,12 @@ private:
     QNetworkAccessManager mNetwork;
     QTimer mUpdateTimer;
     bool mUpdateRunning;
+    int mUpdateThreshold;
+    QHash<CDTpAccountPtr, CDTpAccount::Changes> mAccountUpdateQueue;
+    QTimer mAccountUpdateTimer;
+    QTimer mThumbnailCleanupTimer;
+    ContactIdType mSelfContactId;
+    QContact mSelfContact;
 };
 
 #endif // CDTPSTORAGE_H
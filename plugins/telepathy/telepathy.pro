@@ -21,8 +21,9 @@
 # conditions contained in a signed written agreement between you and Nokia.
 
 TEMPLATE = lib
-QT -= gui
-QT += dbus network
+# QImage is needed for the avatar thumbnails
+QT += gui
+QT += dbus network concurrent
 
 CONFIG += plugin link_pkgconfig
 
@@ -30,7 +31,7 @@ PKGCONFIG += Qt5Contacts
 PKGCONFIG += TelepathyQt5
 DEFINES *= USING_QTPIM
 
-system(qdbusxml2cpp -c BuddyManagementAdaptor -a buddymanagementadaptor.h:buddymanagementadaptor.cpp com.nokia.contacts.buddymanagement.xml)
+system(qdbusxml2cpp -c BuddyManagementAdaptor -i cdtpbuddyoperation.h -a buddymanagementadaptor.h:buddymanagementadaptor.cpp com.nokia.contacts.buddymanagement.xml)
 
 CONFIG(coverage):{
 QMAKE_CXXFLAGS += -c -g  --coverage -ftest-coverage -fprofile-arcs
@@ -48,21 +49,30 @@ HEADERS  = cdtpaccount.h \
     cdtpaccountcachewriter.h \
     types.h \
     cdtpcontact.h \
+    cdtpcontactinfo.h \
     cdtpcontroller.h \
+    cdtpofflinerosterbuffer.h \
     cdtpplugin.h \
     cdtpstorage.h \
     buddymanagementadaptor.h \
-    cdtpavatarupdate.h
+    cdtpavatarupdate.h \
+    cdtpbuddyoperation.h \
+    cdtpavatarprovider.h \
+    cdtpavatarthumbnailer.h
 
 SOURCES  = cdtpaccount.cpp \
     cdtpaccountcacheloader.cpp \
     cdtpaccountcachewriter.cpp \
     cdtpcontact.cpp \
+    cdtpcontactinfo.cpp \
     cdtpcontroller.cpp \
+    cdtpofflinerosterbuffer.cpp \
     cdtpplugin.cpp \
     cdtpstorage.cpp \
     buddymanagementadaptor.cpp \
-    cdtpavatarupdate.cpp
+    cdtpavatarupdate.cpp \
+    cdtpavatarprovider.cpp \
+    cdtpavatarthumbnailer.cpp
 
 VERSIONED_PACKAGENAME=contactsd-1.0
 
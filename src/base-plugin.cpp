@@ -32,6 +32,10 @@ namespace Contactsd
 const QString BasePlugin::metaDataKeyVersion = QString::fromLatin1("version");
 const QString BasePlugin::metaDataKeyName    = QString::fromLatin1("name");
 const QString BasePlugin::metaDataKeyComment = QString::fromLatin1("comment");
+const QString BasePlugin::metaDataKeyDependencies = QString::fromLatin1("dependencies");
+const QString BasePlugin::metaDataKeyActivationServices = QString::fromLatin1("activation-services");
+const QString BasePlugin::metaDataKeyActivationSettings = QString::fromLatin1("activation-settings");
+const QString BasePlugin::metaDataKeyActivationObjectPaths = QString::fromLatin1("activation-object-paths");
 
 
 QDir
@@ -61,4 +65,28 @@ BasePlugin::cacheFileName(const QString &fileName)
     return cacheDir().filePath(fileName);
 }
 
+Counter *
+BasePlugin::counter(const QString &name)
+{
+    return Metrics::instance()->counter(name);
+}
+
+Gauge *
+BasePlugin::gauge(const QString &name)
+{
+    return Metrics::instance()->gauge(name);
+}
+
+Histogram *
+BasePlugin::histogram(const QString &name)
+{
+    return Metrics::instance()->histogram(name);
+}
+
+Config *
+BasePlugin::config()
+{
+    return Config::instance();
+}
+
 } // Contactsd
@@ -32,6 +32,9 @@
 #include <QThreadStorage>
 #include <QDir>
 
+#include "config.h"
+#include "metrics.h"
+
 namespace Contactsd
 {
 
@@ -43,6 +46,16 @@ public:
     static const QString metaDataKeyVersion;
     static const QString metaDataKeyName;
     static const QString metaDataKeyComment;
+    // Names of the plugins whose init() must run before this plugin's
+    static const QString metaDataKeyDependencies;
+    // Activation triggers: with lazy activation, a plugin declaring any of
+    // them only gets its init() called once the first one fires
+    // - names of D-Bus services appearing on the session bus
+    static const QString metaDataKeyActivationServices;
+    // - keys being set in the contactsd settings
+    static const QString metaDataKeyActivationSettings;
+    // - a first call to one of these object paths on the contactsd service
+    static const QString metaDataKeyActivationObjectPaths;
     typedef QMap<QString, QVariant> MetaData;
 
     virtual ~BasePlugin () {}
@@ -52,6 +65,14 @@ public:
     static QDir cacheDir();
     static QString cacheFileName(const QString &fileName);
 
+    // Metrics exported by the daemon, named "<plugin>.<metric>"
+    static Counter *counter(const QString &name);
+    static Gauge *gauge(const QString &name);
+    static Histogram *histogram(const QString &name);
+
+    // Daemon configuration, keys are named "<plugin>/<key>"
+    static Config *config();
+
 Q_SIGNALS:
     // \param service - display name of a service (e.g. Gtalk, MSN)
     // \param account - account id or account path that can uniquely identify an account
@@ -0,0 +1,234 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QAtomicPointer>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+
+#include "config.h"
+#include "debug.h"
+#include "metrics.h"
+
+namespace Contactsd
+{
+
+Config::Config()
+    : mFileName(defaultFileName())
+    , mWatcher(new QFileSystemWatcher(this))
+{
+    connect(mWatcher, SIGNAL(fileChanged(QString)), SLOT(onFileChanged()));
+    connect(mWatcher, SIGNAL(directoryChanged(QString)), SLOT(onFileChanged()));
+
+    reload();
+}
+
+Config::~Config()
+{
+}
+
+Config *Config::instance()
+{
+    static QAtomicPointer<Config> config;
+    static QMutex mutex;
+
+    if (Config *c = config.loadAcquire()) {
+        return c;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    if (!config.load()) {
+        Config *c = new Config;
+
+        // reloads are triggered from the main thread's event loop
+        if (QCoreApplication::instance()) {
+            c->moveToThread(QCoreApplication::instance()->thread());
+        }
+
+        config.storeRelease(c);
+    }
+
+    return config.load();
+}
+
+QString Config::defaultFileName()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+            + QLatin1String("/contactsd/contactsd.conf");
+}
+
+QString Config::fileName() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFileName;
+}
+
+void Config::setFileName(const QString &fileName)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mFileName = fileName;
+    }
+
+    if (!mWatcher->files().isEmpty()) {
+        mWatcher->removePaths(mWatcher->files());
+    }
+    if (!mWatcher->directories().isEmpty()) {
+        mWatcher->removePaths(mWatcher->directories());
+    }
+
+    reload();
+}
+
+void Config::reload()
+{
+    const QString fileName = this->fileName();
+    QHash<QString, QString> values;
+
+    if (QFile::exists(fileName)) {
+        QSettings settings(fileName, QSettings::IniFormat);
+
+        if (settings.status() != QSettings::NoError) {
+            warning() << "Could not read configuration file" << fileName;
+            return; // keep the values we have
+        }
+
+        foreach (const QString &key, settings.allKeys()) {
+            values.insert(key, settings.value(key).toString());
+        }
+    }
+
+    watchFile();
+
+    bool modified;
+    {
+        QMutexLocker locker(&mMutex);
+        modified = (values != mValues);
+        mValues = values;
+        mInvalidKeys.clear();
+    }
+
+    if (modified) {
+        debug() << "Loaded" << values.count() << "configuration values from" << fileName;
+        Q_EMIT changed();
+    }
+}
+
+void Config::onFileChanged()
+{
+    reload();
+}
+
+void Config::watchFile()
+{
+    // Editors save by replacing the file, and the file may not exist yet, so
+    // watch its directory too and pick the file up again each time
+    const QString fileName = this->fileName();
+    const QString dirName = QFileInfo(fileName).absolutePath();
+
+    if (!mWatcher->directories().contains(dirName) && QDir(dirName).exists()) {
+        mWatcher->addPath(dirName);
+    }
+    if (!mWatcher->files().contains(fileName) && QFile::exists(fileName)) {
+        mWatcher->addPath(fileName);
+    }
+}
+
+bool Config::lookup(const QString &key, QString *value) const
+{
+    QMutexLocker locker(&mMutex);
+
+    QHash<QString, QString>::const_iterator it = mValues.constFind(key);
+    if (it == mValues.constEnd()) {
+        return false;
+    }
+
+    *value = it.value();
+    return true;
+}
+
+void Config::invalidValue(const QString &key, const QString &value) const
+{
+    QMutexLocker locker(&mMutex);
+
+    if (!mInvalidKeys.contains(key)) {
+        mInvalidKeys.insert(key);
+        warning() << "Ignoring invalid value" << value << "for" << key << "in" << mFileName;
+    }
+}
+
+void Config::exportValue(const QString &key, int value)
+{
+    QString name = QLatin1String("config.") + key;
+    name.replace(QLatin1Char('/'), QLatin1Char('.'));
+    Metrics::instance()->gauge(name)->set(value);
+}
+
+int Config::intValue(const QString &key, int defaultValue, int minimum) const
+{
+    int value = defaultValue;
+
+    QString configured;
+    if (lookup(key, &configured)) {
+        bool ok = false;
+        const int number = configured.toInt(&ok);
+
+        if (ok && number >= minimum) {
+            value = number;
+        } else {
+            invalidValue(key, configured);
+        }
+    }
+
+    exportValue(key, value);
+    return value;
+}
+
+bool Config::boolValue(const QString &key, bool defaultValue) const
+{
+    bool value = defaultValue;
+
+    QString configured;
+    if (lookup(key, &configured)) {
+        configured = configured.toLower();
+
+        if (configured == QLatin1String("true") || configured == QLatin1String("1")) {
+            value = true;
+        } else if (configured == QLatin1String("false") || configured == QLatin1String("0")) {
+            value = false;
+        } else {
+            invalidValue(key, configured);
+        }
+    }
+
+    exportValue(key, value ? 1 : 0);
+    return value;
+}
+
+} // Contactsd
@@ -0,0 +1,89 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CONTACTSD_CONFIG_H
+#define CONTACTSD_CONFIG_H
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+namespace Contactsd
+{
+
+// Tuning values read from an INI file, "<plugin>/<key>=<value>", so they
+// can be adjusted per device without a rebuild. The file is read again when
+// it changes on disk or the daemon gets SIGHUP; users connect to changed()
+// to apply the new values. Every value handed out is exported as the gauge
+// "config.<plugin>.<key>", so the applied configuration can be checked on
+// the metrics interface. The getters can be called from any thread.
+class Config : public QObject
+{
+    Q_OBJECT
+
+public:
+    static Config *instance();
+
+    // ~/.config/contactsd/contactsd.conf
+    static QString defaultFileName();
+
+    QString fileName() const;
+    void setFileName(const QString &fileName);
+
+    // \param minimum - values below it are ignored, as are non-numbers
+    int intValue(const QString &key, int defaultValue, int minimum = 0) const;
+    bool boolValue(const QString &key, bool defaultValue) const;
+
+public Q_SLOTS:
+    void reload();
+
+Q_SIGNALS:
+    // emitted when a reload changed any value
+    void changed();
+
+private Q_SLOTS:
+    void onFileChanged();
+
+private:
+    Config();
+    ~Config();
+
+    bool lookup(const QString &key, QString *value) const;
+    void invalidValue(const QString &key, const QString &value) const;
+    static void exportValue(const QString &key, int value);
+    void watchFile();
+
+    mutable QMutex mMutex;
+    QString mFileName;
+    QHash<QString, QString> mValues;
+    // reported once per reload, the getters may be called on hot paths
+    mutable QSet<QString> mInvalidKeys;
+    QFileSystemWatcher *mWatcher;
+};
+
+} // Contactsd
+
+#endif // CONTACTSD_CONFIG_H
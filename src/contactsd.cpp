@@ -28,11 +28,19 @@
 #include <QDir>
 
 #include "contactsd.h"
+#include "config.h"
 #include "contactsdpluginloader.h"
 #include "debug.h"
+#include "logcontrol.h"
+#include "loggingadaptor.h"
+#include "metrics.h"
+#include "metricsadaptor.h"
+#include "trace.h"
+#include "traceadaptor.h"
 
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
 #include <sys/socket.h>
 
 using namespace Contactsd;
@@ -60,6 +68,13 @@ using namespace Contactsd;
   \param loadPlugins The names of the plugins to load.
 */
 
+/*!
+  \fn void ContactsDaemon::setLazyActivation(bool lazy)
+
+  Defer the initialization of plugins declaring activation triggers until the
+  first of them fires, if \a lazy is true. Must be called before loadPlugins().
+*/
+
 /*!
   \fn QStringList ContactsDaemon::loadedPlugins() const
 
@@ -86,6 +101,8 @@ ContactsDaemon::ContactsDaemon(QObject *parent)
 
     mSignalNotifier = new QSocketNotifier(sigFd[1], QSocketNotifier::Read, this);
     connect(mSignalNotifier, SIGNAL(activated(int)), SLOT(onUnixSignalReceived()));
+
+    registerDiagnosticObjects();
 }
 
 ContactsDaemon::~ContactsDaemon()
@@ -93,6 +110,11 @@ ContactsDaemon::~ContactsDaemon()
     delete mLoader;
 }
 
+void ContactsDaemon::setLazyActivation(bool lazy)
+{
+    mLoader->setLazyActivation(lazy);
+}
+
 void ContactsDaemon::loadPlugins(const QStringList &plugins)
 {
     mLoader->loadPlugins(plugins);
@@ -103,10 +125,36 @@ QStringList ContactsDaemon::loadedPlugins() const
     return mLoader->loadedPlugins();
 }
 
-void ContactsDaemon::unixSignalHandler(int)
+void ContactsDaemon::registerDiagnosticObjects()
+{
+    QDBusConnection connection = QDBusConnection::sessionBus();
+
+    Metrics *metrics = Metrics::instance();
+    (void) new MetricsAdaptor(metrics);
+
+    if (!connection.registerObject(QLatin1String("/metrics"), metrics)) {
+        warning() << "Could not register DBus object '/metrics':" << connection.lastError();
+    }
+
+    TraceRecorder *recorder = TraceRecorder::instance();
+    (void) new TraceAdaptor(recorder);
+
+    if (!connection.registerObject(QLatin1String("/trace"), recorder)) {
+        warning() << "Could not register DBus object '/trace':" << connection.lastError();
+    }
+
+    LogControl *logControl = new LogControl(this);
+    (void) new LoggingAdaptor(logControl);
+
+    if (!connection.registerObject(QLatin1String("/logging"), logControl)) {
+        warning() << "Could not register DBus object '/logging':" << connection.lastError();
+    }
+}
+
+void ContactsDaemon::unixSignalHandler(int signalNumber)
 {
-    // Write a byte on the socket to activate the socket listener
-    char a = 1;
+    // Write the signal number on the socket to activate the socket listener
+    char a = signalNumber;
     if (::write(sigFd[0], &a, sizeof(a)) != sizeof(a)) {
         warning() << "Unable to write to sigFd" << errno;
     }
@@ -118,14 +166,21 @@ void ContactsDaemon::onUnixSignalReceived()
     mSignalNotifier->setEnabled(false);
 
     // Empty the socket buffer
-    char dummy;
-    if (::read(sigFd[1], &dummy, sizeof(dummy)) != sizeof(dummy)) {
+    char signalNumber = 0;
+    if (::read(sigFd[1], &signalNumber, sizeof(signalNumber)) != sizeof(signalNumber)) {
         warning() << "Unable to complete read from sigFd" << errno;
     }
 
-    debug() << "Received quit signal";
-
-    QCoreApplication::quit();
+    if (signalNumber == SIGUSR1) {
+        debug() << "Received trace dump signal";
+        TraceRecorder::instance()->dumpTrace();
+    } else if (signalNumber == SIGHUP) {
+        debug() << "Received configuration reload signal";
+        Config::instance()->reload();
+    } else {
+        debug() << "Received quit signal";
+        QCoreApplication::quit();
+    }
 
     // Unmask signals
     mSignalNotifier->setEnabled(true);
@@ -38,17 +38,20 @@ public:
     ContactsDaemon(QObject *parent);
     virtual ~ContactsDaemon();
 
+    void setLazyActivation(bool lazy);
     void loadPlugins(const QStringList &plugins = QStringList());
     QStringList loadedPlugins() const;
 
     // UNIX signal handlers
-    static void unixSignalHandler(int /* unused */);
+    static void unixSignalHandler(int signalNumber);
 
 private Q_SLOTS:
     // Qt signal handler
     void onUnixSignalReceived();
 
 private:
+    void registerDiagnosticObjects();
+
     ContactsdPluginLoader *mLoader;
     static int sigFd[2];
     QSocketNotifier *mSignalNotifier;
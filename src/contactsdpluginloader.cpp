@@ -22,21 +22,29 @@
  **/
 
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QPluginLoader>
+#include <QScopedPointer>
 #include <QString>
 #include <QStringList>
 #include <QVariant>
 #include <QTimer>
+#include <QtConcurrentMap>
 
 #include "contactsdpluginloader.h"
 #include "contactsimportprogressadaptor.h"
+#include "config.h"
 #include "debug.h"
+#include "trace.h"
 
 using namespace Contactsd;
 
-// import timeout is 5 minutes
+static DebugCategory logCategory("loader");
+
+// import timeout is 5 minutes, unless configured as loader/import-timeout
 const int IMPORT_TIMEOUT = 5 * 60 * 1000;
-// alive check timeout is 30 seconds
+// alive check timeout is 30 seconds, unless configured as loader/alive-timeout
 const int ALIVE_TIMEOUT = 30 * 1000;
 
 class MsgHandlerGuard
@@ -57,7 +65,7 @@ public:
     ~MsgHandlerGuard()
     {
         if (qInstallMessageHandler(m_msgHandler) != m_msgHandler) {
-            warning() << "Message handler got modified by"
+            warning(logCategory) << "Message handler got modified by"
                       << m_context << " - don't do that!";
         }
     }
@@ -65,7 +73,9 @@ public:
 
 
 ContactsdPluginLoader::ContactsdPluginLoader()
-    : mImportTimer(0)
+    : mManifest(BasePlugin::cacheFileName(QLatin1String("plugin-manifest")))
+    , mLazyActivation(false)
+    , mImportTimer(0)
     , mCheckAliveTimer(0)
 {
     if (registerNotificationService()) {
@@ -75,10 +85,27 @@ ContactsdPluginLoader::ContactsdPluginLoader()
 
 ContactsdPluginLoader::~ContactsdPluginLoader()
 {
+    qDeleteAll(mActivators.values());
+    mActivators.clear();
     qDeleteAll(mPluginStore.values());
     mPluginStore.clear();
 }
 
+struct PluginLibrary
+{
+    QString fileName;
+    QPluginLoader *loader;
+    qint64 loadTime;
+};
+
+static void loadPluginLibrary(PluginLibrary &library)
+{
+    QElapsedTimer t;
+    t.start();
+    library.loader->load();
+    library.loadTime = t.elapsed();
+}
+
 void ContactsdPluginLoader::loadPlugins(const QStringList &plugins)
 {
     QStringList pluginsDirs;
@@ -90,65 +117,129 @@ void ContactsdPluginLoader::loadPlugins(const QStringList &plugins)
         pluginsDirs << pluginsDirsEnv.split(':');
     }
 
+    QStringList fileNames;
     Q_FOREACH (const QString &pluginsDir, pluginsDirs) {
-        loadPlugins(pluginsDir, plugins);
+        fileNames << pluginFileNames(pluginsDir);
     }
+
+    loadPluginFiles(fileNames, plugins);
 }
 
 void ContactsdPluginLoader::loadPlugins(const QString &pluginsDir, const QStringList &plugins)
+{
+    loadPluginFiles(pluginFileNames(pluginsDir), plugins);
+}
+
+QStringList ContactsdPluginLoader::pluginFileNames(const QString &pluginsDir)
 {
     QDir dir(pluginsDir);
     dir.setFilter(QDir::Files | QDir::NoSymLinks);
 
+    QStringList fileNames;
     Q_FOREACH (const QString &fileName, dir.entryList()) {
-        QString absFileName = dir.absoluteFilePath(fileName);
-        debug() << "Trying to load plugin" << absFileName;
+        fileNames << dir.absoluteFilePath(fileName);
+    }
+
+    return fileNames;
+}
+
+void ContactsdPluginLoader::loadPluginFiles(const QStringList &fileNames, const QStringList &plugins)
+{
+    QElapsedTimer t;
+    t.start();
+
+    // The libraries don't depend on each other, so resolve and dlopen them
+    // all at once; plugin objects must still be created in the main thread
+    QList<PluginLibrary> libraries;
+    Q_FOREACH (const QString &fileName, fileNames) {
+        PluginManifest::Entry entry;
+        if (mManifest.lookup(QFileInfo(fileName), &entry)) {
+            if (entry.name.isEmpty()) {
+                debug(logCategory) << "Skipping non-plugin file" << fileName;
+                continue;
+            }
+            if (!plugins.isEmpty() && !plugins.contains(entry.name)) {
+                debug(logCategory) << "Skipping plugin" << entry.name << "in" << fileName;
+                continue;
+            }
+        }
+
+        debug(logCategory) << "Trying to load plugin" << fileName;
+
+        PluginLibrary library;
+        library.fileName = fileName;
+        library.loader = new QPluginLoader(fileName);
+        library.loadTime = 0;
+        libraries << library;
+    }
+
+    {
+        MsgHandlerGuard guard(QLatin1String("plugin libraries"));
+        QtConcurrent::blockingMap(libraries, loadPluginLibrary);
+        Q_UNUSED(guard); // actually we do: RAII
+    }
+
+    QList<BasePlugin *> pendingPlugins;
+
+    Q_FOREACH (const PluginLibrary &library, libraries) {
+        const QString &absFileName(library.fileName);
 
         MsgHandlerGuard guard(absFileName);
 
-        // We intentionally leak this object, and never unload the plugin
+        // We intentionally leak the plugin, and never unload it (deleting the
+        // loader does not unload the library).
         // When you load a plugin, you can't know what happens in the underlying
         // loaded libraries, so unloading a plugin while being sure it will not
         // have any unwanted side effect is just impossible. For ignored plugins,
         // we just avoid calling the init() function.
-        QPluginLoader loader(absFileName);
+        QScopedPointer<QPluginLoader> loader(library.loader);
 
-        QObject *pluginObject = loader.instance();
+        QObject *pluginObject = loader->instance();
 
         if (!pluginObject) {
-            debug() << "Error loading plugin" << absFileName << "- " << loader.errorString();
+            debug(logCategory) << "Error loading plugin" << absFileName << "- " << loader->errorString();
+
+            // Libraries that failed to load may work next time, but files
+            // without plugin metadata never will
+            if (loader->metaData().isEmpty()) {
+                mManifest.insertNonPlugin(QFileInfo(absFileName));
+            }
             continue;
         }
 
         BasePlugin *basePlugin = qobject_cast<BasePlugin *>(pluginObject);
 
         if (!basePlugin) {
-            debug() << "Error loading plugin" << absFileName << "- not a Contactd::BasePlugin";
+            debug(logCategory) << "Error loading plugin" << absFileName << "- not a Contactd::BasePlugin";
+            mManifest.insertNonPlugin(QFileInfo(absFileName));
             continue;
         }
 
         BasePlugin::MetaData metaData = basePlugin->metaData();
 
         if (!metaData.contains(BasePlugin::metaDataKeyName)) {
-            warning() << "Error loading plugin" << absFileName << "- invalid plugin metadata";
+            warning(logCategory) << "Error loading plugin" << absFileName << "- invalid plugin metadata";
+            mManifest.insertNonPlugin(QFileInfo(absFileName));
             continue;
         }
 
         QString pluginName = metaData[BasePlugin::metaDataKeyName].toString();
+        mManifest.insert(QFileInfo(absFileName), pluginName, metaData[BasePlugin::metaDataKeyVersion].toString());
 
         if (!plugins.isEmpty() && !plugins.contains(pluginName)) {
-            warning() << "Ignoring plugin" << absFileName;
+            warning(logCategory) << "Ignoring plugin" << absFileName;
             continue;
         }
 
         if (mPluginStore.contains(pluginName)) {
-            warning() << "Ignoring plugin" << absFileName <<
+            warning(logCategory) << "Ignoring plugin" << absFileName <<
                 "- plugin with name" << pluginName << "already registered";
             continue;
         }
 
-        debug() << "Plugin" << pluginName << "loaded";
+        debug(logCategory) << "Plugin" << pluginName << "loaded in" << library.loadTime << "ms";
         mPluginStore.insert(pluginName, basePlugin);
+        mPluginLoadTimes.insert(pluginName, library.loadTime);
 
         connect(basePlugin, SIGNAL(importStarted(const QString &, const QString &)),
                 this, SLOT(onPluginImportStarted(const QString &, const QString &)));
@@ -159,10 +250,138 @@ void ContactsdPluginLoader::loadPlugins(const QString &pluginsDir, const QString
         connect(basePlugin, SIGNAL(importAlive()),
                 this, SLOT(onImportAlive()));
 
-        basePlugin->init();
+        pendingPlugins << basePlugin;
 
         Q_UNUSED(guard); // actually we do: RAII
     }
+
+    mManifest.save();
+
+    Q_FOREACH (BasePlugin *basePlugin, initOrder(pendingPlugins)) {
+        const QString name = pluginName(basePlugin);
+        const BasePlugin::MetaData metaData = basePlugin->metaData();
+
+        if (mLazyActivation && PluginActivator::hasTriggers(metaData)) {
+            debug(logCategory) << "Deferring initialization of plugin" << name;
+
+            PluginActivator *activator = new PluginActivator(name, metaData, this);
+            // queued, so the plugin is never initialized from within a
+            // D-Bus dispatch or while we are still loading
+            connect(activator, SIGNAL(triggered(QString)),
+                    this, SLOT(onActivationTriggered(QString)), Qt::QueuedConnection);
+            mActivators.insert(name, activator);
+            activator->start();
+            continue;
+        }
+
+        // Plugins needed by this one can't wait for their triggers
+        Q_FOREACH (const QString &dependency, metaData.value(BasePlugin::metaDataKeyDependencies).toStringList()) {
+            activatePlugin(dependency);
+        }
+
+        initPlugin(basePlugin);
+    }
+
+    debug(logCategory) << "Loaded" << pendingPlugins.count() << "plugins in" << t.elapsed() << "ms";
+
+    Q_EMIT pluginsLoaded();
+}
+
+void ContactsdPluginLoader::initPlugin(BasePlugin *plugin)
+{
+    const QString name = pluginName(plugin);
+
+    MsgHandlerGuard guard(name);
+
+    TraceSpan span(TraceRecorder::instance()->intern(QLatin1String("plugin-init ") + name));
+
+    QElapsedTimer initTimer;
+    initTimer.start();
+
+    plugin->init();
+
+    mPluginInitTimes.insert(name, initTimer.elapsed());
+    debug(logCategory) << "Plugin" << name << "initialized in" << mPluginInitTimes.value(name) << "ms";
+
+    Q_UNUSED(guard); // actually we do: RAII
+}
+
+void ContactsdPluginLoader::activatePlugin(const QString &name)
+{
+    PluginActivator *activator = mActivators.take(name);
+    if (!activator) {
+        return;
+    }
+
+    // Free the object paths for the plugin to register its own objects
+    activator->stop();
+
+    BasePlugin *plugin = mPluginStore.value(name);
+    Q_FOREACH (const QString &dependency, plugin->metaData().value(BasePlugin::metaDataKeyDependencies).toStringList()) {
+        activatePlugin(dependency);
+    }
+
+    initPlugin(plugin);
+
+    activator->replayPendingCalls();
+}
+
+void ContactsdPluginLoader::onActivationTriggered(const QString &name)
+{
+    activatePlugin(name);
+}
+
+QList<BasePlugin *> ContactsdPluginLoader::initOrder(const QList<BasePlugin *> &plugins)
+{
+    QMap<QString, BasePlugin *> pending;
+    Q_FOREACH (BasePlugin *plugin, plugins) {
+        pending.insert(pluginName(plugin), plugin);
+    }
+
+    QList<BasePlugin *> ordered;
+
+    // Repeatedly take the plugins whose dependencies are initialized already;
+    // dependencies which are not being loaded now can't hold anything up
+    while (!pending.isEmpty()) {
+        bool progress = false;
+
+        QMap<QString, BasePlugin *>::iterator it = pending.begin();
+        while (it != pending.end()) {
+            bool ready = true;
+            Q_FOREACH (const QString &dependency, it.value()->metaData().value(BasePlugin::metaDataKeyDependencies).toStringList()) {
+                if (pending.contains(dependency)) {
+                    ready = false;
+                    break;
+                }
+            }
+
+            if (ready) {
+                ordered << it.value();
+                it = pending.erase(it);
+                progress = true;
+            } else {
+                ++it;
+            }
+        }
+
+        if (!progress) {
+            warning(logCategory) << "Circular plugin dependencies between" << pending.keys();
+            ordered << pending.values();
+            break;
+        }
+    }
+
+    return ordered;
+}
+
+QMap<QString, qint64> ContactsdPluginLoader::pluginLoadTimes() const
+{
+    return mPluginLoadTimes;
+}
+
+QMap<QString, qint64> ContactsdPluginLoader::pluginInitTimes() const
+{
+    return mPluginInitTimes;
 }
 
 QStringList ContactsdPluginLoader::loadedPlugins() const
@@ -170,6 +389,16 @@ QStringList ContactsdPluginLoader::loadedPlugins() const
     return mPluginStore.keys();
 }
 
+QStringList ContactsdPluginLoader::pendingPlugins() const
+{
+    return mActivators.keys();
+}
+
+void ContactsdPluginLoader::setLazyActivation(bool lazy)
+{
+    mLazyActivation = lazy;
+}
+
 QStringList ContactsdPluginLoader::hasActiveImports()
 {
     return mImportState.activeImportingServices();
@@ -179,12 +408,12 @@ void ContactsdPluginLoader::onPluginImportStarted(const QString &service, const
 {
     BasePlugin *plugin = qobject_cast<BasePlugin *>(sender());
     if (not plugin) {
-        warning() << Q_FUNC_INFO << "invalid Contactsd::BasePlugin object";
+        warning(logCategory) << Q_FUNC_INFO << "invalid Contactsd::BasePlugin object";
         return ;
     }
 
     QString name = pluginName(plugin);
-    debug() << Q_FUNC_INFO << "by plugin" << name
+    debug(logCategory) << Q_FUNC_INFO << "by plugin" << name
              << "with service" << service << "account" << account;
 
     if (mImportState.hasActiveImports()) {
@@ -208,12 +437,12 @@ void ContactsdPluginLoader::onPluginImportEnded(const QString &service, const QS
 {
     BasePlugin *plugin = qobject_cast<BasePlugin *>(sender());
     if (not plugin) {
-        warning() << Q_FUNC_INFO << "invalid Contactsd::BasePlugin object";
+        warning(logCategory) << Q_FUNC_INFO << "invalid Contactsd::BasePlugin object";
         return ;
     }
 
     QString name = pluginName(plugin);
-    debug() << Q_FUNC_INFO << "by plugin" << name
+    debug(logCategory) << Q_FUNC_INFO << "by plugin" << name
              << "service" << service << "account" << account
              << "added" << contactsAdded << "removed" << contactsRemoved
              << "merged" << contactsMerged;
@@ -221,7 +450,7 @@ void ContactsdPluginLoader::onPluginImportEnded(const QString &service, const QS
     bool removed = mImportState.removeImportingAccount(service, account, contactsAdded,
                                                        contactsRemoved, contactsMerged);
     if (not removed) {
-        debug() << Q_FUNC_INFO << "account does not exist";
+        debug(logCategory) << Q_FUNC_INFO << "account does not exist";
         return ;
     }
 
@@ -247,7 +476,7 @@ void ContactsdPluginLoader::onImportAlive()
 
 void ContactsdPluginLoader::onImportTimeout()
 {
-    debug() << Q_FUNC_INFO;
+    debug(logCategory) << Q_FUNC_INFO;
     stopImportTimer();
     startCheckAliveTimer();
 }
@@ -259,7 +488,8 @@ void ContactsdPluginLoader::startCheckAliveTimer()
     mCheckAliveTimer = new QTimer(this);
     connect(mCheckAliveTimer, SIGNAL(timeout()),
             this, SLOT(onCheckAliveTimeout()));
-    mCheckAliveTimer->start(ALIVE_TIMEOUT);
+    mCheckAliveTimer->start(Config::instance()->intValue(QLatin1String("loader/alive-timeout"),
+                                                         ALIVE_TIMEOUT, 1));
 }
 
 void ContactsdPluginLoader::stopCheckAliveTimer()
@@ -293,7 +523,8 @@ void ContactsdPluginLoader::startImportTimer()
     mImportTimer = new QTimer(this);
     connect(mImportTimer, SIGNAL(timeout()),
             this, SLOT(onImportTimeout()));
-    mImportTimer->start(IMPORT_TIMEOUT);
+    mImportTimer->start(Config::instance()->intValue(QLatin1String("loader/import-timeout"),
+                                                     IMPORT_TIMEOUT, 1));
 }
 
 void ContactsdPluginLoader::stopImportTimer()
@@ -315,18 +546,18 @@ bool ContactsdPluginLoader::registerNotificationService()
 {
     QDBusConnection connection = QDBusConnection::sessionBus();
     if (!connection.isConnected()) {
-        warning() << "Could not connect to DBus:" << connection.lastError();
+        warning(logCategory) << "Could not connect to DBus:" << connection.lastError();
         return false;
     }
 
     if (!connection.registerService("com.nokia.contactsd")) {
-        warning() << "Could not register DBus service "
+        warning(logCategory) << "Could not register DBus service "
             "'com.nokia.contactsd':" << connection.lastError();
         return false;
     }
 
     if (!connection.registerObject("/", this)) {
-        warning() << "Could not register DBus object '/':" <<
+        warning(logCategory) << "Could not register DBus object '/':" <<
             connection.lastError();
         return false;
     }
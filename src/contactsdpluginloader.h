@@ -29,6 +29,8 @@
 
 #include "base-plugin.h"
 #include "importstate.h"
+#include "pluginmanifest.h"
+#include "pluginactivator.h"
 
 class QTimer;
 class QPluginLoader;
@@ -46,6 +48,12 @@ public:
     void loadPlugins(const QStringList &plugins);
     void loadPlugins(const QString &pluginsDir, const QStringList &plugins);
     QStringList loadedPlugins() const;
+    // loaded plugins whose init() waits for an activation trigger
+    QStringList pendingPlugins() const;
+    // defer init() of the plugins declaring activation triggers
+    void setLazyActivation(bool lazy);
+    QMap<QString, qint64> pluginLoadTimes() const;
+    QMap<QString, qint64> pluginInitTimes() const;
     bool registerNotificationService();
 
 public Q_SLOTS:
@@ -67,6 +75,7 @@ private Q_SLOTS:
     void onImportTimeout();
     void onImportAlive();
     void onCheckAliveTimeout();
+    void onActivationTriggered(const QString &name);
 
 private:
     void startImportTimer();
@@ -74,13 +83,25 @@ private:
     void startCheckAliveTimer();
     void stopCheckAliveTimer();
     QString pluginName(Contactsd::BasePlugin *plugin);
+    QStringList pluginFileNames(const QString &pluginsDir);
+    void loadPluginFiles(const QStringList &fileNames, const QStringList &plugins);
+    QList<Contactsd::BasePlugin *> initOrder(const QList<Contactsd::BasePlugin *> &plugins);
+    void initPlugin(Contactsd::BasePlugin *plugin);
+    void activatePlugin(const QString &name);
 
     typedef QMap<QString, Contactsd::BasePlugin*> PluginStore;
     PluginStore mPluginStore;
+    PluginManifest mManifest;
+    QMap<QString, qint64> mPluginLoadTimes;
+    QMap<QString, qint64> mPluginInitTimes;
+    QMap<QString, PluginActivator *> mActivators;
+    bool mLazyActivation;
     ImportState mImportState;
 
     QTimer *mImportTimer;
     QTimer *mCheckAliveTimer;
+
+    friend class TestContactsd;
 };
 
 #endif
@@ -19,6 +19,11 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <QAtomicInt>
+#include <QMultiHash>
+#include <QMutex>
+#include <QMutexLocker>
+
 #include "debug.h"
 
 /**
@@ -67,33 +72,37 @@ namespace Contactsd
 
 namespace
 {
-bool debugEnabled = false;
-bool warningsEnabled = true;
+// plugins log from worker threads too
+QBasicAtomicInt debugEnabled = Q_BASIC_ATOMIC_INITIALIZER(0);
+QBasicAtomicInt warningsEnabled = Q_BASIC_ATOMIC_INITIALIZER(1);
 }
 
 void enableDebug(bool enable)
 {
-    debugEnabled = enable;
+    debugEnabled.store(enable);
+    DebugCategory::updateDefaultLevels();
 }
 
 void enableWarnings(bool enable)
 {
-    warningsEnabled = enable;
+    warningsEnabled.store(enable);
+    DebugCategory::updateDefaultLevels();
 }
 
 bool isDebugEnabled()
 {
-    return debugEnabled;
+    return debugEnabled.load();
 }
 
 bool isWarningsEnabled()
 {
-    return warningsEnabled;
+    return warningsEnabled.load();
 }
 
 Debug enabledDebug()
 {
-    if (debugEnabled) {
+    // checked before any QDebug is created
+    if (debugEnabled.load()) {
         return Debug(qDebug() << "contactsd " VERSION " DEBUG:");
     } else {
         return Debug();
@@ -102,13 +111,27 @@ Debug enabledDebug()
 
 Debug enabledWarning()
 {
-    if (warningsEnabled) {
+    if (warningsEnabled.load()) {
         return Debug(qWarning() << "contactsd " VERSION " WARN:");
     } else {
         return Debug();
     }
 }
 
+// Messages of enabled categories must get past the message handler's level
+// filter, so they are logged in the "contactsd" Qt logging category
+Debug enabledDebug(const DebugCategory &category)
+{
+    return Debug(QMessageLogger(0, 0, 0, "contactsd").debug()
+                 << "contactsd " VERSION " DEBUG" << category.name() << ":");
+}
+
+Debug enabledWarning(const DebugCategory &category)
+{
+    return Debug(QMessageLogger(0, 0, 0, "contactsd").warning()
+                 << "contactsd " VERSION " WARN" << category.name() << ":");
+}
+
 #else /* !defined(ENABLE_DEBUG) */
 
 void enableDebug(bool enable)
@@ -141,6 +164,117 @@ Debug enabledWarning()
     return Debug();
 }
 
+Debug enabledDebug(const DebugCategory &)
+{
+    return Debug();
+}
+
+Debug enabledWarning(const DebugCategory &)
+{
+    return Debug();
+}
+
 #endif /* !defined(ENABLE_DEBUG) */
 
+namespace
+{
+// Function statics, as plugins register their categories while being loaded
+QMutex *categoryMutex()
+{
+    static QMutex mutex;
+    return &mutex;
+}
+
+QMultiHash<QString, DebugCategory *> &categoryRegistry()
+{
+    static QMultiHash<QString, DebugCategory *> registry;
+    return registry;
+}
+
+DebugCategory::Level defaultLevel()
+{
+    if (isDebugEnabled()) {
+        return DebugCategory::DebugLevel;
+    }
+
+    return isWarningsEnabled() ? DebugCategory::WarningLevel : DebugCategory::SilentLevel;
+}
+}
+
+DebugCategory::DebugCategory(const char *name)
+    : mName(name)
+    , mLevel(defaultLevel())
+    , mExplicitLevel(false)
+{
+    QMutexLocker locker(categoryMutex());
+
+    // share the level of an existing category with the same name
+    QMultiHash<QString, DebugCategory *> &registry = categoryRegistry();
+    QMultiHash<QString, DebugCategory *>::const_iterator it = registry.constFind(QLatin1String(name));
+    if (it != registry.constEnd()) {
+        mLevel.store(it.value()->mLevel.load());
+        mExplicitLevel = it.value()->mExplicitLevel;
+    }
+
+    registry.insert(QLatin1String(name), this);
+}
+
+DebugCategory::~DebugCategory()
+{
+    QMutexLocker locker(categoryMutex());
+    categoryRegistry().remove(QLatin1String(mName), this);
+}
+
+QStringList DebugCategory::categoryNames()
+{
+    QMutexLocker locker(categoryMutex());
+    return categoryRegistry().uniqueKeys();
+}
+
+bool DebugCategory::categoryLevel(const QString &name, Level *level)
+{
+    QMutexLocker locker(categoryMutex());
+
+    QMultiHash<QString, DebugCategory *>::const_iterator it = categoryRegistry().constFind(name);
+    if (it == categoryRegistry().constEnd()) {
+        return false;
+    }
+
+    *level = Level(it.value()->mLevel.load());
+    return true;
+}
+
+void DebugCategory::setCategoryLevel(const QString &name, Level level)
+{
+    QMutexLocker locker(categoryMutex());
+
+    Q_FOREACH (DebugCategory *category, categoryRegistry().values(name)) {
+        category->mLevel.store(level);
+        category->mExplicitLevel = true;
+    }
+}
+
+void DebugCategory::resetCategoryLevel(const QString &name)
+{
+    QMutexLocker locker(categoryMutex());
+
+    const Level level = defaultLevel();
+    Q_FOREACH (DebugCategory *category, categoryRegistry().values(name)) {
+        category->mLevel.store(level);
+        category->mExplicitLevel = false;
+    }
+}
+
+void DebugCategory::updateDefaultLevels()
+{
+    QMutexLocker locker(categoryMutex());
+
+    const Level level = defaultLevel();
+    Q_FOREACH (DebugCategory *category, categoryRegistry()) {
+        if (!category->mExplicitLevel) {
+            category->mLevel.store(level);
+        }
+    }
+}
+
 } // Contactsd
@@ -22,7 +22,11 @@
 #ifndef CONTACTSD_DEBUG_H
 #define CONTACTSD_DEBUG_H
 
+#include <QAtomicInt>
 #include <QDebug>
+#include <QStringList>
+
+#include <new>
 
 namespace Contactsd
 {
@@ -35,19 +39,29 @@ bool isWarningsEnabled();
 class Debug
 {
 public:
-    inline Debug() : debug(0) { }
-    inline Debug(const QDebug &debug) : debug(new QDebug(debug)) { }
+    inline Debug() : valid(false) { }
+    inline Debug(const QDebug &debug) : valid(true) { new (storage()) QDebug(debug); }
 
-    inline Debug(const Debug &a) : debug(a.debug ? new QDebug(*(a.debug)) : 0) { }
+    // Copying a QDebug only shares its stream, so keep it in place rather
+    // than allocating one per copy
+    inline Debug(const Debug &a) : valid(a.valid)
+    {
+        if (valid) {
+            new (storage()) QDebug(*a.stream());
+        }
+    }
 
     inline Debug &operator=(const Debug &a)
     {
         if (this != &a) {
-            delete debug;
-            debug = 0;
+            if (valid) {
+                stream()->~QDebug();
+            }
 
-            if (a.debug) {
-                debug = new QDebug(*(a.debug));
+            valid = a.valid;
+
+            if (valid) {
+                new (storage()) QDebug(*a.stream());
             }
         }
 
@@ -56,13 +70,15 @@ public:
 
     inline ~Debug()
     {
-        delete debug;
+        if (valid) {
+            stream()->~QDebug();
+        }
     }
 
     inline Debug &space()
     {
-        if (debug) {
-            debug->space();
+        if (valid) {
+            stream()->space();
         }
 
         return *this;
@@ -70,8 +86,8 @@ public:
 
     inline Debug &nospace()
     {
-        if (debug) {
-            debug->nospace();
+        if (valid) {
+            stream()->nospace();
         }
 
         return *this;
@@ -79,8 +95,8 @@ public:
 
     inline Debug &maybeSpace()
     {
-        if (debug) {
-            debug->maybeSpace();
+        if (valid) {
+            stream()->maybeSpace();
         }
 
         return *this;
@@ -89,16 +105,64 @@ public:
     template <typename T>
     inline Debug &operator<<(T a)
     {
-        if (debug) {
-            (*debug) << a;
+        if (valid) {
+            (*stream()) << a;
         }
 
         return *this;
     }
 
 private:
+    inline void *storage() { return &data; }
+    inline QDebug *stream() { return reinterpret_cast<QDebug *>(&data); }
+    inline const QDebug *stream() const { return reinterpret_cast<const QDebug *>(&data); }
+
+    union {
+        char bytes[sizeof(QDebug)];
+        void *align;
+    } data;
+    bool valid;
+};
 
-    QDebug *debug;
+// A subsystem whose messages can be enabled on their own, to debug one hot
+// path without flooding the log. Categories with the same name share their
+// level. Unless a level was set explicitly, it follows enableDebug() and
+// enableWarnings().
+class DebugCategory
+{
+public:
+    enum Level {
+        DebugLevel,
+        WarningLevel,
+        SilentLevel
+    };
+
+    // \param name - a string literal, it is not copied
+    explicit DebugCategory(const char *name);
+    ~DebugCategory();
+
+    const char *name() const { return mName; }
+
+    // a single atomic load, so disabled categories cost next to nothing
+    inline bool isDebugEnabled() const { return mLevel.load() <= DebugLevel; }
+    inline bool isWarningEnabled() const { return mLevel.load() <= WarningLevel; }
+
+    static QStringList categoryNames();
+    static bool categoryLevel(const QString &name, Level *level);
+    static void setCategoryLevel(const QString &name, Level level);
+    // let the category follow enableDebug() and enableWarnings() again
+    static void resetCategoryLevel(const QString &name);
+
+private:
+    friend void enableDebug(bool enable);
+    friend void enableWarnings(bool enable);
+    static void updateDefaultLevels();
+
+    Q_DISABLE_COPY(DebugCategory)
+
+    const char *mName;
+    QAtomicInt mLevel;
+    bool mExplicitLevel;
 };
 
 // The telepathy-farsight Qt 4 binding links to these - they're not API outside
@@ -106,6 +170,9 @@ private:
 Debug enabledDebug();
 Debug enabledWarning();
 
+Debug enabledDebug(const DebugCategory &category);
+Debug enabledWarning(const DebugCategory &category);
+
 #ifdef ENABLE_DEBUG
 
 inline Debug debug()
@@ -118,6 +185,24 @@ inline Debug warning()
     return enabledWarning();
 }
 
+inline Debug debug(const DebugCategory &category)
+{
+    if (!category.isDebugEnabled()) {
+        return Debug();
+    }
+
+    return enabledDebug(category);
+}
+
+inline Debug warning(const DebugCategory &category)
+{
+    if (!category.isWarningEnabled()) {
+        return Debug();
+    }
+
+    return enabledWarning(category);
+}
+
 #else /* #ifdef ENABLE_DEBUG */
 
 struct NoDebug
@@ -154,6 +239,16 @@ inline NoDebug warning()
     return NoDebug();
 }
 
+inline NoDebug debug(const DebugCategory &)
+{
+    return NoDebug();
+}
+
+inline NoDebug warning(const DebugCategory &)
+{
+    return NoDebug();
+}
+
 #endif /* #ifdef ENABLE_DEBUG */
 
 } // Contactsd
@@ -21,19 +21,38 @@
  ** conditions contained in a signed written agreement between you and Nokia.
  **/
 
+#include <QDir>
+#include <QFileInfo>
+
 #include "debug.h"
 #include "importstateconst.h"
 #include "importstate.h"
 
 using namespace Contactsd;
 
+static DebugCategory logCategory("loader");
+
+// pending account states are written 500 ms after the first change
+const int FLUSH_TIMEOUT = 500;
+
 ImportState::ImportState()
     : mContactsAdded(0),
       mContactsMerged(0),
       mContactsRemoved(0),
       mStateStore(QSettings::IniFormat, QSettings::UserScope,
-                  Contactsd::SettingsOrganization, Contactsd::SettingsApplication)
+                  Contactsd::SettingsOrganization, Contactsd::SettingsApplication),
+      mJournal(mStateStore.fileName() + QLatin1String(".journal"))
+{
+    mFlushTimer.setInterval(FLUSH_TIMEOUT);
+    mFlushTimer.setSingleShot(true);
+    connect(&mFlushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    replayJournal();
+}
+
+ImportState::~ImportState()
 {
+    flush();
 }
 
 bool ImportState::hasActiveImports()
@@ -44,10 +63,9 @@ bool ImportState::hasActiveImports()
 void ImportState::timeout()
 {
     foreach (const QString &account, mService2Accounts.values()) {
-        mStateStore.setValue(account, Contactsd::Imported);
+        storeAccountState(account, Contactsd::Imported);
     }
 
-    mStateStore.sync();
     reset();
 }
 
@@ -71,19 +89,18 @@ bool ImportState::serviceHasActiveImports(const QString &service)
 
 void ImportState::addImportingAccount(const QString &service, const QString &account)
 {
-    debug() << Q_FUNC_INFO << service << account;
+    debug(logCategory) << Q_FUNC_INFO << service << account;
 
     if (not mService2Accounts.contains(service, account)) {
         mService2Accounts.insert(service, account);
-        mStateStore.setValue(account, Contactsd::Importing);
-        mStateStore.sync();
+        storeAccountState(account, Contactsd::Importing);
     }
 }
 
 bool ImportState::removeImportingAccount(const QString &service, const QString &account,
                                          int added, int removed, int merged)
 {
-    debug() << Q_FUNC_INFO << service << account;
+    debug(logCategory) << Q_FUNC_INFO << service << account;
 
     int numRemoved = mService2Accounts.remove(service, account);
 
@@ -91,8 +108,7 @@ bool ImportState::removeImportingAccount(const QString &service, const QString &
         mContactsAdded += added;
         mContactsRemoved += removed;
         mContactsMerged += merged;
-        mStateStore.setValue(account, Contactsd::Imported);
-        mStateStore.sync();
+        storeAccountState(account, Contactsd::Imported);
         return true;
     }
     else
@@ -113,3 +129,95 @@ int ImportState::contactsRemoved()
 {
     return mContactsRemoved;
 }
+
+void ImportState::storeAccountState(const QString &account, int state)
+{
+    mPendingStates.insert(account, state);
+
+    if (not mJournal.isOpen()) {
+        QDir().mkpath(QFileInfo(mJournal).absolutePath());
+    }
+    if (not mJournal.isOpen() && not mJournal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        warning(logCategory) << "Could not open import state journal" << mJournal.fileName()
+                  << mJournal.errorString();
+    }
+
+    if (mJournal.isOpen()) {
+        // one line per change, handed to the kernel at once so a crash
+        // can at worst lose the line being written
+        mJournal.write(QByteArray::number(state) + ' ' + account.toUtf8() + '\n');
+        mJournal.flush();
+    }
+
+    if (not mFlushTimer.isActive()) {
+        mFlushTimer.start();
+    }
+}
+
+void ImportState::flush()
+{
+    mFlushTimer.stop();
+
+    if (mPendingStates.isEmpty()) {
+        return;
+    }
+
+    QHash<QString, int>::const_iterator it;
+    for (it = mPendingStates.constBegin(); it != mPendingStates.constEnd(); ++it) {
+        mStateStore.setValue(it.key(), it.value());
+    }
+
+    mStateStore.sync();
+
+    if (mStateStore.status() != QSettings::NoError) {
+        // keep the journal, it is replayed on the next start
+        warning(logCategory) << "Could not write import state to" << mStateStore.fileName();
+        return;
+    }
+
+    mPendingStates.clear();
+
+    if (mJournal.isOpen()) {
+        mJournal.resize(0);
+    } else {
+        mJournal.remove();
+    }
+}
+
+void ImportState::replayJournal()
+{
+    if (not mJournal.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    while (not mJournal.atEnd()) {
+        const QByteArray line = mJournal.readLine();
+
+        // skip the partial line a crash may have left behind
+        if (not line.endsWith('\n')) {
+            break;
+        }
+
+        const int separator = line.indexOf(' ');
+        bool ok = false;
+        const int state = line.left(separator).toInt(&ok);
+
+        if (separator < 0 || not ok) {
+            warning(logCategory) << "Invalid line in import state journal:" << line;
+            continue;
+        }
+
+        mPendingStates.insert(QString::fromUtf8(line.mid(separator + 1).trimmed()), state);
+    }
+
+    mJournal.close();
+
+    if (mPendingStates.isEmpty()) {
+        mJournal.remove();
+        return;
+    }
+
+    debug(logCategory) << "Recovered" << mPendingStates.count() << "account states from import state journal";
+
+    flush();
+}
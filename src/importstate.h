@@ -24,15 +24,24 @@
 #ifndef IMPORTSTATE_H_
 #define IMPORTSTATE_H_
 
+#include <QFile>
+#include <QHash>
 #include <QMultiHash>
+#include <QObject>
 #include <QString>
 #include <QStringList>
 #include <QSettings>
+#include <QTimer>
 
-class ImportState
+// Account import states are written behind: changes are appended to a
+// journal right away, and merged into the settings file in batches
+class ImportState : public QObject
 {
+    Q_OBJECT
+
 public:
     ImportState();
+    ~ImportState();
 
     bool hasActiveImports();
     // make all account state as finished and reset the state
@@ -56,7 +65,14 @@ public:
     int contactsMerged();
     int contactsRemoved();
 
+public Q_SLOTS:
+    // write the pending account states to the settings file
+    void flush();
+
 private:
+    void storeAccountState(const QString &account, int state);
+    void replayJournal();
+
     // each service may have multiple active importing accounts
     QMultiHash<QString, QString> mService2Accounts;
     // accumlated amount of contacts being added, merged, removed
@@ -65,6 +81,11 @@ private:
     int mContactsRemoved;
     // store each account's import state
     QSettings mStateStore;
+    // account states not written to mStateStore yet
+    QHash<QString, int> mPendingStates;
+    // the pending states, to recover them if we crash before the flush
+    QFile mJournal;
+    QTimer mFlushTimer;
 };
 
 #endif // IMPORTSTATE_H_
@@ -0,0 +1,82 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include "logcontrol.h"
+#include "debug.h"
+
+using namespace Contactsd;
+
+LogControl::LogControl(QObject *parent)
+    : QObject(parent)
+{
+}
+
+QVariantMap LogControl::logLevels() const
+{
+    QVariantMap levels;
+
+    foreach (const QString &name, DebugCategory::categoryNames()) {
+        DebugCategory::Level level;
+        if (!DebugCategory::categoryLevel(name, &level)) {
+            continue; // unloaded meanwhile
+        }
+
+        switch (level) {
+        case DebugCategory::DebugLevel:
+            levels.insert(name, QString::fromLatin1("debug"));
+            break;
+        case DebugCategory::WarningLevel:
+            levels.insert(name, QString::fromLatin1("warning"));
+            break;
+        case DebugCategory::SilentLevel:
+            levels.insert(name, QString::fromLatin1("silent"));
+            break;
+        }
+    }
+
+    return levels;
+}
+
+bool LogControl::setLogLevel(const QString &category, const QString &level)
+{
+    if (!DebugCategory::categoryNames().contains(category)) {
+        warning() << "Unknown debug category" << category;
+        return false;
+    }
+
+    if (level == QLatin1String("debug")) {
+        DebugCategory::setCategoryLevel(category, DebugCategory::DebugLevel);
+    } else if (level == QLatin1String("warning")) {
+        DebugCategory::setCategoryLevel(category, DebugCategory::WarningLevel);
+    } else if (level == QLatin1String("silent")) {
+        DebugCategory::setCategoryLevel(category, DebugCategory::SilentLevel);
+    } else if (level == QLatin1String("default")) {
+        DebugCategory::resetCategoryLevel(category);
+    } else {
+        warning() << "Unknown log level" << level;
+        return false;
+    }
+
+    debug() << "Log level of" << category << "set to" << level;
+    return true;
+}
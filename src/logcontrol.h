@@ -0,0 +1,46 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CONTACTSD_LOGCONTROL_H
+#define CONTACTSD_LOGCONTROL_H
+
+#include <QObject>
+#include <QVariantMap>
+
+// Exposes the debug category levels over D-Bus, so a single subsystem can be
+// made verbose on a running daemon
+class LogControl : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LogControl(QObject *parent = 0);
+
+public Q_SLOTS:
+    // category name -> "debug", "warning" or "silent"
+    QVariantMap logLevels() const;
+    // \param level - "debug", "warning", "silent" or "default"
+    bool setLogLevel(const QString &category, const QString &level);
+};
+
+#endif // CONTACTSD_LOGCONTROL_H
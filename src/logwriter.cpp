@@ -0,0 +1,401 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QFile>
+#include <QtAlgorithms>
+
+#include <errno.h>
+#include <string.h>
+
+#include "logwriter.h"
+#include "debug.h"
+#include "metrics.h"
+
+using namespace Contactsd;
+
+// ring buffer size of each logging thread, must be a power of two
+const int BUFFER_SIZE = 64 * 1024;
+// queued messages are written at least every 100 ms
+const int WRITE_INTERVAL = 100;
+
+namespace {
+
+struct LogRecord
+{
+    quint32 sequence;
+    QByteArray message;
+};
+
+bool operator<(const LogRecord &a, const LogRecord &b)
+{
+    // sequence numbers wrap around
+    return qint32(a.sequence - b.sequence) < 0;
+}
+
+struct RecordHeader
+{
+    quint32 length;
+    quint32 sequence;
+};
+
+} // namespace
+
+// Single producer, single consumer ring buffer: the owning thread appends,
+// and whoever holds LogWriter::mWriteMutex takes the records out
+class LogBuffer
+{
+public:
+    LogBuffer()
+        : mData(BUFFER_SIZE, '\0')
+    {
+    }
+
+    bool append(quint32 sequence, const QByteArray &message)
+    {
+        const quint32 head = quint32(mHead.load());
+        const quint32 tail = quint32(mTail.loadAcquire());
+        const quint32 size = sizeof(RecordHeader) + message.size();
+
+        if (size > BUFFER_SIZE - (head - tail)) {
+            return false;
+        }
+
+        RecordHeader header;
+        header.length = message.size();
+        header.sequence = sequence;
+        copyIn(head, reinterpret_cast<const char *>(&header), sizeof(header));
+        copyIn(head + sizeof(header), message.constData(), message.size());
+
+        mHead.storeRelease(int(head + size));
+        return true;
+    }
+
+    // true if more than half full
+    bool isFilling() const
+    {
+        return quint32(mHead.load()) - quint32(mTail.load()) > BUFFER_SIZE / 2;
+    }
+
+    bool isEmpty() const
+    {
+        return mHead.loadAcquire() == mTail.load();
+    }
+
+    void takeRecords(QList<LogRecord> &records)
+    {
+        const quint32 head = quint32(mHead.loadAcquire());
+        quint32 tail = quint32(mTail.load());
+
+        while (tail != head) {
+            RecordHeader header;
+            copyOut(tail, reinterpret_cast<char *>(&header), sizeof(header));
+
+            LogRecord record;
+            record.sequence = header.sequence;
+            record.message.resize(header.length);
+            copyOut(tail + sizeof(header), record.message.data(), header.length);
+            records << record;
+
+            tail += sizeof(header) + header.length;
+        }
+
+        mTail.storeRelease(int(tail));
+    }
+
+    // set once the owning thread is gone
+    QAtomicInt released;
+
+private:
+    void copyIn(quint32 position, const char *data, quint32 length)
+    {
+        const quint32 offset = position & (BUFFER_SIZE - 1);
+        const quint32 first = qMin(length, BUFFER_SIZE - offset);
+        memcpy(mData.data() + offset, data, first);
+        memcpy(mData.data(), data + first, length - first);
+    }
+
+    void copyOut(quint32 position, char *data, quint32 length) const
+    {
+        const quint32 offset = position & (BUFFER_SIZE - 1);
+        const quint32 first = qMin(length, BUFFER_SIZE - offset);
+        memcpy(data, mData.constData() + offset, first);
+        memcpy(data + first, mData.constData(), length - first);
+    }
+
+    QByteArray mData;
+    QAtomicInt mHead;
+    QAtomicInt mTail;
+};
+
+struct LogWriter::BufferRef
+{
+    BufferRef(LogBuffer *buffer) : buffer(buffer) {}
+    ~BufferRef() { buffer->released.storeRelease(1); }
+
+    LogBuffer *buffer;
+};
+
+LogWriter::LogWriter(bool console)
+    : mReportedDrops(0)
+    , mConsole(console)
+    , mFile(0)
+    , mFileSize(0)
+    , mMaxFileSize(0)
+    , mKeepCount(0)
+{
+}
+
+LogWriter::~LogWriter()
+{
+    stop();
+
+    qDeleteAll(mBuffers);
+
+    if (mFile) {
+        fclose(mFile);
+    }
+}
+
+void LogWriter::write(const QByteArray &message)
+{
+    LogBuffer *buffer = threadBuffer();
+
+    if (not buffer->append(quint32(mSequence.fetchAndAddRelaxed(1)), message)) {
+        static Counter *dropped = Metrics::instance()->counter(QLatin1String("contactsd.log-messages-dropped"));
+        dropped->add();
+        mDropped.ref();
+    }
+
+    if (buffer->isFilling()) {
+        mWakeUp.wakeOne();
+    }
+}
+
+void LogWriter::flush()
+{
+    // mWriteMutex is not recursive, and a thread which raises a fatal message
+    // from within a write would wait for itself instead of aborting
+    if (mWritingThread.load() == QThread::currentThread()) {
+        writeInterrupted();
+        return;
+    }
+
+    writeQueued();
+}
+
+void LogWriter::stop()
+{
+    if (isRunning()) {
+        mStopping.storeRelease(1);
+        mWakeUp.wakeOne();
+        wait();
+    }
+
+    writeQueued();
+}
+
+bool LogWriter::setLogFile(const QString &fileName, qint64 maxSize, int keepCount)
+{
+    mFileName = fileName;
+    mMaxFileSize = maxSize;
+    mKeepCount = keepCount;
+
+    // Keep the log of the previous run
+    if (QFile(mFileName).size() > 0) {
+        rotateLogFile();
+    }
+
+    return openLogFile();
+}
+
+bool LogWriter::openLogFile()
+{
+    mFile = fopen(QFile::encodeName(mFileName).constData(), "a");
+    mFileSize = mFile ? ftell(mFile) : 0;
+    return mFile != 0;
+}
+
+void LogWriter::rotateLogFile()
+{
+    if (mFile) {
+        fclose(mFile);
+        mFile = 0;
+    }
+
+    if (mKeepCount < 1) {
+        QFile::remove(mFileName);
+        return;
+    }
+
+    QFile::remove(mFileName + QLatin1Char('.') + QString::number(mKeepCount));
+
+    for (int i = mKeepCount - 1; i > 0; --i) {
+        QFile::rename(mFileName + QLatin1Char('.') + QString::number(i),
+                      mFileName + QLatin1Char('.') + QString::number(i + 1));
+    }
+
+    QFile::rename(mFileName, mFileName + QLatin1String(".1"));
+}
+
+int LogWriter::droppedMessages() const
+{
+    return mDropped.load();
+}
+
+void LogWriter::run()
+{
+    QMutex waitMutex;
+    QMutexLocker locker(&waitMutex);
+
+    while (not mStopping.loadAcquire()) {
+        mWakeUp.wait(&waitMutex, WRITE_INTERVAL);
+        writeQueued();
+    }
+}
+
+LogBuffer *LogWriter::threadBuffer()
+{
+    BufferRef *ref = mThreadBuffers.localData();
+
+    if (not ref) {
+        ref = new BufferRef(new LogBuffer);
+        mThreadBuffers.setLocalData(ref);
+
+        // Only taken once per thread
+        QMutexLocker locker(&mBuffersMutex);
+        mBuffers << ref->buffer;
+    }
+
+    return ref->buffer;
+}
+
+void LogWriter::writeQueued()
+{
+    QMutexLocker writeLocker(&mWriteMutex);
+    mWritingThread.store(QThread::currentThread());
+
+    QList<LogRecord> records;
+
+    {
+        QMutexLocker locker(&mBuffersMutex);
+
+        QList<LogBuffer *>::iterator it = mBuffers.begin();
+        while (it != mBuffers.end()) {
+            LogBuffer *buffer = *it;
+            // check before taking the records, so that nothing the thread
+            // wrote before exiting is missed
+            const bool released = buffer->released.loadAcquire();
+
+            buffer->takeRecords(records);
+
+            if (released) {
+                delete buffer;
+                it = mBuffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    const int dropped = mDropped.load();
+    if (records.isEmpty() && dropped == mReportedDrops) {
+        mWritingThread.store(0);
+        return;
+    }
+
+    // restore the order in which the threads logged
+    qStableSort(records);
+
+    QByteArray batch;
+    Q_FOREACH (const LogRecord &record, records) {
+        batch += record.message;
+        batch += '\n';
+    }
+
+    if (dropped != mReportedDrops) {
+        batch += "contactsd: " + QByteArray::number(dropped - mReportedDrops)
+               + " log messages dropped\n";
+        mReportedDrops = dropped;
+    }
+
+    writeBatch(batch);
+    mWritingThread.store(0);
+}
+
+void LogWriter::writeInterrupted()
+{
+    // The records of the other threads were taken by the interrupted write
+    // already, only the messages this thread logged since are left. As the
+    // caller holds mWriteMutex, it may take them out of its own buffer.
+    QList<LogRecord> records;
+    threadBuffer()->takeRecords(records);
+
+    QByteArray batch;
+    Q_FOREACH (const LogRecord &record, records) {
+        batch += record.message;
+        batch += '\n';
+    }
+
+    if (mConsole) {
+        fwrite(batch.constData(), 1, batch.size(), stderr);
+    }
+
+    if (mFile) {
+        fwrite(batch.constData(), 1, batch.size(), mFile);
+        fflush(mFile);
+    }
+}
+
+void LogWriter::writeBatch(const QByteArray &batch)
+{
+    if (mConsole) {
+        fwrite(batch.constData(), 1, batch.size(), stderr);
+    }
+
+    if (mFile && mMaxFileSize > 0 && mFileSize > 0 && mFileSize + batch.size() > mMaxFileSize) {
+        rotateLogFile();
+
+        if (not openLogFile()) {
+            const int fileError = errno;
+            (warning().nospace()
+                    << "Could not reopen the log file after rotating it: "
+                    << strerror(fileError) << " (" << fileError << ").").space();
+        }
+    }
+
+    if (mFile) {
+        mFileSize += batch.size();
+
+        if (fwrite(batch.constData(), 1, batch.size(), mFile) != size_t(batch.size())
+                || fflush(mFile) != 0) {
+            const int fileError = errno;
+            fclose(mFile);
+            mFile = 0;
+
+            (warning().nospace()
+                    << "An error occured when writing to the log file: "
+                    << strerror(fileError) << " (" << fileError << "). "
+                    << "The log file is truncated.").space();
+        }
+    }
+}
@@ -0,0 +1,102 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef LOGWRITER_H_
+#define LOGWRITER_H_
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QThreadStorage>
+#include <QWaitCondition>
+
+#include <stdio.h>
+
+class LogBuffer;
+
+// Writes log messages from a background thread. Each thread logs into its
+// own ring buffer without taking any lock, and the writer thread collects
+// the messages of all threads and writes them out in batches.
+class LogWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    // \param console - write messages to stderr
+    explicit LogWriter(bool console);
+    ~LogWriter();
+
+    // Also write the messages to fileName. Once it grows beyond maxSize bytes
+    // it is renamed to fileName.1, shifting older files up to fileName.N,
+    // with N = keepCount; older ones are removed. Call before start().
+    bool setLogFile(const QString &fileName, qint64 maxSize, int keepCount);
+
+    // queue a message, from any thread; a newline is appended when written
+    void write(const QByteArray &message);
+    // write out all queued messages before returning, from any thread; also
+    // from within a write on the same thread, as when a fatal message is
+    // raised while writing
+    void flush();
+    // flush and stop the writer thread
+    void stop();
+
+    // messages lost because the writing thread's buffer was full
+    int droppedMessages() const;
+
+protected:
+    void run();
+
+private:
+    struct BufferRef;
+
+    LogBuffer *threadBuffer();
+    void writeQueued();
+    void writeInterrupted();
+    void writeBatch(const QByteArray &batch);
+    bool openLogFile();
+    void rotateLogFile();
+
+    QList<LogBuffer *> mBuffers;
+    QThreadStorage<BufferRef *> mThreadBuffers;
+    QMutex mBuffersMutex;
+    QMutex mWriteMutex;
+    // the thread holding mWriteMutex
+    QAtomicPointer<QThread> mWritingThread;
+    QWaitCondition mWakeUp;
+    QAtomicInt mSequence;
+    QAtomicInt mDropped;
+    QAtomicInt mStopping;
+    int mReportedDrops;
+    bool mConsole;
+    FILE *mFile;
+    QString mFileName;
+    qint64 mFileSize;
+    qint64 mMaxFileSize;
+    int mKeepCount;
+};
+
+#endif // LOGWRITER_H_
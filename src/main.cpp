@@ -25,46 +25,37 @@
 #include <QDBusConnection>
 #include <QTimer>
 
-#include <errno.h>
 #include <signal.h>
 
+#include "config.h"
 #include "contactsd.h"
 #include "debug.h"
+#include "logwriter.h"
 
 using namespace Contactsd;
 
 static QtMessageHandler defaultMsgHandler = 0;
 static QtMsgType messageThreshold = QtWarningMsg;
-static FILE *messageLog = NULL;
+static LogWriter *logWriter = 0;
 
 static void customMessageHandler(QtMsgType type, const QMessageLogContext &ctxt, const QString &msgStr)
 {
-    if (type < messageThreshold) {
+    // debug categories enabled at runtime log in the "contactsd" category
+    if (type < messageThreshold && qstrcmp(ctxt.category, "contactsd") != 0) {
         return; // no debug messages please
     }
 
-    const QByteArray &msgData(msgStr.toLocal8Bit());
-    const char *msg = msgData.constData();
-
     // Actually qInstallMsgHandler() returned null in main() when
     // I checked, so defaultMsgHandler should be null - but let's be careful.
     if (defaultMsgHandler) {
         defaultMsgHandler(type, ctxt, msgStr);
-    } else {
-        fprintf(stderr, "%s\n", msg);
     }
 
-    if (messageLog) {
-        if (fprintf(messageLog, "%s\n", msg) < 0 || fflush(messageLog) != 0) {
-            const int messageLogError = errno;
-            fclose(messageLog);
-            messageLog = NULL;
+    logWriter->write(msgStr.toLocal8Bit());
 
-            (warning().nospace()
-                    << "An error occured when writing to the log file: "
-                    << strerror(messageLogError) << " (" << messageLogError << "). "
-                    << "The log file is truncated.").space();
-        }
+    if (type == QtFatalMsg) {
+        // we are about to abort
+        logWriter->flush();
     }
 }
 
@@ -76,8 +67,12 @@ static void usage()
             << "Options:\n"
             << "\n"
             << "  --plugins PLUGINS    Comma separated list of plugins to load\n"
+            << "  --lazy-plugins       Initialize plugins only once they are needed\n"
+            << "  --config FILENAME    Read tuning values from FILENAME (default: ~/.config/contactsd/contactsd.conf)\n"
             << "  --log-console        Enable console logging\n"
             << "  --log-file FILENAME  Additional write logging information to FILENAME\n"
+            << "  --log-file-size KB   Rotate the log file when it exceeds KB kilobytes (default: 1024, 0 never)\n"
+            << "  --log-file-count N   Keep N rotated log files (default: 3)\n"
             << "  --version            Output version information and exit\n"
             << "  --help               Display this help and exit\n"
             << "\n";
@@ -85,7 +80,7 @@ static void usage()
 
 static void setupUnixSignalHandlers()
 {
-    struct sigaction sigterm, sigint;
+    struct sigaction sigterm, sigint, sigusr1, sighup;
 
     sigterm.sa_handler = ContactsDaemon::unixSignalHandler;
     sigemptyset(&sigterm.sa_mask);
@@ -104,6 +99,24 @@ static void setupUnixSignalHandlers()
         warning() << "Could not setup signal handler for SIGINT";
         return;
     }
+
+    sigusr1.sa_handler = ContactsDaemon::unixSignalHandler;
+    sigemptyset(&sigusr1.sa_mask);
+    sigusr1.sa_flags = SA_RESTART;
+
+    if (sigaction(SIGUSR1, &sigusr1, 0) < 0) {
+        warning() << "Could not setup signal handler for SIGUSR1";
+        return;
+    }
+
+    sighup.sa_handler = ContactsDaemon::unixSignalHandler;
+    sigemptyset(&sighup.sa_mask);
+    sighup.sa_flags = SA_RESTART;
+
+    if (sigaction(SIGHUP, &sighup, 0) < 0) {
+        warning() << "Could not setup signal handler for SIGHUP";
+        return;
+    }
 }
 
 int main(int argc, char **argv)
@@ -114,7 +127,11 @@ int main(int argc, char **argv)
 
     QStringList plugins;
     bool logConsole = !qgetenv("CONTACTSD_DEBUG").isEmpty();
+    bool lazyPlugins = false;
     QString logFileName;
+    QString configFileName;
+    qint64 logFileSize = 1024;
+    int logFileCount = 3;
 
     const QStringList args = app.arguments();
     int i = 1; // ignore argv[0]
@@ -137,6 +154,14 @@ int main(int argc, char **argv)
         } else if (arg == "--help") {
             usage();
             return 0;
+        } else if (arg == "--config") {
+            if (++i == args.count()) {
+                usage();
+                return -1;
+            }
+            configFileName = args.at(i);
+        } else if (arg == "--lazy-plugins") {
+            lazyPlugins = true;
         } else if (arg == "--log-console") {
             logConsole = true;
         } else if (arg == "--log-file") {
@@ -146,6 +171,20 @@ int main(int argc, char **argv)
             }
 
             logFileName = args.at(i);
+        } else if (arg == "--log-file-size" || arg == "--log-file-count") {
+            bool ok = false;
+            const int value = (++i < args.count() ? args.at(i).toInt(&ok) : 0);
+
+            if (not ok || value < 0) {
+                usage();
+                return -1;
+            }
+
+            if (arg == "--log-file-size") {
+                logFileSize = value;
+            } else {
+                logFileCount = value;
+            }
         } else {
             warning() << "Invalid argument" << arg;
             usage();
@@ -158,23 +197,34 @@ int main(int argc, char **argv)
         messageThreshold = QtDebugMsg;
     }
 
-    if (not logFileName.isEmpty()) {
-        messageLog = fopen(qPrintable(logFileName), "w");
-    }
+    defaultMsgHandler = qInstallMessageHandler(0);
+    logWriter = new LogWriter(defaultMsgHandler == 0);
 
-    defaultMsgHandler = qInstallMessageHandler(customMessageHandler);
+    if (not logFileName.isEmpty()
+            && not logWriter->setLogFile(logFileName, logFileSize * 1024, logFileCount)) {
+        warning() << "Could not open log file" << logFileName;
+    }
+    logWriter->start();
+    qInstallMessageHandler(customMessageHandler);
 
     enableDebug(logConsole);
     debug() << "contactsd version" << VERSION << "started";
 
+    if (not configFileName.isEmpty()) {
+        Config::instance()->setFileName(configFileName);
+    }
+
     ContactsDaemon *daemon = new ContactsDaemon(&app);
+    daemon->setLazyActivation(lazyPlugins);
     daemon->loadPlugins(plugins);
 
     const int rc = app.exec();
 
-    if (messageLog) {
-        fclose (messageLog);
-    }
+    // Unload the plugins while their messages still get logged
+    delete daemon;
+
+    qInstallMessageHandler(defaultMsgHandler);
+    delete logWriter;
 
     return rc;
 }
@@ -0,0 +1,190 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QThread>
+
+#include "metrics.h"
+
+namespace Contactsd
+{
+
+// 1 ms to 10 s, and everything slower
+static const qint64 histogramBounds[] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000
+};
+
+QList<qint64> Histogram::bucketBounds()
+{
+    QList<qint64> bounds;
+    for (int i = 0; i < BucketCount - 1; ++i) {
+        bounds << histogramBounds[i];
+    }
+    return bounds;
+}
+
+void Histogram::record(qint64 value)
+{
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && value > histogramBounds[bucket]) {
+        ++bucket;
+    }
+
+    mBuckets[bucket].fetchAndAddRelaxed(1);
+    mCount.fetchAndAddRelaxed(1);
+    mSum.fetchAndAddRelaxed(value);
+}
+
+QList<qint64> Histogram::bucketCounts() const
+{
+    QList<qint64> counts;
+    for (int i = 0; i < BucketCount; ++i) {
+        counts << mBuckets[i].load();
+    }
+    return counts;
+}
+
+Metrics::Metrics()
+{
+}
+
+Metrics::~Metrics()
+{
+    qDeleteAll(mCounters);
+    qDeleteAll(mGauges);
+    qDeleteAll(mHistograms);
+}
+
+Metrics *Metrics::instance()
+{
+    static QAtomicPointer<Metrics> metrics;
+    static QMutex mutex;
+
+    if (Metrics *m = metrics.loadAcquire()) {
+        return m;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    if (!metrics.load()) {
+        Metrics *m = new Metrics;
+
+        // Metrics may first be used from a worker thread, but D-Bus calls
+        // must be delivered to the main thread
+        if (QCoreApplication::instance()) {
+            m->moveToThread(QCoreApplication::instance()->thread());
+        }
+
+        metrics.storeRelease(m);
+    }
+
+    return metrics.load();
+}
+
+Counter *Metrics::counter(const QString &name)
+{
+    QMutexLocker locker(&mMutex);
+
+    Counter *&counter = mCounters[name];
+    if (!counter) {
+        counter = new Counter;
+    }
+    return counter;
+}
+
+Gauge *Metrics::gauge(const QString &name)
+{
+    QMutexLocker locker(&mMutex);
+
+    Gauge *&gauge = mGauges[name];
+    if (!gauge) {
+        gauge = new Gauge;
+    }
+    return gauge;
+}
+
+Histogram *Metrics::histogram(const QString &name)
+{
+    QMutexLocker locker(&mMutex);
+
+    Histogram *&histogram = mHistograms[name];
+    if (!histogram) {
+        histogram = new Histogram;
+    }
+    return histogram;
+}
+
+QVariantMap Metrics::counters() const
+{
+    QMutexLocker locker(&mMutex);
+
+    QVariantMap values;
+    QMap<QString, Counter *>::const_iterator it;
+    for (it = mCounters.constBegin(); it != mCounters.constEnd(); ++it) {
+        values.insert(it.key(), it.value()->value());
+    }
+    return values;
+}
+
+QVariantMap Metrics::gauges() const
+{
+    QMutexLocker locker(&mMutex);
+
+    QVariantMap values;
+    QMap<QString, Gauge *>::const_iterator it;
+    for (it = mGauges.constBegin(); it != mGauges.constEnd(); ++it) {
+        values.insert(it.key(), it.value()->value());
+    }
+    return values;
+}
+
+static QVariantList toVariantList(const QList<qint64> &values)
+{
+    QVariantList list;
+    Q_FOREACH (qint64 value, values) {
+        list << value;
+    }
+    return list;
+}
+
+QVariantMap Metrics::histograms() const
+{
+    QMutexLocker locker(&mMutex);
+
+    const QVariantList bounds = toVariantList(Histogram::bucketBounds());
+
+    QVariantMap values;
+    QMap<QString, Histogram *>::const_iterator it;
+    for (it = mHistograms.constBegin(); it != mHistograms.constEnd(); ++it) {
+        QVariantMap histogram;
+        histogram.insert(QLatin1String("count"), it.value()->count());
+        histogram.insert(QLatin1String("sum"), it.value()->sum());
+        histogram.insert(QLatin1String("bounds"), bounds);
+        histogram.insert(QLatin1String("buckets"), toVariantList(it.value()->bucketCounts()));
+        values.insert(it.key(), histogram);
+    }
+    return values;
+}
+
+} // Contactsd
@@ -0,0 +1,147 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CONTACTSD_METRICS_H
+#define CONTACTSD_METRICS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVariantMap>
+
+namespace Contactsd
+{
+
+// Monotonically increasing count, e.g. of contacts written
+class Counter
+{
+public:
+    Counter() {}
+
+    void add(qint64 amount = 1) { mValue.fetchAndAddRelaxed(amount); }
+    qint64 value() const { return mValue.load(); }
+
+private:
+    Q_DISABLE_COPY(Counter)
+
+    QAtomicInteger<qint64> mValue;
+};
+
+// Current level of something, e.g. a queue depth
+class Gauge
+{
+public:
+    Gauge() {}
+
+    void set(qint64 value) { mValue.store(value); }
+    void add(qint64 amount) { mValue.fetchAndAddRelaxed(amount); }
+    qint64 value() const { return mValue.load(); }
+
+private:
+    Q_DISABLE_COPY(Gauge)
+
+    QAtomicInteger<qint64> mValue;
+};
+
+// Distribution of latencies in milliseconds, over fixed exponential buckets
+class Histogram
+{
+public:
+    Histogram() {}
+
+    // upper bounds of the buckets; a last bucket takes everything above
+    static QList<qint64> bucketBounds();
+
+    void record(qint64 value);
+
+    qint64 count() const { return mCount.load(); }
+    qint64 sum() const { return mSum.load(); }
+    QList<qint64> bucketCounts() const;
+
+private:
+    Q_DISABLE_COPY(Histogram)
+
+    enum { BucketCount = 14 };
+
+    QAtomicInteger<qint64> mBuckets[BucketCount];
+    QAtomicInteger<qint64> mCount;
+    QAtomicInteger<qint64> mSum;
+};
+
+// Records the lifetime of the scope into a histogram
+class HistogramTimer
+{
+public:
+    explicit HistogramTimer(Histogram *histogram)
+        : mHistogram(histogram)
+    {
+        mTimer.start();
+    }
+
+    ~HistogramTimer()
+    {
+        mHistogram->record(mTimer.elapsed());
+    }
+
+private:
+    Histogram *mHistogram;
+    QElapsedTimer mTimer;
+};
+
+// Registry of the daemon's metrics, exported on the com.nokia.contactsd.metrics
+// D-Bus interface. Metrics are created on first use and live as long as the
+// daemon, so the returned pointers can be kept.
+class Metrics : public QObject
+{
+    Q_OBJECT
+
+public:
+    static Metrics *instance();
+
+    Counter *counter(const QString &name);
+    Gauge *gauge(const QString &name);
+    Histogram *histogram(const QString &name);
+
+public Q_SLOTS:
+    QVariantMap counters() const;
+    QVariantMap gauges() const;
+    // each value is a map of "count", "sum", "bounds" and "buckets"
+    QVariantMap histograms() const;
+
+private:
+    Metrics();
+    ~Metrics();
+
+    mutable QMutex mMutex;
+    QMap<QString, Counter *> mCounters;
+    QMap<QString, Gauge *> mGauges;
+    QMap<QString, Histogram *> mHistograms;
+};
+
+} // Contactsd
+
+#endif // CONTACTSD_METRICS_H
@@ -0,0 +1,287 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusPendingCallWatcher>
+#include <QDBusServiceWatcher>
+#include <QDBusVirtualObject>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSettings>
+
+#include "pluginactivator.h"
+#include "importstateconst.h"
+#include "debug.h"
+
+using namespace Contactsd;
+
+static DebugCategory logCategory("loader");
+
+namespace {
+
+// Stands in for the plugin's object until it is initialized
+class ActivationStub : public QDBusVirtualObject
+{
+public:
+    ActivationStub(PluginActivator *activator)
+        : QDBusVirtualObject(activator)
+        , mActivator(activator)
+    {
+    }
+
+    QString introspect(const QString &) const
+    {
+        return QString();
+    }
+
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &)
+    {
+        // replied to by replayPendingCalls()
+        mActivator->queueCall(message);
+        return true;
+    }
+
+private:
+    PluginActivator *mActivator;
+};
+
+// Queued calls are replayed over a connection of their own: calls over the
+// local loop could not be replied to later, as the plugin's objects may do
+QDBusConnection replayConnection()
+{
+    return QDBusConnection::connectToBus(QDBusConnection::SessionBus,
+                                         QLatin1String("contactsd-activation"));
+}
+
+} // namespace
+
+PluginActivator::PluginActivator(const QString &pluginName, const BasePlugin::MetaData &metaData,
+                                 QObject *parent)
+    : QObject(parent)
+    , mPluginName(pluginName)
+    , mServices(metaData.value(BasePlugin::metaDataKeyActivationServices).toStringList())
+    , mSettingsKeys(metaData.value(BasePlugin::metaDataKeyActivationSettings).toStringList())
+    , mObjectPaths(metaData.value(BasePlugin::metaDataKeyActivationObjectPaths).toStringList())
+    , mServiceWatcher(0)
+    , mSettingsWatcher(0)
+    , mTriggered(false)
+{
+}
+
+PluginActivator::~PluginActivator()
+{
+    stop();
+}
+
+bool PluginActivator::hasTriggers(const BasePlugin::MetaData &metaData)
+{
+    return !metaData.value(BasePlugin::metaDataKeyActivationServices).toStringList().isEmpty()
+        || !metaData.value(BasePlugin::metaDataKeyActivationSettings).toStringList().isEmpty()
+        || !metaData.value(BasePlugin::metaDataKeyActivationObjectPaths).toStringList().isEmpty();
+}
+
+QString PluginActivator::pluginName() const
+{
+    return mPluginName;
+}
+
+void PluginActivator::start()
+{
+    QDBusConnection connection = QDBusConnection::sessionBus();
+
+    if (!mServices.isEmpty()) {
+        mServiceWatcher = new QDBusServiceWatcher(this);
+        mServiceWatcher->setConnection(connection);
+        mServiceWatcher->setWatchMode(QDBusServiceWatcher::WatchForRegistration);
+        mServiceWatcher->setWatchedServices(mServices);
+        connect(mServiceWatcher, SIGNAL(serviceRegistered(QString)),
+                this, SLOT(onServiceRegistered(QString)));
+    }
+
+    if (!mSettingsKeys.isEmpty()) {
+        mSettingsWatcher = new QFileSystemWatcher(this);
+        connect(mSettingsWatcher, SIGNAL(directoryChanged(QString)),
+                this, SLOT(onSettingsChanged()));
+        connect(mSettingsWatcher, SIGNAL(fileChanged(QString)),
+                this, SLOT(onSettingsChanged()));
+    }
+
+    Q_FOREACH (const QString &path, mObjectPaths) {
+        ActivationStub *stub = new ActivationStub(this);
+
+        if (!connection.registerVirtualObject(path, stub)) {
+            warning(logCategory) << "Could not register activation object" << path
+                      << "for plugin" << mPluginName;
+            delete stub;
+            continue;
+        }
+
+        mStubs << stub;
+    }
+
+    // The trigger may have fired before we started watching
+    Q_FOREACH (const QString &service, mServices) {
+        if (connection.interface()->isServiceRegistered(service)) {
+            trigger(QString::fromLatin1("service %1").arg(service));
+            return;
+        }
+    }
+
+    if (mSettingsWatcher) {
+        onSettingsChanged();
+    }
+}
+
+void PluginActivator::stop()
+{
+    delete mServiceWatcher;
+    mServiceWatcher = 0;
+
+    delete mSettingsWatcher;
+    mSettingsWatcher = 0;
+
+    if (!mStubs.isEmpty()) {
+        QDBusConnection connection = QDBusConnection::sessionBus();
+        Q_FOREACH (const QString &path, mObjectPaths) {
+            connection.unregisterObject(path);
+        }
+
+        qDeleteAll(mStubs);
+        mStubs.clear();
+    }
+}
+
+void PluginActivator::queueCall(const QDBusMessage &message)
+{
+    mPendingCalls << message;
+    trigger(QString::fromLatin1("call to %1").arg(message.path()));
+}
+
+void PluginActivator::replayPendingCalls()
+{
+    const QString service = QDBusConnection::sessionBus().baseService();
+    QDBusConnection connection = replayConnection();
+
+    Q_FOREACH (const QDBusMessage &message, mPendingCalls) {
+        QDBusMessage call = QDBusMessage::createMethodCall(service, message.path(),
+                                                           message.interface(), message.member());
+        call.setArguments(message.arguments());
+
+        if (!message.isReplyRequired()) {
+            connection.send(call);
+            continue;
+        }
+
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(connection.asyncCall(call), this);
+        connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)),
+                this, SLOT(onReplayFinished(QDBusPendingCallWatcher *)));
+        mReplayedCalls.insert(watcher, message);
+    }
+
+    mPendingCalls.clear();
+
+    if (mReplayedCalls.isEmpty()) {
+        deleteLater();
+    }
+}
+
+void PluginActivator::onReplayFinished(QDBusPendingCallWatcher *watcher)
+{
+    const QDBusMessage message = mReplayedCalls.take(watcher);
+    const QDBusMessage reply = watcher->reply();
+
+    if (reply.type() == QDBusMessage::ErrorMessage) {
+        QDBusConnection::sessionBus().send(message.createErrorReply(reply.errorName(), reply.errorMessage()));
+    } else {
+        QDBusConnection::sessionBus().send(message.createReply(reply.arguments()));
+    }
+
+    watcher->deleteLater();
+
+    if (mReplayedCalls.isEmpty()) {
+        deleteLater();
+    }
+}
+
+void PluginActivator::onServiceRegistered(const QString &service)
+{
+    trigger(QString::fromLatin1("service %1").arg(service));
+}
+
+void PluginActivator::onSettingsChanged()
+{
+    if (!mSettingsWatcher) {
+        return;
+    }
+
+    // Settings are saved by replacing the file, and the file may not exist
+    // yet, so watch its directory too and pick the file up again each time
+    const QString fileName = settingsFileName();
+    const QString dirName = QFileInfo(fileName).absolutePath();
+
+    if (!mSettingsWatcher->directories().contains(dirName) && QDir(dirName).exists()) {
+        mSettingsWatcher->addPath(dirName);
+    }
+    if (!mSettingsWatcher->files().contains(fileName) && QFile::exists(fileName)) {
+        mSettingsWatcher->addPath(fileName);
+    }
+
+    if (settingsKeySet()) {
+        trigger(QString::fromLatin1("settings in %1").arg(fileName));
+    }
+}
+
+QString PluginActivator::settingsFileName()
+{
+    return QSettings(QSettings::IniFormat, QSettings::UserScope,
+                     SettingsOrganization, SettingsApplication).fileName();
+}
+
+bool PluginActivator::settingsKeySet() const
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope,
+                       SettingsOrganization, SettingsApplication);
+
+    Q_FOREACH (const QString &key, mSettingsKeys) {
+        if (settings.contains(key)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void PluginActivator::trigger(const QString &reason)
+{
+    if (mTriggered) {
+        return;
+    }
+
+    mTriggered = true;
+    debug(logCategory) << "Activating plugin" << mPluginName << "on" << reason;
+
+    Q_EMIT triggered(mPluginName);
+}
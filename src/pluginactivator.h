@@ -0,0 +1,92 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef PLUGINACTIVATOR_H_
+#define PLUGINACTIVATOR_H_
+
+#include <QDBusMessage>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QStringList>
+
+#include "base-plugin.h"
+
+class QDBusPendingCallWatcher;
+class QDBusServiceWatcher;
+class QFileSystemWatcher;
+
+// Watches the activation triggers a plugin declares in its metadata, so its
+// init() can be deferred until one of them fires
+class PluginActivator : public QObject
+{
+    Q_OBJECT
+
+public:
+    PluginActivator(const QString &pluginName, const Contactsd::BasePlugin::MetaData &metaData,
+                    QObject *parent = 0);
+    ~PluginActivator();
+
+    static bool hasTriggers(const Contactsd::BasePlugin::MetaData &metaData);
+
+    QString pluginName() const;
+
+    // start watching; triggered() is emitted right away if a trigger
+    // condition already holds
+    void start();
+    // stop watching and release the plugin's object paths
+    void stop();
+    // forward the calls which arrived on the plugin's object paths before it
+    // was initialized to the objects it has registered since; the activator
+    // deletes itself once all replies are sent
+    void replayPendingCalls();
+
+    // used by the stubs registered on the object paths
+    void queueCall(const QDBusMessage &message);
+
+Q_SIGNALS:
+    void triggered(const QString &pluginName);
+
+private Q_SLOTS:
+    void onServiceRegistered(const QString &service);
+    void onSettingsChanged();
+    void onReplayFinished(QDBusPendingCallWatcher *watcher);
+
+private:
+    static QString settingsFileName();
+    bool settingsKeySet() const;
+    void trigger(const QString &reason);
+
+    QString mPluginName;
+    QStringList mServices;
+    QStringList mSettingsKeys;
+    QStringList mObjectPaths;
+    QDBusServiceWatcher *mServiceWatcher;
+    QFileSystemWatcher *mSettingsWatcher;
+    QList<QObject *> mStubs;
+    QList<QDBusMessage> mPendingCalls;
+    QHash<QDBusPendingCallWatcher *, QDBusMessage> mReplayedCalls;
+    bool mTriggered;
+};
+
+#endif // PLUGINACTIVATOR_H_
@@ -0,0 +1,149 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QSaveFile>
+
+#include "debug.h"
+#include "pluginmanifest.h"
+
+using namespace Contactsd;
+
+static DebugCategory logCategory("loader");
+
+static const qint32 ManifestVersion = 1;
+
+static QDataStream &operator<<(QDataStream &stream, const PluginManifest::Entry &entry)
+{
+    return stream << entry.name << entry.version << entry.size << entry.modified;
+}
+
+static QDataStream &operator>>(QDataStream &stream, PluginManifest::Entry &entry)
+{
+    return stream >> entry.name >> entry.version >> entry.size >> entry.modified;
+}
+
+static qint64 modificationTime(const QFileInfo &file)
+{
+    return file.lastModified().toMSecsSinceEpoch();
+}
+
+PluginManifest::PluginManifest(const QString &fileName)
+    : mFileName(fileName),
+      mModified(false)
+{
+    load();
+}
+
+void PluginManifest::load()
+{
+    QFile file(mFileName);
+    if (not file.open(QIODevice::ReadOnly)) {
+        debug(logCategory) << "No plugin manifest" << mFileName;
+        return;
+    }
+
+    QDataStream stream(&file);
+
+    qint32 version = 0;
+    stream >> version;
+    if (version != ManifestVersion) {
+        warning(logCategory) << "Ignoring plugin manifest" << mFileName << "with version" << version;
+        return;
+    }
+
+    stream >> mEntries;
+    if (stream.status() != QDataStream::Ok) {
+        warning(logCategory) << "Ignoring damaged plugin manifest" << mFileName;
+        mEntries.clear();
+    }
+}
+
+bool PluginManifest::lookup(const QFileInfo &file, Entry *entry) const
+{
+    QHash<QString, Entry>::const_iterator it = mEntries.constFind(file.absoluteFilePath());
+    if (it == mEntries.constEnd()) {
+        return false;
+    }
+
+    // Any change to the file makes us load it again
+    if (it->size != file.size() || it->modified != modificationTime(file)) {
+        return false;
+    }
+
+    *entry = *it;
+    return true;
+}
+
+void PluginManifest::insert(const QFileInfo &file, const QString &name, const QString &version)
+{
+    Entry entry;
+    entry.name = name;
+    entry.version = version;
+    entry.size = file.size();
+    entry.modified = modificationTime(file);
+
+    mEntries.insert(file.absoluteFilePath(), entry);
+    mModified = true;
+}
+
+void PluginManifest::insertNonPlugin(const QFileInfo &file)
+{
+    insert(file, QString(), QString());
+}
+
+bool PluginManifest::save()
+{
+    QHash<QString, Entry>::iterator it = mEntries.begin();
+    while (it != mEntries.end()) {
+        if (not QFile::exists(it.key())) {
+            it = mEntries.erase(it);
+            mModified = true;
+        } else {
+            ++it;
+        }
+    }
+
+    if (not mModified) {
+        return true;
+    }
+
+    QSaveFile file(mFileName);
+    if (not file.open(QIODevice::WriteOnly)) {
+        warning(logCategory) << "Could not open plugin manifest" << mFileName << "for writing:" << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream << ManifestVersion << mEntries;
+
+    if (not file.commit()) {
+        warning(logCategory) << "Could not write plugin manifest" << mFileName << ":" << file.errorString();
+        return false;
+    }
+
+    mModified = false;
+    return true;
+}
@@ -0,0 +1,66 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef PLUGINMANIFEST_H_
+#define PLUGINMANIFEST_H_
+
+#include <QFileInfo>
+#include <QHash>
+#include <QString>
+
+// Remembers what each file in the plugin directories contains, so that
+// files which are not wanted need not be loaded to find out
+class PluginManifest
+{
+public:
+    struct Entry
+    {
+        Entry() : size(0), modified(0) {}
+
+        // empty for files which are not contactsd plugins
+        QString name;
+        QString version;
+        qint64 size;
+        qint64 modified;
+    };
+
+    explicit PluginManifest(const QString &fileName);
+
+    // return true if the file is known and has not changed since
+    bool lookup(const QFileInfo &file, Entry *entry) const;
+
+    void insert(const QFileInfo &file, const QString &name, const QString &version);
+    void insertNonPlugin(const QFileInfo &file);
+
+    // write the manifest if it changed, dropping files which no longer exist
+    bool save();
+
+private:
+    void load();
+
+    QString mFileName;
+    QHash<QString, Entry> mEntries;
+    bool mModified;
+};
+
+#endif // PLUGINMANIFEST_H_
@@ -25,10 +25,13 @@ TARGET = contactsd
 
 VERSIONED_TARGET = $$TARGET-1.0
 
-QT += dbus
+QT += dbus concurrent
 QT += gui # for QDesktopServices
 
 system(qdbusxml2cpp -c ContactsImportProgressAdaptor -a contactsimportprogressadaptor.h:contactsimportprogressadaptor.cpp com.nokia.contacts.importprogress.xml)
+system(qdbusxml2cpp -c MetricsAdaptor -a metricsadaptor.h:metricsadaptor.cpp com.nokia.contactsd.metrics.xml)
+system(qdbusxml2cpp -c TraceAdaptor -a traceadaptor.h:traceadaptor.cpp com.nokia.contactsd.trace.xml)
+system(qdbusxml2cpp -c LoggingAdaptor -a loggingadaptor.h:loggingadaptor.cpp com.nokia.contactsd.logging.xml)
 
 INCLUDEPATH += $$TOP_SOURCEDIR/lib
 LIBS += -export-dynamic
@@ -38,7 +41,17 @@ HEADERS += contactsd.h \
     contactsdpluginloader.h \
     importstate.h \
     importstateconst.h \
+    pluginmanifest.h \
+    pluginactivator.h \
     contactsimportprogressadaptor.h \
+    config.h \
+    metrics.h \
+    metricsadaptor.h \
+    trace.h \
+    traceadaptor.h \
+    logwriter.h \
+    logcontrol.h \
+    loggingadaptor.h \
     debug.h \
     base-plugin.h
 
@@ -46,7 +59,17 @@ SOURCES += main.cpp \
     contactsd.cpp \
     contactsdpluginloader.cpp \
     importstate.cpp \
+    pluginmanifest.cpp \
+    pluginactivator.cpp \
     contactsimportprogressadaptor.cpp \
+    config.cpp \
+    metrics.cpp \
+    metricsadaptor.cpp \
+    trace.cpp \
+    traceadaptor.cpp \
+    logwriter.cpp \
+    logcontrol.cpp \
+    loggingadaptor.cpp \
     debug.cpp \
     base-plugin.cpp
 
@@ -56,10 +79,16 @@ DEFINES += CONTACTSD_PLUGINS_DIR=\\\"$$LIBDIR/$${VERSIONED_TARGET}/plugins\\\"
 
 headers.files = BasePlugin base-plugin.h \
     Debug debug.h \
+    Config config.h \
+    Metrics metrics.h \
+    Trace trace.h \
     ImportStateConst importstateconst.h
 headers.path = $$INCLUDEDIR/$${VERSIONED_TARGET}/Contactsd
 
-xml.files = com.nokia.contacts.importprogress.xml
+xml.files = com.nokia.contacts.importprogress.xml \
+    com.nokia.contactsd.metrics.xml \
+    com.nokia.contactsd.trace.xml \
+    com.nokia.contactsd.logging.xml
 xml.path = $$INCLUDEDIR/$${VERSIONED_TARGET}
 
 target.path = $$BINDIR
@@ -0,0 +1,209 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include <QAtomicPointer>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QtAlgorithms>
+
+#include "trace.h"
+#include "base-plugin.h"
+#include "debug.h"
+
+namespace Contactsd
+{
+
+namespace {
+
+struct Span
+{
+    const char *name;
+    qint64 start;
+    qint64 duration;
+    qint64 value;
+    quintptr thread;
+};
+
+bool startsBefore(const Span &a, const Span &b)
+{
+    return a.start < b.start;
+}
+
+} // namespace
+
+TraceRecorder::TraceRecorder()
+    : mSlots(new Slot[Capacity])
+{
+    mClock.start();
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    delete [] mSlots;
+}
+
+TraceRecorder *TraceRecorder::instance()
+{
+    static QAtomicPointer<TraceRecorder> recorder;
+    static QMutex mutex;
+
+    if (TraceRecorder *r = recorder.loadAcquire()) {
+        return r;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    if (!recorder.load()) {
+        TraceRecorder *r = new TraceRecorder;
+
+        // D-Bus calls must be delivered to the main thread
+        if (QCoreApplication::instance()) {
+            r->moveToThread(QCoreApplication::instance()->thread());
+        }
+
+        recorder.storeRelease(r);
+    }
+
+    return recorder.load();
+}
+
+void TraceRecorder::record(const char *name, qint64 start, qint64 end, qint64 value)
+{
+    const quint32 index = mNext.fetchAndAddRelaxed(1);
+    Slot &slot = mSlots[index % Capacity];
+
+    slot.sequence.storeRelease(0);
+    slot.name = name;
+    slot.start = start;
+    slot.duration = end - start;
+    slot.value = value;
+    slot.thread = quintptr(QThread::currentThreadId());
+    slot.sequence.storeRelease(index + 1);
+}
+
+const char *TraceRecorder::intern(const QString &name)
+{
+    QMutexLocker locker(&mNamesMutex);
+
+    QHash<QString, QByteArray>::const_iterator it = mNames.constFind(name);
+    if (it == mNames.constEnd()) {
+        it = mNames.insert(name, name.toUtf8());
+    }
+
+    // the byte arrays are never modified, so their data stays in place
+    return it.value().constData();
+}
+
+bool TraceRecorder::dump(const QString &fileName) const
+{
+    QList<Span> spans;
+
+    for (int i = 0; i < Capacity; ++i) {
+        const Slot &slot = mSlots[i];
+        const quint32 sequence = slot.sequence.loadAcquire();
+
+        if (sequence == 0) {
+            continue;
+        }
+
+        Span span;
+        span.name = slot.name;
+        span.start = slot.start;
+        span.duration = slot.duration;
+        span.value = slot.value;
+        span.thread = slot.thread;
+
+        // skip the slot if it got overwritten while we read it
+        if (slot.sequence.loadAcquire() != sequence) {
+            continue;
+        }
+
+        spans << span;
+    }
+
+    qSort(spans.begin(), spans.end(), startsBefore);
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QHash<quintptr, int> threadIds;
+    QJsonArray events;
+
+    Q_FOREACH (const Span &span, spans) {
+        QHash<quintptr, int>::const_iterator thread = threadIds.constFind(span.thread);
+        if (thread == threadIds.constEnd()) {
+            thread = threadIds.insert(span.thread, threadIds.count() + 1);
+        }
+
+        QJsonObject args;
+        args.insert(QLatin1String("value"), double(span.value));
+
+        QJsonObject event;
+        event.insert(QLatin1String("name"), QLatin1String(span.name));
+        event.insert(QLatin1String("ph"), QLatin1String("X"));
+        // microseconds
+        event.insert(QLatin1String("ts"), span.start / 1000.0);
+        event.insert(QLatin1String("dur"), span.duration / 1000.0);
+        event.insert(QLatin1String("pid"), double(pid));
+        event.insert(QLatin1String("tid"), thread.value());
+        event.insert(QLatin1String("args"), args);
+        events.append(event);
+    }
+
+    QJsonObject trace;
+    trace.insert(QLatin1String("traceEvents"), events);
+    trace.insert(QLatin1String("displayTimeUnit"), QLatin1String("ms"));
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        warning() << "Could not open trace file" << fileName << file.errorString();
+        return false;
+    }
+
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+
+    if (!file.commit()) {
+        warning() << "Could not write trace file" << fileName << file.errorString();
+        return false;
+    }
+
+    debug() << "Wrote" << spans.count() << "trace events to" << fileName;
+
+    return true;
+}
+
+QString TraceRecorder::dumpTrace()
+{
+    const QString fileName = BasePlugin::cacheFileName(QString::fromLatin1("trace-%1.json")
+            .arg(QDateTime::currentDateTime().toString(QLatin1String("yyyyMMdd-hhmmss"))));
+
+    return dump(fileName) ? fileName : QString();
+}
+
+} // Contactsd
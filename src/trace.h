@@ -0,0 +1,117 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef CONTACTSD_TRACE_H
+#define CONTACTSD_TRACE_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QHash>
+#include <QString>
+
+namespace Contactsd
+{
+
+// Keeps the most recent spans of work in a fixed ring buffer, and writes them
+// as a Chrome trace (chrome://tracing, Perfetto) on demand: through the
+// com.nokia.contactsd.trace D-Bus interface, or by sending SIGUSR1 to the
+// daemon. Recording is lock free, and can be done from any thread.
+class TraceRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    static TraceRecorder *instance();
+
+    // monotonic timestamp, in nanoseconds
+    qint64 now() const { return mClock.nsecsElapsed(); }
+
+    // \param name - a string literal, it is not copied
+    // \param value - shown as the "value" argument of the span
+    void record(const char *name, qint64 start, qint64 end, qint64 value = 0);
+
+    // a span name which lives as long as the recorder, for names which are
+    // not literals
+    const char *intern(const QString &name);
+
+    bool dump(const QString &fileName) const;
+
+public Q_SLOTS:
+    // dump the trace into the cache dir, and return the file name
+    QString dumpTrace();
+
+private:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    struct Slot
+    {
+        // index of the event + 1, or 0 while it is being written
+        QAtomicInteger<quint32> sequence;
+        const char *name;
+        qint64 start;
+        qint64 duration;
+        qint64 value;
+        quintptr thread;
+    };
+
+    enum { Capacity = 4096 };
+
+    QElapsedTimer mClock;
+    Slot *mSlots;
+    QAtomicInteger<quint32> mNext;
+    QMutex mNamesMutex;
+    QHash<QString, QByteArray> mNames;
+};
+
+// Records the lifetime of the scope as a span
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, qint64 value = 0)
+        : mName(name)
+        , mValue(value)
+        , mStart(TraceRecorder::instance()->now())
+    {
+    }
+
+    ~TraceSpan()
+    {
+        TraceRecorder *recorder = TraceRecorder::instance();
+        recorder->record(mName, mStart, recorder->now(), mValue);
+    }
+
+    void setValue(qint64 value) { mValue = value; }
+
+private:
+    const char *mName;
+    qint64 mValue;
+    qint64 mStart;
+};
+
+} // Contactsd
+
+#endif // CONTACTSD_TRACE_H
@@ -25,9 +25,9 @@ PACKAGENAME = contactsd
 TEMPLATE = subdirs
 CONFIG += ordered
 
-SUBDIRS += libtelepathy ut_birthdayplugin ut_telepathyplugin
+SUBDIRS += libtelepathy ut_contactsd ut_birthdayplugin ut_telepathyplugin ut_telepathyinternals
 
-UNIT_TESTS += ut_birthdayplugin ut_telepathyplugin
+UNIT_TESTS += ut_contactsd ut_birthdayplugin ut_telepathyplugin ut_telepathyinternals
 
 testxml.target = tests.xml
 testxml.commands = sh $$PWD/mktests.sh $$UNIT_TESTS >$@ || rm -f $@
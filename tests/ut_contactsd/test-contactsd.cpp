@@ -23,20 +23,40 @@
 
 #include "test-contactsd.h"
 #include "importstate.h"
+#include "pluginmanifest.h"
+#include "pluginactivator.h"
+#include "importstateconst.h"
+#include "logwriter.h"
+#include "logcontrol.h"
+#include "debug.h"
+#include "config.h"
+#include "metrics.h"
+#include "trace.h"
 #include <test-common.h>
 #include <QtDBus>
 #include <QByteArray>
+#include <QtConcurrentRun>
 
 const QString telepathyString("telepathy");
 
+void TestContactsd::initTestCase()
+{
+    // The wrapper script points us to the telepathy and test plugins
+    mPluginsDirs = qgetenv("CONTACTSD_PLUGINS_DIRS");
+    if (mPluginsDirs.isEmpty()) {
+        mPluginsDirs = CONTACTSD_PLUGINS_DIR ":" UT_CONTACTSD_PLUGINS_DIR;
+    }
+}
+
 void TestContactsd::init()
 {
+    qputenv("CONTACTSD_PLUGINS_DIRS", mPluginsDirs);
     mLoader = new ContactsdPluginLoader();
 }
 
 void TestContactsd::envTest()
 {
-    qputenv("CONTACTSD_PLUGINS_DIRS", "/usr/lib/contactsd-1.0/plugins/:/usr/lib/contactsd-1.0/plgins/");
+    qputenv("CONTACTSD_PLUGINS_DIRS", mPluginsDirs + ":/usr/lib/contactsd-1.0/plgins/");
     mLoader->loadPlugins(QStringList());
     QVERIFY2(mLoader->loadedPlugins().count() > 0, "failed to load plugins from evn variable");
     qDebug() << mLoader->loadedPlugins();
@@ -55,7 +75,7 @@ void TestContactsd::importNonPlugin()
 {
     /* This is just a coverage test */
     const QString path(QDir::currentPath() + "/data/");
-    qputenv("CONTACTSD_PLUGINS_DIRS", path.toAscii());
+    qputenv("CONTACTSD_PLUGINS_DIRS", path.toLatin1());
     mLoader->loadPlugins(QStringList());
     QStringList pluginList = mLoader->loadedPlugins();
     QCOMPARE(pluginList.size(), 0);
@@ -122,6 +142,72 @@ void TestContactsd::testLoadPlugins()
                 .arg(telepathyString).toLatin1());
 }
 
+void TestContactsd::testPluginsLoaded()
+{
+    const QString dbusPlugin("dbusplugin");
+
+    // only the requested plugin gets initialized
+    QSignalSpy spy(mLoader, SIGNAL(pluginsLoaded()));
+    mLoader->loadPlugins(QStringList() << dbusPlugin);
+
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(mLoader->loadedPlugins(), QStringList() << dbusPlugin);
+    QVERIFY(mLoader->pluginLoadTimes().contains(dbusPlugin));
+    QVERIFY(mLoader->pluginInitTimes().contains(dbusPlugin));
+
+    // nothing new to load still completes
+    mLoader->loadPlugins(QStringList() << dbusPlugin);
+    QCOMPARE(spy.count(), 2);
+}
+
+class OrderPlugin : public Contactsd::BasePlugin
+{
+public:
+    OrderPlugin(const QString &name, const QStringList &dependencies = QStringList())
+    {
+        mMetaData[metaDataKeyName] = name;
+        mMetaData[metaDataKeyDependencies] = dependencies;
+    }
+
+    void init() {}
+    MetaData metaData() { return mMetaData; }
+
+private:
+    MetaData mMetaData;
+};
+
+static QStringList pluginNames(const QList<Contactsd::BasePlugin *> &plugins)
+{
+    QStringList names;
+    Q_FOREACH (Contactsd::BasePlugin *plugin, plugins) {
+        names << plugin->metaData().value(Contactsd::BasePlugin::metaDataKeyName).toString();
+    }
+    return names;
+}
+
+void TestContactsd::testPluginInitOrder()
+{
+    OrderPlugin a("a", QStringList() << "c");
+    OrderPlugin b("b", QStringList() << "a" << "missing");
+    OrderPlugin c("c");
+
+    QList<Contactsd::BasePlugin *> plugins;
+    plugins << &a << &b << &c;
+
+    // dependencies first, plugins which aren't loaded don't hold anything up
+    QCOMPARE(pluginNames(mLoader->initOrder(plugins)), QStringList() << "c" << "a" << "b");
+
+    // all plugins of a cycle still get initialized
+    OrderPlugin x("x", QStringList() << "y");
+    OrderPlugin y("y", QStringList() << "x");
+    plugins.clear();
+    plugins << &x << &y << &c;
+
+    const QStringList names = pluginNames(mLoader->initOrder(plugins));
+    QCOMPARE(names.count(), 3);
+    QCOMPARE(names.first(), QString("c"));
+}
+
 void TestContactsd::testImportState()
 {
     ImportState state;
@@ -180,6 +266,655 @@ void TestContactsd::testImportState()
     QCOMPARE(state.contactsMerged(), 0);
 }
 
+void TestContactsd::testImportStateJournal()
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope,
+                       Contactsd::SettingsOrganization, Contactsd::SettingsApplication);
+    const QString journalFileName(settings.fileName() + ".journal");
+
+    {
+        ImportState state;
+        state.addImportingAccount("gtalk", "journal-account1");
+        state.addImportingAccount("msn", "journal-account2");
+        state.removeImportingAccount("gtalk", "journal-account1", 1, 0, 0);
+
+        // changes are journaled right away, but written in one batch
+        QVERIFY(QFileInfo(journalFileName).size() > 0);
+        state.flush();
+        QVERIFY(not QFile::exists(journalFileName) || QFileInfo(journalFileName).size() == 0);
+
+        settings.sync();
+        QCOMPARE(settings.value("journal-account1").toInt(), int(Contactsd::Imported));
+        QCOMPARE(settings.value("journal-account2").toInt(), int(Contactsd::Importing));
+    }
+
+    // a journal left behind by a crash is replayed, skipping invalid lines
+    // and the partial line being written when it crashed
+    QFile journal(journalFileName);
+    QVERIFY(journal.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    journal.write(QByteArray::number(Contactsd::Imported) + " journal-account2\n");
+    journal.write("garbage\n");
+    journal.write(QByteArray::number(Contactsd::Finished) + " journal-account1\n");
+    journal.write(QByteArray::number(Contactsd::Importing) + " journal-acc");
+    journal.close();
+
+    {
+        ImportState state;
+        QVERIFY(not QFile::exists(journalFileName));
+    }
+
+    settings.sync();
+    QCOMPARE(settings.value("journal-account2").toInt(), int(Contactsd::Imported));
+    QCOMPARE(settings.value("journal-account1").toInt(), int(Contactsd::Finished));
+    QVERIFY(not settings.contains("garbage"));
+    QVERIFY(not settings.contains("journal-acc"));
+
+    // an empty journal is removed
+    QVERIFY(journal.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    journal.close();
+    {
+        ImportState state;
+        QVERIFY(not QFile::exists(journalFileName));
+    }
+
+    settings.remove("journal-account1");
+    settings.remove("journal-account2");
+}
+
+void TestContactsd::testPluginManifest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString manifestFileName(dir.path() + "/manifest");
+    const QString pluginFileName(dir.path() + "/libplugin.so");
+    const QString otherFileName(dir.path() + "/README");
+
+    QFile pluginFile(pluginFileName);
+    QVERIFY(pluginFile.open(QIODevice::WriteOnly));
+    pluginFile.write("plugin");
+    pluginFile.close();
+
+    QFile otherFile(otherFileName);
+    QVERIFY(otherFile.open(QIODevice::WriteOnly));
+    otherFile.close();
+
+    {
+        PluginManifest manifest(manifestFileName);
+        PluginManifest::Entry entry;
+        QVERIFY(not manifest.lookup(QFileInfo(pluginFileName), &entry));
+
+        manifest.insert(QFileInfo(pluginFileName), "telepathy", "0.2");
+        manifest.insertNonPlugin(QFileInfo(otherFileName));
+        QVERIFY(manifest.save());
+    }
+
+    PluginManifest::Entry entry;
+    {
+        PluginManifest manifest(manifestFileName);
+        QVERIFY(manifest.lookup(QFileInfo(pluginFileName), &entry));
+        QCOMPARE(entry.name, QString("telepathy"));
+        QCOMPARE(entry.version, QString("0.2"));
+
+        QVERIFY(manifest.lookup(QFileInfo(otherFileName), &entry));
+        QVERIFY(entry.name.isEmpty());
+    }
+
+    // A changed file has to be loaded again, a removed one is forgotten
+    QVERIFY(pluginFile.open(QIODevice::Append));
+    pluginFile.write("updated");
+    pluginFile.close();
+    QVERIFY(QFile::remove(otherFileName));
+
+    PluginManifest manifest(manifestFileName);
+    QVERIFY(not manifest.lookup(QFileInfo(pluginFileName), &entry));
+    QVERIFY(manifest.save());
+
+    QVERIFY(not PluginManifest(manifestFileName).lookup(QFileInfo(otherFileName), &entry));
+
+    // A damaged manifest is ignored
+    QFile manifestFile(manifestFileName);
+    QVERIFY(manifestFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    manifestFile.write("garbage");
+    manifestFile.close();
+    QVERIFY(not PluginManifest(manifestFileName).lookup(QFileInfo(pluginFileName), &entry));
+
+    // The loader records plugins and other files it has loaded
+    mLoader->loadPlugins(QStringList() << "dbusplugin");
+
+    PluginManifest loaderManifest(Contactsd::BasePlugin::cacheFileName("plugin-manifest"));
+    int pluginFiles = 0;
+    Q_FOREACH (const QString &pluginsDir, QString::fromLocal8Bit(mPluginsDirs).split(':')) {
+        const QFileInfo dbusPlugin(QDir(pluginsDir).filePath("libdbusplugin.so"));
+        if (dbusPlugin.exists()) {
+            QVERIFY(loaderManifest.lookup(dbusPlugin, &entry));
+            QCOMPARE(entry.name, QString("dbusplugin"));
+            ++pluginFiles;
+        }
+
+        const QFileInfo fakePlugin(QDir(pluginsDir).filePath("libfakeplugin.so"));
+        if (fakePlugin.exists()) {
+            QVERIFY(loaderManifest.lookup(fakePlugin, &entry));
+            QVERIFY(entry.name.isEmpty());
+            ++pluginFiles;
+        }
+    }
+    QCOMPARE(pluginFiles, 2);
+}
+
+void TestContactsd::testPluginActivator()
+{
+    const QString settingsKey("ut_contactsd/activate");
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope,
+                       Contactsd::SettingsOrganization, Contactsd::SettingsApplication);
+    settings.remove(settingsKey);
+    settings.sync();
+
+    Contactsd::BasePlugin::MetaData metaData;
+    QVERIFY(not PluginActivator::hasTriggers(metaData));
+
+    metaData[Contactsd::BasePlugin::metaDataKeyActivationSettings] = QStringList() << settingsKey;
+    metaData[Contactsd::BasePlugin::metaDataKeyActivationObjectPaths] = QStringList() << "/ut_contactsd";
+    QVERIFY(PluginActivator::hasTriggers(metaData));
+
+    {
+        PluginActivator activator("lazy", metaData);
+        QSignalSpy spy(&activator, SIGNAL(triggered(QString)));
+        activator.start();
+        QCOMPARE(spy.count(), 0);
+
+        settings.setValue(settingsKey, true);
+        settings.sync();
+
+        QTRY_COMPARE(spy.count(), 1);
+        QCOMPARE(spy.at(0).at(0).toString(), QString("lazy"));
+    }
+
+    settings.remove(settingsKey);
+    settings.sync();
+
+    // A call to the object path activates the plugin, and gets replayed once
+    // it has been initialized. Calls over the local loop can't wait for the
+    // plugin, so call from another connection as clients do.
+    PluginActivator *activator = new PluginActivator("lazy", metaData);
+    QSignalSpy spy(activator, SIGNAL(triggered(QString)));
+    QSignalSpy destroyedSpy(activator, SIGNAL(destroyed()));
+    activator->start();
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QDBusConnection client = QDBusConnection::connectToBus(QDBusConnection::SessionBus, "ut_contactsd-client");
+    QVERIFY(client.isConnected());
+
+    // A service appearing on the bus activates the plugin
+    {
+        const QString service("com.nokia.contactsd.ut_activation");
+
+        Contactsd::BasePlugin::MetaData serviceMetaData;
+        serviceMetaData[Contactsd::BasePlugin::metaDataKeyActivationServices] = QStringList() << service;
+
+        PluginActivator serviceActivator("lazy", serviceMetaData);
+        QSignalSpy serviceSpy(&serviceActivator, SIGNAL(triggered(QString)));
+        serviceActivator.start();
+        QCOMPARE(serviceSpy.count(), 0);
+
+        QVERIFY(client.registerService(service));
+        QTRY_COMPARE(serviceSpy.count(), 1);
+        client.unregisterService(service);
+    }
+
+    QDBusMessage call = QDBusMessage::createMethodCall(bus.baseService(), "/ut_contactsd",
+            QString(), "hasActiveImports");
+    QDBusPendingCallWatcher watcher(client.asyncCall(call));
+
+    QTRY_COMPARE(spy.count(), 1);
+    activator->stop();
+    QVERIFY(bus.registerObject("/ut_contactsd", mLoader, QDBusConnection::ExportAllSlots));
+    activator->replayPendingCalls();
+
+    QTRY_VERIFY(watcher.isFinished());
+    QVERIFY2(not watcher.isError(), watcher.error().message().toLatin1());
+    QDBusReply<QStringList> reply(watcher.reply());
+    QCOMPARE(reply.value().count(), 0);
+    QTRY_COMPARE(destroyedSpy.count(), 1);
+
+    bus.unregisterObject("/ut_contactsd");
+}
+
+static void writeLogMessages(LogWriter *writer, const QByteArray &prefix)
+{
+    for (int i = 0; i < 100; ++i) {
+        writer->write(prefix + QByteArray::number(i));
+    }
+}
+
+void TestContactsd::testLogWriter()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString logFileName(dir.path() + "/log");
+
+    LogWriter writer(false);
+    QVERIFY(writer.setLogFile(logFileName, 0, 0));
+    writer.start();
+
+    QList<QFuture<void> > threads;
+    for (int i = 0; i < 4; ++i) {
+        threads << QtConcurrent::run(writeLogMessages, &writer, "thread" + QByteArray::number(i) + ":");
+    }
+    writeLogMessages(&writer, "main:");
+
+    // flushing writes out what this thread logged right away
+    writer.flush();
+    QFile flushedLog(logFileName);
+    QVERIFY(flushedLog.open(QIODevice::ReadOnly));
+    QVERIFY(flushedLog.readAll().contains("main:99\n"));
+    flushedLog.close();
+
+    // too big for any buffer
+    writer.write(QByteArray(128 * 1024, 'x'));
+    QCOMPARE(writer.droppedMessages(), 1);
+
+    Q_FOREACH (QFuture<void> thread, threads) {
+        thread.waitForFinished();
+    }
+    writer.stop();
+
+    QFile log(logFileName);
+    QVERIFY(log.open(QIODevice::ReadOnly));
+    const QList<QByteArray> lines = log.readAll().split('\n');
+
+    // 5 * 100 messages, the dropped message notice and the final newline
+    QCOMPARE(lines.count(), 502);
+
+    // the messages of each thread keep their order
+    QList<QByteArray> mainLines;
+    int dropNotices = 0;
+    Q_FOREACH (const QByteArray &line, lines) {
+        if (line.startsWith("main:")) {
+            mainLines << line;
+        } else if (line.contains("1 log messages dropped")) {
+            ++dropNotices;
+        }
+    }
+    QCOMPARE(dropNotices, 1);
+    QCOMPARE(mainLines.count(), 100);
+    for (int i = 0; i < mainLines.count(); ++i) {
+        QCOMPARE(mainLines.at(i), "main:" + QByteArray::number(i));
+    }
+}
+
+static QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+// the 40 character log lines of testLogRotation, from first to last
+static QByteArray logLines(char first, char last)
+{
+    QByteArray lines;
+    for (char c = first; c <= last; ++c) {
+        lines += QByteArray(40, c) + '\n';
+    }
+    return lines;
+}
+
+void TestContactsd::testLogRotation()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString logFileName(dir.path() + "/log");
+
+    QFile previousLog(logFileName);
+    QVERIFY(previousLog.open(QIODevice::WriteOnly));
+    previousLog.write("previous run\n");
+    previousLog.close();
+
+    {
+        LogWriter writer(false);
+        QVERIFY(writer.setLogFile(logFileName, 100, 2));
+
+        // the log of the previous run is kept
+        QCOMPARE(readFile(logFileName + ".1"), QByteArray("previous run\n"));
+        QCOMPARE(QFile(logFileName).size(), Q_INT64_C(0));
+
+        for (int i = 0; i < 10; ++i) {
+            writer.write(QByteArray(40, 'a' + i));
+            writer.flush();
+        }
+    }
+
+    QVERIFY(QFile::exists(logFileName));
+    QVERIFY(QFile::exists(logFileName + ".1"));
+    QVERIFY(QFile::exists(logFileName + ".2"));
+    QVERIFY(not QFile::exists(logFileName + ".3"));
+
+    // two messages fit in a file, older files shift up until they expire
+    // along with the log of the previous run
+    QCOMPARE(readFile(logFileName), logLines('i', 'j'));
+    QCOMPARE(readFile(logFileName + ".1"), logLines('g', 'h'));
+    QCOMPARE(readFile(logFileName + ".2"), logLines('e', 'f'));
+
+    // without rotated files to keep, full logs are just removed
+    const QString unkeptFileName(dir.path() + "/unkept");
+    QFile unkeptLog(unkeptFileName);
+    QVERIFY(unkeptLog.open(QIODevice::WriteOnly));
+    unkeptLog.write("previous run\n");
+    unkeptLog.close();
+
+    {
+        LogWriter writer(false);
+        QVERIFY(writer.setLogFile(unkeptFileName, 100, 0));
+        QCOMPARE(QFile(unkeptFileName).size(), Q_INT64_C(0));
+
+        for (int i = 0; i < 3; ++i) {
+            writer.write(QByteArray(40, 'a' + i));
+            writer.flush();
+        }
+    }
+
+    QCOMPARE(readFile(unkeptFileName), logLines('c', 'c'));
+    QVERIFY(not QFile::exists(unkeptFileName + ".1"));
+}
+
+static QStringList capturedMessages;
+
+static void captureMessage(QtMsgType, const QMessageLogContext &, const QString &message)
+{
+    capturedMessages << message;
+}
+
+void TestContactsd::testDebugCategory()
+{
+    using Contactsd::DebugCategory;
+
+    Contactsd::enableDebug(false);
+    Contactsd::enableWarnings(true);
+
+    DebugCategory category("test-category");
+    QVERIFY(!category.isDebugEnabled());
+    QVERIFY(category.isWarningEnabled());
+    QVERIFY(DebugCategory::categoryNames().contains("test-category"));
+
+    LogControl control;
+    QVERIFY(control.setLogLevel("test-category", "debug"));
+    QVERIFY(category.isDebugEnabled());
+    QCOMPARE(control.logLevels().value("test-category").toString(), QString("debug"));
+
+    // same name, same level
+    DebugCategory other("test-category");
+    QVERIFY(other.isDebugEnabled());
+
+    // explicit levels are kept when the global switches change
+    Contactsd::enableWarnings(false);
+    QVERIFY(category.isDebugEnabled());
+
+    QVERIFY(control.setLogLevel("test-category", "default"));
+    QVERIFY(!category.isWarningEnabled());
+    QVERIFY(!other.isWarningEnabled());
+    Contactsd::enableWarnings(true);
+    QVERIFY(category.isWarningEnabled());
+    QVERIFY(!category.isDebugEnabled());
+
+    QVERIFY(control.setLogLevel("test-category", "silent"));
+    QVERIFY(!other.isWarningEnabled());
+
+    QVERIFY(!control.setLogLevel("test-category", "verbose"));
+    QVERIFY(!control.setLogLevel("no-such-category", "debug"));
+
+    // messages pass the category's level, not the global one
+    QVERIFY(control.setLogLevel("test-category", "debug"));
+    capturedMessages.clear();
+    QtMessageHandler previousHandler = qInstallMessageHandler(captureMessage);
+    Contactsd::debug(category) << "category message";
+    Contactsd::debug() << "global message";
+    QVERIFY(control.setLogLevel("test-category", "silent"));
+    Contactsd::warning(category) << "silenced message";
+    qInstallMessageHandler(previousHandler);
+    QCOMPARE(capturedMessages.count(), 1);
+    QVERIFY(capturedMessages.first().contains("test-category"));
+    QVERIFY(capturedMessages.first().endsWith("category message"));
+
+    QVERIFY(control.setLogLevel("test-category", "warning"));
+    QCOMPARE(control.logLevels().value("test-category").toString(), QString("warning"));
+
+    // a category is listed while any instance of it lives
+    {
+        DebugCategory scoped("test-scoped-category");
+        QVERIFY(control.logLevels().contains("test-scoped-category"));
+    }
+    QVERIFY(!control.logLevels().contains("test-scoped-category"));
+    QVERIFY(!control.setLogLevel("test-scoped-category", "debug"));
+
+    // the running daemon lists its categories on D-Bus
+    QDBusInterface iface("com.nokia.contactsd", "/logging", "com.nokia.contactsd.logging");
+    QDBusReply<QVariantMap> levelsReply = iface.call("logLevels");
+    QVERIFY2(levelsReply.isValid(), qPrintable(levelsReply.error().message()));
+    QVERIFY(levelsReply.value().contains("loader"));
+    QDBusReply<bool> setReply = iface.call("setLogLevel", QString("loader"), QString("debug"));
+    QVERIFY(setReply.isValid() && setReply.value());
+    levelsReply = iface.call("logLevels");
+    QCOMPARE(levelsReply.value().value("loader").toString(), QString("debug"));
+    QVERIFY(iface.call("setLogLevel", QString("loader"), QString("default")).type() == QDBusMessage::ReplyMessage);
+}
+
+static void addToCounter(Contactsd::Counter *counter)
+{
+    for (int i = 0; i < 1000; ++i) {
+        counter->add();
+    }
+}
+
+void TestContactsd::testMetrics()
+{
+    Contactsd::Metrics *metrics = Contactsd::Metrics::instance();
+
+    Contactsd::Counter *counter = metrics->counter("test.counter");
+    QCOMPARE(metrics->counter("test.counter"), counter);
+    counter->add();
+    counter->add(4);
+    QCOMPARE(metrics->counters().value("test.counter").toLongLong(), Q_INT64_C(5));
+
+    Contactsd::Gauge *gauge = metrics->gauge("test.gauge");
+    gauge->set(10);
+    gauge->add(-3);
+    QCOMPARE(metrics->gauges().value("test.gauge").toLongLong(), Q_INT64_C(7));
+
+    Contactsd::Histogram *histogram = metrics->histogram("test.histogram");
+    histogram->record(0);
+    histogram->record(3);
+    histogram->record(1000000);
+
+    const QVariantMap values = metrics->histograms().value("test.histogram").toMap();
+    QCOMPARE(values.value("count").toLongLong(), Q_INT64_C(3));
+    QCOMPARE(values.value("sum").toLongLong(), Q_INT64_C(1000003));
+
+    const QVariantList bounds = values.value("bounds").toList();
+    const QVariantList buckets = values.value("buckets").toList();
+    QCOMPARE(buckets.count(), bounds.count() + 1);
+    QCOMPARE(buckets.at(0).toLongLong(), Q_INT64_C(1)); // <= 1 ms
+    QCOMPARE(buckets.at(2).toLongLong(), Q_INT64_C(1)); // <= 5 ms
+    QCOMPARE(buckets.last().toLongLong(), Q_INT64_C(1));
+
+    const QList<qint64> bucketBounds = Contactsd::Histogram::bucketBounds();
+    QCOMPARE(bounds.count(), bucketBounds.count());
+    for (int i = 0; i < bounds.count(); ++i) {
+        QCOMPARE(bounds.at(i).toLongLong(), bucketBounds.at(i));
+        if (i > 0) {
+            QVERIFY(bucketBounds.at(i) > bucketBounds.at(i - 1));
+        }
+    }
+
+    // counters may be updated from any thread
+    Contactsd::Counter *threadCounter = metrics->counter("test.thread-counter");
+    QList<QFuture<void> > threads;
+    for (int i = 0; i < 4; ++i) {
+        threads << QtConcurrent::run(addToCounter, threadCounter);
+    }
+    Q_FOREACH (QFuture<void> thread, threads) {
+        thread.waitForFinished();
+    }
+    QCOMPARE(threadCounter->value(), Q_INT64_C(4000));
+
+    // a timer records its scope exactly once
+    Contactsd::Histogram *timed = metrics->histogram("test.timed");
+    {
+        Contactsd::HistogramTimer timer(timed);
+        QTest::qWait(20);
+    }
+    QCOMPARE(timed->count(), Q_INT64_C(1));
+    QVERIFY(timed->sum() >= 20);
+    QCOMPARE(timed->bucketCounts().at(0), Q_INT64_C(0));
+
+    // the running daemon exports its metrics on D-Bus
+    QDBusInterface iface("com.nokia.contactsd", "/metrics", "com.nokia.contactsd.metrics");
+    QDBusReply<QVariantMap> countersReply = iface.call("counters");
+    QVERIFY2(countersReply.isValid(), qPrintable(countersReply.error().message()));
+    QDBusReply<QVariantMap> gaugesReply = iface.call("gauges");
+    QVERIFY2(gaugesReply.isValid(), qPrintable(gaugesReply.error().message()));
+}
+
+void TestContactsd::testTraceRecorder()
+{
+    Contactsd::TraceRecorder *recorder = Contactsd::TraceRecorder::instance();
+
+    const qint64 start = recorder->now();
+    {
+        Contactsd::TraceSpan span("test.outer", 42);
+        Contactsd::TraceSpan inner(recorder->intern("test.inner"));
+    }
+    QVERIFY(recorder->now() >= start);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName(dir.path() + "/trace.json");
+    QVERIFY(recorder->dump(fileName));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QJsonArray events = QJsonDocument::fromJson(file.readAll()).object().value("traceEvents").toArray();
+
+    int outer = -1, inner = -1;
+    for (int i = 0; i < events.count(); ++i) {
+        const QJsonObject event = events.at(i).toObject();
+        QCOMPARE(event.value("ph").toString(), QString("X"));
+
+        if (event.value("name").toString() == "test.outer") {
+            outer = i;
+            QCOMPARE(event.value("args").toObject().value("value").toDouble(), 42.0);
+        } else if (event.value("name").toString() == "test.inner") {
+            inner = i;
+        }
+    }
+
+    // events are ordered by their start
+    QVERIFY(outer >= 0);
+    QVERIFY(inner > outer);
+    file.close();
+
+    // interned names stay the same for the lifetime of the recorder
+    QCOMPARE(recorder->intern("test.inner"), recorder->intern(QString("test.") + "inner"));
+
+    // the ring buffer keeps only the most recent 4096 spans
+    const qint64 now = recorder->now();
+    for (int i = 0; i < 4096 + 10; ++i) {
+        recorder->record("test.wrap", now + i, now + i + 1, i);
+    }
+    QVERIFY(recorder->dump(fileName));
+
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QJsonArray wrapped = QJsonDocument::fromJson(file.readAll()).object().value("traceEvents").toArray();
+    QCOMPARE(wrapped.count(), 4096);
+    QCOMPARE(wrapped.first().toObject().value("args").toObject().value("value").toDouble(), 10.0);
+    QCOMPARE(wrapped.last().toObject().value("args").toObject().value("value").toDouble(), 4105.0);
+    QCOMPARE(wrapped.first().toObject().value("dur").toDouble(), 0.001);
+
+    // the running daemon dumps its trace on request
+    QDBusInterface iface("com.nokia.contactsd", "/trace", "com.nokia.contactsd.trace");
+    QDBusReply<QString> dumpReply = iface.call("dumpTrace");
+    QVERIFY2(dumpReply.isValid(), qPrintable(dumpReply.error().message()));
+    QVERIFY(QFile::exists(dumpReply.value()));
+}
+
+void TestContactsd::testConfig()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString fileName(dir.path() + "/contactsd.conf");
+    {
+        QSettings settings(fileName, QSettings::IniFormat);
+        settings.setValue("test/batch-size", 10);
+        settings.setValue("test/timeout", "soon");
+        settings.setValue("test/enabled", "false");
+        settings.setValue("test/verbose", "maybe");
+    }
+
+    Contactsd::Config *config = Contactsd::Config::instance();
+    config->setFileName(fileName);
+    QCOMPARE(config->fileName(), fileName);
+
+    QCOMPARE(config->intValue("test/batch-size", 5), 10);
+    QCOMPARE(config->intValue("test/batch-size", 5, 20), 5);
+    QCOMPARE(config->intValue("test/timeout", 150), 150);
+    QCOMPARE(config->intValue("test/missing", 42), 42);
+    QCOMPARE(config->boolValue("test/enabled", true), false);
+    QCOMPARE(config->boolValue("test/verbose", true), true);
+    QCOMPARE(config->boolValue("test/verbose", false), false);
+
+    // applied values are exported as metrics, also when falling back
+    QCOMPARE(Contactsd::Metrics::instance()->gauges().value("config.test.timeout").toLongLong(),
+             Q_INT64_C(150));
+    QCOMPARE(config->intValue("test/batch-size", 5), 10);
+    QCOMPARE(Contactsd::Metrics::instance()->gauges().value("config.test.batch-size").toLongLong(),
+             Q_INT64_C(10));
+
+    // an invalid value is reported once, until the next reload
+    Contactsd::enableWarnings(true);
+    capturedMessages.clear();
+    QtMessageHandler previousHandler = qInstallMessageHandler(captureMessage);
+    config->intValue("test/timeout", 150);
+    config->intValue("test/timeout", 150);
+    qInstallMessageHandler(previousHandler);
+    QCOMPARE(capturedMessages.count(), 0);
+
+    QSignalSpy spy(config, SIGNAL(changed()));
+    config->reload();
+    QCOMPARE(spy.count(), 0);
+
+    {
+        QSettings settings(fileName, QSettings::IniFormat);
+        settings.setValue("test/batch-size", 1);
+    }
+
+    config->reload();
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(config->intValue("test/batch-size", 5), 1);
+
+    capturedMessages.clear();
+    previousHandler = qInstallMessageHandler(captureMessage);
+    config->intValue("test/timeout", 150);
+    qInstallMessageHandler(previousHandler);
+    QCOMPARE(capturedMessages.count(), 1);
+
+    // edits are picked up without an explicit reload
+    {
+        QSettings settings(fileName, QSettings::IniFormat);
+        settings.setValue("test/batch-size", 3);
+    }
+    QTRY_COMPARE(spy.count(), 2);
+    QCOMPARE(config->intValue("test/batch-size", 5), 3);
+
+    // so is removing the file, which restores the defaults
+    QVERIFY(QFile::remove(fileName));
+    QTRY_COMPARE(spy.count(), 3);
+    QCOMPARE(config->intValue("test/batch-size", 5), 5);
+
+    config->setFileName(Contactsd::Config::defaultFileName());
+}
+
 void TestContactsd::testDbusRegister()
 {
     QVERIFY2(not mLoader->registerNotificationService(),
@@ -34,6 +34,7 @@ class TestContactsd : public QObject
     Q_OBJECT
 
 private Q_SLOTS:
+    void initTestCase();
     void init();
     void envTest();
     void instanceTest();
@@ -43,14 +44,26 @@ private Q_SLOTS:
     void testDbusPlugin();
     void testLoadAllPlugins();
     void testLoadPlugins();
+    void testPluginsLoaded();
+    void testPluginInitOrder();
     void testInvalid();
     void testImportState();
+    void testImportStateJournal();
+    void testPluginManifest();
+    void testPluginActivator();
+    void testLogWriter();
+    void testLogRotation();
+    void testDebugCategory();
+    void testMetrics();
+    void testTraceRecorder();
+    void testConfig();
     void testDbusRegister();
 
     void cleanup();
 
 private:
     ContactsdPluginLoader *mLoader;
+    QByteArray mPluginsDirs;
 };
 
 #endif // TEST_CONTACTSD_H
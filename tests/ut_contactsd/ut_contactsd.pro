@@ -25,6 +25,7 @@ CONFIG += test
 QT -= gui
 QT += testlib
 QT += dbus
+QT += concurrent
 
 CONFIG(coverage):{
 QMAKE_CXXFLAGS +=  -ftest-coverage -fprofile-arcs
@@ -34,25 +35,47 @@ LIBS += -lgcov
 include(../common/test-common.pri)
 
 TARGET = ut_contactsd
-target.path = $$BINDIR
+target.path = /opt/tests/$${PACKAGENAME}/ut_contactsd
+
+include(check.pri)
+include(tests.pri)
 
 INCLUDEPATH += $$TOP_SOURCEDIR/src
+# the plugins resolve the BasePlugin symbols from the test binary
+LIBS += -export-dynamic
+DEFINES += ENABLE_DEBUG
+DEFINES += VERSION=\\\"$${VERSION}\\\"
 
 HEADERS += test-contactsd.h \
     $$TOP_SOURCEDIR/src/contactsimportprogressadaptor.h \
     $$TOP_SOURCEDIR/src/contactsdpluginloader.h \
     $$TOP_SOURCEDIR/src/importstate.h \
+    $$TOP_SOURCEDIR/src/pluginmanifest.h \
+    $$TOP_SOURCEDIR/src/pluginactivator.h \
+    $$TOP_SOURCEDIR/src/logwriter.h \
+    $$TOP_SOURCEDIR/src/logcontrol.h \
     $$TOP_SOURCEDIR/src/debug.h \
+    $$TOP_SOURCEDIR/src/config.h \
+    $$TOP_SOURCEDIR/src/metrics.h \
+    $$TOP_SOURCEDIR/src/trace.h \
     $$TOP_SOURCEDIR/src/base-plugin.h
 
 SOURCES += test-contactsd.cpp \
     $$TOP_SOURCEDIR/src/contactsimportprogressadaptor.cpp  \
     $$TOP_SOURCEDIR/src/contactsdpluginloader.cpp \
     $$TOP_SOURCEDIR/src/importstate.cpp \
+    $$TOP_SOURCEDIR/src/pluginmanifest.cpp \
+    $$TOP_SOURCEDIR/src/pluginactivator.cpp \
+    $$TOP_SOURCEDIR/src/logwriter.cpp \
+    $$TOP_SOURCEDIR/src/logcontrol.cpp \
     $$TOP_SOURCEDIR/src/debug.cpp \
+    $$TOP_SOURCEDIR/src/config.cpp \
+    $$TOP_SOURCEDIR/src/metrics.cpp \
+    $$TOP_SOURCEDIR/src/trace.cpp \
     $$TOP_SOURCEDIR/src/base-plugin.cpp
 
 DEFINES += CONTACTSD_PLUGINS_DIR=\\\"$$LIBDIR/$${PACKAGENAME}-1.0/plugins\\\"
+DEFINES += UT_CONTACTSD_PLUGINS_DIR=\\\"/opt/tests/$${PACKAGENAME}/plugins\\\"
 
 #gcov stuff
 CONFIG(coverage):{
@@ -0,0 +1,683 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#include "test-telepathy-internals.h"
+
+#include <test-common.h>
+
+#include <QContactAddress>
+#include <QContactBirthday>
+#include <QContactGender>
+#include <QContactName>
+#include <QContactNickname>
+#include <QContactPhoneNumber>
+#include <QContactSyncTarget>
+#include <QDir>
+#include <QImageReader>
+#include <QNetworkRequest>
+
+#include "cdtpaccountcache.h"
+#include "cdtpaccountcacheloader.h"
+#include "cdtpavatarprovider.h"
+#include "cdtpavatarthumbnailer.h"
+#include "cdtpavatarupdate.h"
+#include "cdtpcontact.h"
+#include "cdtpcontactinfo.h"
+#include "cdtpofflinerosterbuffer.h"
+#include "cdtpplugin.h"
+#include "cdtpstorage.h"
+
+const int QContactName__FieldCustomLabel = (QContactName::FieldSuffix+1);
+
+Tp::ContactInfoField TestTelepathyInternals::makeField(const QString &name,
+                                                       const QStringList &parameters,
+                                                       const QStringList &values)
+{
+    Tp::ContactInfoField field;
+    field.fieldName = name;
+    field.parameters = parameters;
+    field.fieldValue = values;
+    return field;
+}
+
+void TestTelepathyInternals::initTestCase()
+{
+    // The avatar provider registry is built on first use
+    QVERIFY(mHomeDir.isValid());
+    QVERIFY(QDir(mHomeDir.path()).mkpath(QLatin1String("avatars-test")));
+    qputenv("CONTACTSD_TEST_AVATAR_DIR", QFile::encodeName(mHomeDir.path() + QLatin1String("/avatars-test")));
+}
+
+void TestTelepathyInternals::testContactInfoPhoneNumber()
+{
+    Tp::ContactInfoFieldList fields;
+    fields << makeField("tel", QStringList() << "type=cell" << "type=home" << "type=CELL", QStringList() << "+123");
+    fields << makeField("tel", QStringList(), QStringList() << "+456");
+
+    CDTpContactInfoMapper mapper;
+    const QList<QContactDetail> details = mapper.details(fields);
+    QCOMPARE(details.count(), 2);
+
+    const QContactPhoneNumber mobile(details.at(0));
+    QCOMPARE(mobile.number(), QString("+123"));
+    QCOMPARE(mobile.contexts(), QList<int>() << QContactDetail::ContextHome);
+    QCOMPARE(mobile.subTypes(), QList<int>() << QContactPhoneNumber::SubTypeMobile);
+
+    // Without any type, the number is a landline in the "other" context
+    const QContactPhoneNumber landline(details.at(1));
+    QCOMPARE(landline.number(), QString("+456"));
+    QCOMPARE(landline.contexts(), QList<int>() << QContactDetail::ContextOther);
+    QCOMPARE(landline.subTypes(), QList<int>() << QContactPhoneNumber::SubTypeLandline);
+}
+
+void TestTelepathyInternals::testContactInfoAddress()
+{
+    Tp::ContactInfoFieldList fields;
+    fields << makeField("adr", QStringList() << "type=work" << "type=postal",
+                        QStringList() << "1" << "Street" << "Extended" << "City" << "Region" << "123" << "Country");
+
+    CDTpContactInfoMapper mapper;
+    const QList<QContactDetail> details = mapper.details(fields);
+    QCOMPARE(details.count(), 1);
+
+    const QContactAddress address(details.at(0));
+    QCOMPARE(address.postOfficeBox(), QString("1"));
+    QCOMPARE(address.street(), QString("Street\nExtended"));
+    QCOMPARE(address.locality(), QString("City"));
+    QCOMPARE(address.region(), QString("Region"));
+    QCOMPARE(address.postcode(), QString("123"));
+    QCOMPARE(address.country(), QString("Country"));
+    QCOMPARE(address.contexts(), QList<int>() << QContactDetail::ContextWork);
+    QCOMPARE(address.subTypes(), QList<int>() << QContactAddress::SubTypePostal);
+}
+
+void TestTelepathyInternals::testContactInfoName()
+{
+    Tp::ContactInfoFieldList fields;
+    fields << makeField("n", QStringList(), QStringList() << "Last" << "First");
+    fields << makeField("nickname", QStringList(), QStringList() << "Nick");
+    fields << makeField("x-unknown", QStringList(), QStringList() << "ignored");
+
+    CDTpContactInfoMapper mapper;
+    const QList<QContactDetail> details = mapper.details(fields);
+    QCOMPARE(details.count(), 2);
+
+    QCOMPARE(QContactNickname(details.at(0)).nickname(), QString("Nick"));
+
+    // The name is always last, and falls back to the nickname for its label
+    const QContactName name(details.at(1));
+    QCOMPARE(name.lastName(), QString("Last"));
+    QCOMPARE(name.firstName(), QString("First"));
+    QCOMPARE(name.value<QString>(QContactName__FieldCustomLabel), QString("Nick"));
+}
+
+void TestTelepathyInternals::testContactInfoGender()
+{
+    Tp::ContactInfoFieldList fields;
+    fields << makeField("x-gender", QStringList(), QStringList() << "Female");
+    fields << makeField("x-gender", QStringList(), QStringList() << "unknown");
+
+    CDTpContactInfoMapper mapper;
+    const QList<QContactDetail> details = mapper.details(fields);
+    QCOMPARE(details.count(), 1);
+    QCOMPARE(QContactGender(details.at(0)).gender(), QContactGender::GenderFemale);
+}
+
+void TestTelepathyInternals::testContactInfoBirthday_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QDate>("date");
+
+    QTest::newRow("dashes") << "1980-02-29" << QDate(1980, 2, 29);
+    QTest::newRow("compact") << "19800229" << QDate(1980, 2, 29);
+    QTest::newRow("datetime") << "1980-02-29T12:00:00" << QDate(1980, 2, 29);
+    QTest::newRow("invalid day") << "1981-02-29" << QDate();
+    QTest::newRow("garbage") << "yesterday" << QDate();
+    QTest::newRow("dashes, letters in year") << "abcd-01-01" << QDate();
+    QTest::newRow("compact, letters in year") << "abcd0101" << QDate();
+    QTest::newRow("dashes, letters in month") << "1980-ab-29" << QDate();
+    QTest::newRow("compact, letters in day") << "198002ab" << QDate();
+    QTest::newRow("empty") << "" << QDate();
+}
+
+void TestTelepathyInternals::testContactInfoBirthday()
+{
+    QFETCH(QString, text);
+    QFETCH(QDate, date);
+
+    QCOMPARE(CDTpContactInfoMapper::parseDate(text), date);
+
+    Tp::ContactInfoFieldList fields;
+    fields << makeField("bday", QStringList(), QStringList() << text);
+
+    CDTpContactInfoMapper mapper;
+    const QList<QContactDetail> details = mapper.details(fields);
+    QCOMPARE(details.count(), date.isValid() ? 1 : 0);
+
+    if (date.isValid()) {
+        QCOMPARE(QContactBirthday(details.at(0)).date(), date);
+    }
+}
+
+void TestTelepathyInternals::testContactInfoMatches()
+{
+    Tp::ContactInfoFieldList fields;
+    fields << makeField("tel", QStringList() << "type=cell", QStringList() << "+123");
+    fields << makeField("adr", QStringList(), QStringList() << "" << "Street");
+
+    CDTpContactInfoMapper mapper;
+    const QList<QContactDetail> details = mapper.details(fields);
+    QCOMPARE(details.count(), 2);
+
+    // Extra fields added by the backend do not matter
+    QContactPhoneNumber stored(details.at(0));
+    stored.setDetailUri("tel:+123");
+    QVERIFY(mapper.matches(stored, details.at(0)));
+
+    // Empty values may be dropped when stored
+    QContactAddress address;
+    address.setStreet("Street\n");
+    QVERIFY(mapper.matches(address, details.at(1)));
+
+    stored.setNumber("+456");
+    QVERIFY(!mapper.matches(stored, details.at(0)));
+
+    stored = QContactPhoneNumber(details.at(0));
+    stored.setContexts(QContactDetail::ContextWork);
+    QVERIFY(!mapper.matches(stored, details.at(0)));
+
+    QVERIFY(!mapper.matches(address, details.at(0)));
+}
+
+void TestTelepathyInternals::benchmarkContactInfo()
+{
+    // A roster worth of vCards, with the fields XMPP servers typically report
+    const int contactCount = 500;
+    QList<Tp::ContactInfoFieldList> roster;
+
+    for (int i = 0; i < contactCount; ++i) {
+        const QString n = QString::number(i);
+        Tp::ContactInfoFieldList fields;
+
+        fields << makeField("fn", QStringList(), QStringList() << "Full Name " + n);
+        fields << makeField("n", QStringList(), QStringList() << "Last" + n << "First" + n << "" << "" << "");
+        fields << makeField("nickname", QStringList(), QStringList() << "nick" + n);
+        fields << makeField("tel", QStringList() << "type=cell" << "type=voice", QStringList() << "+358" + n);
+        fields << makeField("tel", QStringList() << "type=work" << "type=voice", QStringList() << "+359" + n);
+        fields << makeField("tel", QStringList() << "type=home" << "type=fax", QStringList() << "+360" + n);
+        fields << makeField("email", QStringList() << "type=internet" << "type=home", QStringList() << "user" + n + "@example.com");
+        fields << makeField("email", QStringList() << "type=internet" << "type=work", QStringList() << "user" + n + "@example.org");
+        fields << makeField("adr", QStringList() << "type=home" << "type=postal",
+                            QStringList() << "" << "Street " + n << "" << "City" << "Region" << "00100" << "Country");
+        fields << makeField("title", QStringList(), QStringList() << "Title");
+        fields << makeField("org", QStringList() << "type=work", QStringList() << "Company" << "Department");
+        fields << makeField("url", QStringList() << "type=home", QStringList() << "http://example.com/" + n);
+        fields << makeField("bday", QStringList(), QStringList() << "1980-01-01");
+        fields << makeField("x-gender", QStringList(), QStringList() << "male");
+        fields << makeField("desc", QStringList(), QStringList() << "Some note about " + n);
+
+        roster.append(fields);
+    }
+
+    CDTpContactInfoMapper mapper;
+    int detailCount = 0;
+
+    QBENCHMARK {
+        detailCount = 0;
+        foreach (const Tp::ContactInfoFieldList &fields, roster) {
+            detailCount += mapper.details(fields).count();
+        }
+    }
+
+    QCOMPARE(detailCount, contactCount * 13);
+}
+
+void TestTelepathyInternals::testAvatarThumbnails_data()
+{
+    QTest::addColumn<QString>("fixture");
+    QTest::addColumn<QByteArray>("format");
+    QTest::addColumn<QSize>("listSize");
+    QTest::addColumn<QSize>("gridSize");
+
+    QTest::newRow("large") << "avatar-large.png" << QByteArray("jpeg") << QSize(96, 72) << QSize(256, 192);
+    QTest::newRow("between sizes") << "avatar-wide.png" << QByteArray("jpeg") << QSize(96, 48) << QSize(200, 100);
+    QTest::newRow("transparent") << "avatar-transparent.png" << QByteArray("png") << QSize(64, 64) << QSize(64, 64);
+}
+
+void TestTelepathyInternals::testAvatarThumbnails()
+{
+    QFETCH(QString, fixture);
+    QFETCH(QByteArray, format);
+    QFETCH(QSize, listSize);
+    QFETCH(QSize, gridSize);
+
+    QVERIFY(mHomeDir.isValid());
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(mHomeDir.path() + QLatin1String("/cache")));
+
+    // Thumbnails are only current if they are newer than a real file
+    const QString sourcePath(mHomeDir.path() + QLatin1String("/") + fixture);
+    QFile::remove(sourcePath);
+    QVERIFY(QFile::copy(QLatin1String(":/data/") + fixture, sourcePath));
+
+    QString listPath;
+    QString gridPath;
+    QVERIFY(!CDTpAvatarThumbnailer::findThumbnails(sourcePath, &listPath, &gridPath));
+
+    CDTpAvatarThumbnailer *thumbnailer = new CDTpAvatarThumbnailer(sourcePath);
+    QSignalSpy spy(thumbnailer, SIGNAL(finished(QString, QString, QString)));
+    thumbnailer->start();
+    QTRY_COMPARE(spy.count(), 1);
+
+    const QList<QVariant> arguments = spy.first();
+    QCOMPARE(arguments.at(0).toString(), sourcePath);
+    QCOMPARE(arguments.at(1).toString(), CDTpAvatarThumbnailer::thumbnailPath(sourcePath, CDTpAvatarThumbnailer::List));
+    QCOMPARE(arguments.at(2).toString(), CDTpAvatarThumbnailer::thumbnailPath(sourcePath, CDTpAvatarThumbnailer::Grid));
+
+    QImageReader listReader(arguments.at(1).toString());
+    QCOMPARE(listReader.format(), format);
+    QCOMPARE(listReader.size(), listSize);
+
+    QImageReader gridReader(arguments.at(2).toString());
+    QCOMPARE(gridReader.format(), format);
+    QCOMPARE(gridReader.size(), gridSize);
+
+    // Later lookups find the thumbnails without creating them again
+    QVERIFY(CDTpAvatarThumbnailer::findThumbnails(sourcePath, &listPath, &gridPath));
+    QCOMPARE(listPath, arguments.at(1).toString());
+    QCOMPARE(gridPath, arguments.at(2).toString());
+
+    // Thumbnails are kept while a live contact uses their source...
+    CDTpAvatarThumbnailer::addSourceReference(sourcePath);
+    QCOMPARE(CDTpAvatarThumbnailer::removeUnusedThumbnails(QSet<QString>()), 0);
+    QVERIFY(QFile::exists(listPath));
+    QVERIFY(QFile::exists(gridPath));
+    CDTpAvatarThumbnailer::removeSourceReference(sourcePath);
+
+    // ...or a stored contact refers to them
+    QCOMPARE(CDTpAvatarThumbnailer::removeUnusedThumbnails(QSet<QString>() << listPath), 1);
+    QVERIFY(QFile::exists(listPath));
+    QVERIFY(!QFile::exists(gridPath));
+
+    QCOMPARE(CDTpAvatarThumbnailer::removeUnusedThumbnails(QSet<QString>()), 1);
+    QVERIFY(!QFile::exists(listPath));
+    QVERIFY(!CDTpAvatarThumbnailer::findThumbnails(sourcePath, &listPath, &gridPath));
+}
+
+// A contact as stored in the account cache, with only the thumbnails set
+static CDTpContact::Info thumbnailInfo(const QString &listPath, const QString &gridPath)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << QString()                                                     // alias
+        << uint(Tp::ConnectionPresenceTypeUnset) << QString() << QString() // presence
+        << int(0)                                                        // capabilities
+        << QString() << QString() << QString()                           // other avatars
+        << listPath << gridPath
+        << false << uint(0) << false << uint(0)                          // authorization
+        << false << quint32(0)                                           // info fields
+        << false;                                                        // visibility
+
+    CDTpContact::Info info;
+    QDataStream in(data);
+    in >> info;
+    return info;
+}
+
+void TestTelepathyInternals::testAvatarThumbnailChanges()
+{
+    const CDTpContact::Info none(thumbnailInfo(QString(), QString()));
+    const CDTpContact::Info both(thumbnailInfo("list", "grid"));
+    const CDTpContact::Info gridOnly(thumbnailInfo(QString(), "grid"));
+
+    QCOMPARE(int(none.diff(none)), 0);
+    QCOMPARE(int(none.diff(both)), int(CDTpContact::ThumbnailAvatar));
+    QCOMPARE(int(both.diff(gridOnly)), int(CDTpContact::ThumbnailAvatar));
+    QCOMPARE(int(both.diff(thumbnailInfo("list", "grid"))), 0);
+
+    // Thumbnails are part of the avatar as far as storage is concerned
+    QVERIFY(CDTpContact::Avatar & CDTpContact::ThumbnailAvatar);
+}
+
+void TestTelepathyInternals::testAvatarProviderFind_data()
+{
+    QTest::addColumn<QString>("contactId");
+    QTest::addColumn<QString>("provider");
+    QTest::addColumn<QString>("socialId");
+
+    QTest::newRow("facebook") << "-1234@chat.facebook.com" << "facebook" << "1234";
+    QTest::newRow("facebook, prefix") << "x-1234@chat.facebook.com" << QString() << QString();
+    QTest::newRow("facebook, suffix") << "-1234@chat.facebook.com.example.org" << QString() << QString();
+    QTest::newRow("facebook, not numeric") << "-12ab@chat.facebook.com" << QString() << QString();
+    QTest::newRow("facebook, unescaped dot") << "-1234@chatxfacebook.com" << QString() << QString();
+    QTest::newRow("test") << "alice@avatars.test" << "test" << "alice";
+    QTest::newRow("jabber") << "alice@example.org" << QString() << QString();
+}
+
+void TestTelepathyInternals::testAvatarProviderFind()
+{
+    QFETCH(QString, contactId);
+    QFETCH(QString, provider);
+    QFETCH(QString, socialId);
+
+    QString foundSocialId;
+    const CDTpAvatarProvider *found = CDTpAvatarProvider::find(contactId, &foundSocialId);
+
+    if (provider.isEmpty()) {
+        QVERIFY(found == 0);
+    } else {
+        QVERIFY(found != 0);
+        QCOMPARE(found->name(), provider);
+        QCOMPARE(foundSocialId, socialId);
+    }
+}
+
+void TestTelepathyInternals::testAvatarProviderUrls()
+{
+    QString socialId;
+    const CDTpAvatarProvider *facebook = CDTpAvatarProvider::find("-1234@chat.facebook.com", &socialId);
+    QVERIFY(facebook != 0);
+    QVERIFY(facebook->requiresNetwork());
+    QCOMPARE(facebook->avatarTypes(), QStringList() << CDTpAvatarUpdate::Large << CDTpAvatarUpdate::Square);
+    QCOMPARE(facebook->avatarUrl(socialId, CDTpAvatarUpdate::Large),
+             QUrl("http://graph.facebook.com/1234/picture?type=large"));
+    QCOMPARE(facebook->avatarUrl(socialId, "huge"), QUrl());
+
+    // Local avatars are fetched even without network
+    const CDTpAvatarProvider *test = CDTpAvatarProvider::find("alice@avatars.test", &socialId);
+    QVERIFY(test != 0);
+    QVERIFY(!test->requiresNetwork());
+    QCOMPARE(test->avatarUrl(socialId, CDTpAvatarUpdate::Square),
+             QUrl::fromLocalFile(mHomeDir.path() + QLatin1String("/avatars-test/alice-square")));
+
+    CDTpAvatarProvider local("local", "^(.+)$");
+    local.addAvatarType(CDTpAvatarUpdate::Large, "file:///avatars/%1");
+    QVERIFY(!local.requiresNetwork());
+    local.addAvatarType(CDTpAvatarUpdate::Square, "https://example.org/%1");
+    QVERIFY(local.requiresNetwork());
+}
+
+void TestTelepathyInternals::testAvatarProviderFetch()
+{
+    QVERIFY(mHomeDir.isValid());
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(mHomeDir.path() + QLatin1String("/cache")));
+
+    QString socialId;
+    const CDTpAvatarProvider *test = CDTpAvatarProvider::find("bob@avatars.test", &socialId);
+    QVERIFY(test != 0);
+
+    const QUrl avatarUrl = test->avatarUrl(socialId, CDTpAvatarUpdate::Large);
+    QFile::remove(avatarUrl.toLocalFile());
+    QVERIFY(QFile::copy(QLatin1String(":/data/avatar-large.png"), avatarUrl.toLocalFile()));
+
+    QNetworkAccessManager network;
+    CDTpAvatarUpdate update(network.get(QNetworkRequest(avatarUrl)), 0, CDTpAvatarUpdate::Large);
+    QSignalSpy spy(&update, SIGNAL(finished()));
+    QTRY_COMPARE(spy.count(), 1);
+
+    // The avatar is copied into the cache, named after its URL
+    QVERIFY(!update.avatarPath().isEmpty());
+    QVERIFY(update.avatarPath().startsWith(CDTpPlugin::cacheFileName(QLatin1String("avatars/large/"))));
+
+    QFile fetched(update.avatarPath());
+    QVERIFY(fetched.open(QIODevice::ReadOnly));
+    QFile fixture(QLatin1String(":/data/avatar-large.png"));
+    QVERIFY(fixture.open(QIODevice::ReadOnly));
+    QCOMPARE(fetched.readAll(), fixture.readAll());
+
+    // A missing avatar leaves the contact's avatar alone
+    CDTpAvatarUpdate missing(network.get(QNetworkRequest(test->avatarUrl("nobody", CDTpAvatarUpdate::Large))),
+                             0, CDTpAvatarUpdate::Large);
+    QSignalSpy missingSpy(&missing, SIGNAL(finished()));
+    QTRY_COMPARE(missingSpy.count(), 1);
+    QVERIFY(missing.avatarPath().isEmpty());
+}
+
+void TestTelepathyInternals::testOfflineRosterBuffer()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString fileName(dir.path() + "/journal");
+    const QString account1("/org/freedesktop/Telepathy/Account/gabble/jabber/one");
+    const QString account2("/org/freedesktop/Telepathy/Account/gabble/jabber/two");
+
+    {
+        CDTpOfflineRosterBuffer buffer(fileName);
+        QCOMPARE(buffer.addContactIds(CDTpOfflineRosterBuffer::Removal, account1, QStringList() << "a" << "b" << "a"),
+                 QStringList() << "a" << "b");
+        QCOMPARE(buffer.addContactIds(CDTpOfflineRosterBuffer::Removal, account1, QStringList() << "c"),
+                 QStringList() << "a" << "b" << "c");
+        QCOMPARE(buffer.removeContactIds(CDTpOfflineRosterBuffer::Removal, account1, QStringList() << "b"),
+                 QStringList() << "a" << "c");
+        buffer.addContactIds(CDTpOfflineRosterBuffer::Invitation, account1, QStringList() << "d");
+        buffer.addContactIds(CDTpOfflineRosterBuffer::Invitation, account2, QStringList() << "e");
+        buffer.removeAccount(account2);
+        QVERIFY(buffer.commit());
+    }
+
+    {
+        CDTpOfflineRosterBuffer buffer(fileName);
+        QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Removal, account1), QStringList() << "a" << "c");
+        QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Invitation, account1), QStringList() << "d");
+        QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Invitation, account2), QStringList());
+    }
+
+    // A record cut short by a crash is dropped, the ones before it are kept
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::Append));
+    file.write(QByteArray("\x00\x00\x10\x00partial", 11));
+    file.close();
+
+    {
+        CDTpOfflineRosterBuffer buffer(fileName);
+        QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Removal, account1), QStringList() << "a" << "c");
+        buffer.addContactIds(CDTpOfflineRosterBuffer::Removal, account1, QStringList() << "f");
+    }
+
+    {
+        CDTpOfflineRosterBuffer buffer(fileName);
+        QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Removal, account1), QStringList() << "a" << "c" << "f");
+    }
+}
+
+void TestTelepathyInternals::testOfflineRosterBufferImport()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString settingsFileName(dir.path() + "/Contactsd.conf");
+    const QString account("/org/freedesktop/Telepathy/Account/gabble/jabber/one");
+
+    {
+        QSettings settings(settingsFileName, QSettings::IniFormat);
+        settings.beginGroup("OfflineRemovals");
+        settings.setValue(account, QStringList() << "a" << "b");
+        settings.endGroup();
+        settings.beginGroup("OfflineInvitations");
+        settings.setValue(account, QStringList() << "c");
+        settings.endGroup();
+    }
+
+    {
+        CDTpOfflineRosterBuffer buffer(dir.path() + "/journal");
+        buffer.importSettings(settingsFileName);
+        QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Removal, account), QStringList() << "a" << "b");
+        QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Invitation, account), QStringList() << "c");
+    }
+
+    // The settings are only imported once
+    QSettings settings(settingsFileName, QSettings::IniFormat);
+    QVERIFY(settings.allKeys().isEmpty());
+}
+
+void TestTelepathyInternals::benchmarkOfflineRosterBuffer()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString account("/org/freedesktop/Telepathy/Account/gabble/jabber/one");
+
+    QStringList ids;
+    for (int i = 0; i < 500; ++i) {
+        ids.append(QString::fromLatin1("buddy%1@example.com").arg(i));
+    }
+
+    CDTpOfflineRosterBuffer buffer(dir.path() + "/journal");
+
+    QBENCHMARK {
+        buffer.addContactIds(CDTpOfflineRosterBuffer::Removal, account, ids);
+        buffer.commit();
+        buffer.removeContactIds(CDTpOfflineRosterBuffer::Removal, account, ids);
+        buffer.commit();
+    }
+
+    QCOMPARE(buffer.contactIds(CDTpOfflineRosterBuffer::Removal, account), QStringList());
+}
+
+void TestTelepathyInternals::benchmarkAccountCacheLoading_data()
+{
+    QTest::addColumn<int>("accountCount");
+    QTest::addColumn<bool>("parallel");
+
+    const int accountCounts[] = { 1, 5, 10, 20 };
+    for (unsigned i = 0; i < sizeof(accountCounts) / sizeof(accountCounts[0]); ++i) {
+        const int n = accountCounts[i];
+        QTest::newRow(qPrintable(QString::fromLatin1("%1 accounts, sequential").arg(n))) << n << false;
+        QTest::newRow(qPrintable(QString::fromLatin1("%1 accounts, parallel").arg(n))) << n << true;
+    }
+}
+
+void TestTelepathyInternals::benchmarkAccountCacheLoading()
+{
+    QFETCH(int, accountCount);
+    QFETCH(bool, parallel);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const int contactsPerAccount = 500;
+
+    CDTpAccountCacheLoader::Cache cache;
+    for (int i = 0; i < contactsPerAccount; ++i) {
+        cache.insert(QString::fromLatin1("buddy%1@example.com").arg(i), CDTpContact::Info());
+    }
+
+    QStringList fileNames;
+    for (int i = 0; i < accountCount; ++i) {
+        QFile file(dir.path() + QString::fromLatin1("/account%1").arg(i));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+
+        QDataStream stream(&file);
+        stream << CDTpAccountCache::Version << cache;
+        fileNames.append(file.fileName());
+    }
+
+    QBENCHMARK {
+        if (parallel) {
+            QList<QFuture<CDTpAccountCacheLoader::Cache> > futures;
+            foreach (const QString &fileName, fileNames) {
+                futures.append(CDTpAccountCacheLoader::loadInBackground(fileName));
+            }
+            foreach (const QFuture<CDTpAccountCacheLoader::Cache> &future, futures) {
+                QCOMPARE(future.result().count(), contactsPerAccount);
+            }
+        } else {
+            foreach (const QString &fileName, fileNames) {
+                QCOMPARE(CDTpAccountCacheLoader::load(fileName).count(), contactsPerAccount);
+            }
+        }
+    }
+}
+
+void TestTelepathyInternals::benchmarkSelfContactFirstStart()
+{
+    // The contact manager is only created once per process, so point it at an
+    // empty database before anything else uses it
+    QVERIFY(mHomeDir.isValid());
+    qputenv("XDG_DATA_HOME", QFile::encodeName(mHomeDir.path() + QLatin1String("/data")));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(mHomeDir.path() + QLatin1String("/cache")));
+
+    QBENCHMARK_ONCE {
+        CDTpStorage storage;
+        storage.syncAccounts(QList<CDTpAccountPtr>());
+    }
+
+    QVERIFY(QFile::exists(CDTpPlugin::cacheFileName(QLatin1String("telepathy-self-contact"))));
+}
+
+void TestTelepathyInternals::benchmarkSelfContactStampedStart()
+{
+    QVERIFY(QFile::exists(CDTpPlugin::cacheFileName(QLatin1String("telepathy-self-contact"))));
+
+    QBENCHMARK {
+        CDTpStorage storage;
+        storage.syncAccounts(QList<CDTpAccountPtr>());
+    }
+}
+
+void TestTelepathyInternals::testSelfContactStampOtherSelf()
+{
+    QFile stamp(CDTpPlugin::cacheFileName(QLatin1String("telepathy-self-contact")));
+    QVERIFY(stamp.open(QIODevice::ReadOnly));
+    const QByteArray selfStamp(stamp.readAll());
+    stamp.close();
+
+    // A stamp written for another self contact, e.g. before a database reset
+#ifdef USING_QTPIM
+    QContactManager manager(QStringLiteral("org.nemomobile.contacts.sqlite"));
+#else
+    QContactManager manager;
+#endif
+    QContact unlinked;
+    QContactSyncTarget syncTarget;
+    syncTarget.setSyncTarget(QLatin1String("telepathy"));
+    QVERIFY(unlinked.saveDetail(&syncTarget));
+    QVERIFY(manager.saveContact(&unlinked));
+
+    QVERIFY(stamp.open(QIODevice::WriteOnly | QIODevice::Truncate));
+#ifdef USING_QTPIM
+    const QByteArray unlinkedId(unlinked.id().toString().toLatin1());
+#else
+    const QByteArray unlinkedId(QByteArray::number(unlinked.localId()));
+#endif
+    stamp.write(unlinkedId + '\n' + unlinkedId + '\n');
+    stamp.close();
+
+    // The stamp is not trusted, and the real self contact is stamped again
+    {
+        CDTpStorage storage;
+        storage.syncAccounts(QList<CDTpAccountPtr>());
+    }
+
+    QVERIFY(stamp.open(QIODevice::ReadOnly));
+    QCOMPARE(stamp.readAll(), selfStamp);
+    stamp.close();
+
+#ifdef USING_QTPIM
+    QVERIFY(manager.removeContact(unlinked.id()));
+#else
+    QVERIFY(manager.removeContact(unlinked.localId()));
+#endif
+}
+
+CONTACTSD_TEST_MAIN(TestTelepathyInternals)
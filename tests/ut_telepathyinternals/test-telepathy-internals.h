@@ -0,0 +1,71 @@
+/** This file is part of Contacts daemon
+ **
+ ** Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+ **
+ ** Contact:  Nokia Corporation (info@qt.nokia.com)
+ **
+ ** GNU Lesser General Public License Usage
+ ** This file may be used under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation and appearing in the
+ ** file LICENSE.LGPL included in the packaging of this file.  Please review the
+ ** following information to ensure the GNU Lesser General Public License version
+ ** 2.1 requirements will be met:
+ ** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ **
+ ** In addition, as a special exception, Nokia gives you certain additional rights.
+ ** These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+ ** in the file LGPL_EXCEPTION.txt in this package.
+ **
+ ** Other Usage
+ ** Alternatively, this file may be used in accordance with the terms and
+ ** conditions contained in a signed written agreement between you and Nokia.
+ **/
+
+#ifndef TEST_TELEPATHY_INTERNALS_H
+#define TEST_TELEPATHY_INTERNALS_H
+
+#include <QObject>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+
+#include <TelepathyQt/Types>
+
+class TestTelepathyInternals : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testContactInfoPhoneNumber();
+    void testContactInfoAddress();
+    void testContactInfoName();
+    void testContactInfoGender();
+    void testContactInfoBirthday_data();
+    void testContactInfoBirthday();
+    void testContactInfoMatches();
+    void benchmarkContactInfo();
+    void testAvatarThumbnails_data();
+    void testAvatarThumbnails();
+    void testAvatarThumbnailChanges();
+    void testAvatarProviderFind_data();
+    void testAvatarProviderFind();
+    void testAvatarProviderUrls();
+    void testAvatarProviderFetch();
+    void testOfflineRosterBuffer();
+    void testOfflineRosterBufferImport();
+    void benchmarkOfflineRosterBuffer();
+    void benchmarkAccountCacheLoading_data();
+    void benchmarkAccountCacheLoading();
+    void benchmarkSelfContactFirstStart();
+    void benchmarkSelfContactStampedStart();
+    void testSelfContactStampOtherSelf();
+
+private:
+    QTemporaryDir mHomeDir;
+
+    static Tp::ContactInfoField makeField(const QString &name,
+                                          const QStringList &parameters,
+                                          const QStringList &values);
+};
+
+#endif // TEST_TELEPATHY_INTERNALS_H
@@ -0,0 +1,99 @@
+# This file is part of Contacts daemon
+#
+# Copyright (c) 2010-2011 Nokia Corporation and/or its subsidiary(-ies).
+#
+# Contact:  Nokia Corporation (info@qt.nokia.com)
+#
+# GNU Lesser General Public License Usage
+# This file may be used under the terms of the GNU Lesser General Public License
+# version 2.1 as published by the Free Software Foundation and appearing in the
+# file LICENSE.LGPL included in the packaging of this file.  Please review the
+# following information to ensure the GNU Lesser General Public License version
+# 2.1 requirements will be met:
+# http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+#
+# In addition, as a special exception, Nokia gives you certain additional rights.
+# These rights are described in the Nokia Qt LGPL Exception version 1.1, included
+# in the file LGPL_EXCEPTION.txt in this package.
+#
+# Other Usage
+# Alternatively, this file may be used in accordance with the terms and
+# conditions contained in a signed written agreement between you and Nokia.
+
+include(../common/test-common.pri)
+
+TARGET = ut_telepathyinternals
+target.path = /opt/tests/$${PACKAGENAME}/ut_telepathyinternals
+
+CONFIG += test link_pkgconfig
+
+QT += testlib dbus network concurrent
+DEFINES += ENABLE_DEBUG
+DEFINES += VERSION=\\\"$${VERSION}\\\"
+
+PKGCONFIG += Qt5Contacts
+PKGCONFIG += TelepathyQt5
+DEFINES *= USING_QTPIM
+
+# The account cache pulls in the rest of the plugin
+system(qdbusxml2cpp -c BuddyManagementAdaptor -i cdtpbuddyoperation.h -a buddymanagementadaptor.h:buddymanagementadaptor.cpp $$TOP_SOURCEDIR/plugins/telepathy/com.nokia.contacts.buddymanagement.xml)
+
+CONFIG(coverage):{
+QMAKE_CXXFLAGS +=  -ftest-coverage -fprofile-arcs
+LIBS += -lgcov
+}
+
+INCLUDEPATH += $$TOP_SOURCEDIR/src \
+    $$TOP_SOURCEDIR/plugins/telepathy
+
+HEADERS += test-telepathy-internals.h \
+    buddymanagementadaptor.h \
+    $$TOP_SOURCEDIR/src/base-plugin.h \
+    $$TOP_SOURCEDIR/src/debug.h \
+    $$TOP_SOURCEDIR/src/config.h \
+    $$TOP_SOURCEDIR/src/metrics.h \
+    $$TOP_SOURCEDIR/src/trace.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpaccount.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpaccountcache.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpaccountcacheloader.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpaccountcachewriter.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpavatarprovider.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpavatarthumbnailer.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpavatarupdate.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpbuddyoperation.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpcontact.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpcontactinfo.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpcontroller.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpofflinerosterbuffer.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpplugin.h \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpstorage.h
+
+SOURCES += test-telepathy-internals.cpp \
+    buddymanagementadaptor.cpp \
+    $$TOP_SOURCEDIR/src/base-plugin.cpp \
+    $$TOP_SOURCEDIR/src/debug.cpp \
+    $$TOP_SOURCEDIR/src/config.cpp \
+    $$TOP_SOURCEDIR/src/metrics.cpp \
+    $$TOP_SOURCEDIR/src/trace.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpaccount.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpaccountcacheloader.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpaccountcachewriter.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpavatarprovider.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpavatarthumbnailer.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpavatarupdate.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpcontact.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpcontactinfo.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpcontroller.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpofflinerosterbuffer.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpplugin.cpp \
+    $$TOP_SOURCEDIR/plugins/telepathy/cdtpstorage.cpp
+
+# Avatar fixtures are built in, so that the installed test finds them too
+RESOURCES += ut_telepathyinternals.qrc
+
+check.depends = $$TARGET
+check.commands = ./$$TARGET
+
+QMAKE_EXTRA_TARGETS += check
+
+INSTALLS += target
@@ -28,6 +28,9 @@
 #include <QContactSaveRequest>
 #include <QContactSyncTarget>
 #include <QContactOnlineAccount>
+#include <QContactDetailFilter>
+#include <QContactIntersectionFilter>
+#include <QContactRelationshipFilter>
 #ifdef USING_QTPIM
 #include <QContactIdFilter>
 #include <QContactIdFetchRequest>
@@ -57,6 +60,7 @@ void TestTelepathyPlugin::initTestCase()
     initTestCaseImpl();
 
     qRegisterMetaType<QContactAbstractRequest::State>("QContactAbstractRequest::State");
+    registerBuddyOperationTypes();
 
     g_type_init();
     g_set_prgname("test-telepathy-plugin");
@@ -234,6 +238,96 @@ void TestTelepathyPlugin::testSelfContact()
     runExpectation(exp);
 }
 
+// The telepathy contacts aggregated by the self contact
+static QList<TestTelepathyPlugin::ContactIdType> telepathySelfContactIds(QContactManager *manager)
+{
+    QContactDetailFilter syncTargetFilter;
+#ifdef USING_QTPIM
+    syncTargetFilter.setDetailType(QContactSyncTarget::Type, QContactSyncTarget::FieldSyncTarget);
+#else
+    syncTargetFilter.setDetailDefinitionName(QContactSyncTarget::DefinitionName, QContactSyncTarget::FieldSyncTarget);
+#endif
+    syncTargetFilter.setValue(QLatin1String("telepathy"));
+
+    QContactRelationshipFilter relationshipFilter;
+#ifdef USING_QTPIM
+    relationshipFilter.setRelationshipType(QContactRelationship::Aggregates());
+    QContact self;
+    self.setId(manager->selfContactId());
+    relationshipFilter.setRelatedContact(self);
+#else
+    relationshipFilter.setRelationshipType(QContactRelationship::Aggregates);
+    QContactId selfId;
+    selfId.setLocalId(manager->selfContactId());
+    relationshipFilter.setRelatedContactId(selfId);
+#endif
+    relationshipFilter.setRelatedContactRole(QContactRelationship::First);
+
+    return manager->contactIds(syncTargetFilter & relationshipFilter);
+}
+
+void TestTelepathyPlugin::testSelfContactRemoved()
+{
+    const QList<ContactIdType> selfIds = telepathySelfContactIds(mContactManager);
+    QCOMPARE(selfIds.count(), 1);
+
+    /* Remove the telepathy self contact behind contactsd's back. The
+     * notifications of this test are not expectations, don't track them. */
+    mContactManager->blockSignals(true);
+    QVERIFY(mContactManager->removeContact(selfIds.first()));
+
+    /* The next account operation finds or creates the self contact again */
+    TpTestsContactsConnectionPresenceStatusIndex presence =
+            TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY;
+    const gchar *message = "Self contact removed";
+    tp_tests_contacts_connection_change_presences(
+        TP_TESTS_CONTACTS_CONNECTION (mConnService),
+        1, &mConnService->self_handle, &presence, &message);
+
+    QTRY_COMPARE(telepathySelfContactIds(mContactManager).count(), 1);
+    const ContactIdType selfId = telepathySelfContactIds(mContactManager).first();
+    QVERIFY(selfId != selfIds.first());
+    QTRY_VERIFY(!mContactManager->contact(selfId).details<QContactOnlineAccount>().isEmpty());
+
+    mContactManager->blockSignals(false);
+}
+
+static qlonglong accountUpdates()
+{
+    QDBusInterface metrics("com.nokia.contactsd", "/metrics", "com.nokia.contactsd.metrics");
+    QDBusReply<QVariantMap> counters = metrics.call("counters");
+    return counters.isValid() ? counters.value().value("telepathy.account-updates").toLongLong() : -1;
+}
+
+void TestTelepathyPlugin::testAccountUpdatesMerged()
+{
+    const qlonglong updatesBefore = accountUpdates();
+    QVERIFY(updatesBefore >= 0);
+
+    /* Change nickname and presence of the account at once */
+    const gchar *alias = "Merged";
+    tp_tests_contacts_connection_change_aliases(
+        TP_TESTS_CONTACTS_CONNECTION (mConnService),
+        1, &mConnService->self_handle, &alias);
+
+    TpTestsContactsConnectionPresenceStatusIndex presence =
+            TP_TESTS_CONTACTS_CONNECTION_STATUS_AWAY;
+    const gchar *message = "Merged account update";
+    tp_tests_contacts_connection_change_presences(
+        TP_TESTS_CONTACTS_CONNECTION (mConnService),
+        1, &mConnService->self_handle, &presence, &message);
+
+    /* Both changes are written by the same update */
+    TestExpectationContactPtr exp(new TestExpectationContact(EventChanged));
+    exp->verifyAlias(alias);
+    exp->verifyPresence(presence);
+    runExpectation(exp);
+
+    /* ...which is the only one */
+    QTest::qWait(1000);
+    QCOMPARE(accountUpdates(), updatesBefore + 1);
+}
+
 void TestTelepathyPlugin::testAuthorization()
 {
     TpHandle handle;
@@ -445,6 +539,86 @@ void TestTelepathyPlugin::testRemoveBuddyDBusAPI()
     // buddy2 gets removed from roster
 }
 
+void TestTelepathyPlugin::testRemoveBuddiesBatchDBusAPI()
+{
+    const char *buddy1 = "removebatchbuddy1";
+    TpHandle handle1;
+    TestExpectationContactPtr exp1 = createContact(buddy1, handle1);
+
+    const char *buddy2 = "removebatchbuddy2";
+    TpHandle handle2;
+    TestExpectationContactPtr exp2 = createContact(buddy2, handle2);
+
+    CDTpBuddyOperation knownAccount;
+    knownAccount.accountPath = ACCOUNT_PATH;
+    knownAccount.imIds << buddy1 << buddy2;
+
+    CDTpBuddyOperation unknownAccount;
+    unknownAccount.accountPath = QLatin1String("/org/freedesktop/Telepathy/Account/fakecm/fakeproto/unknown");
+    unknownAccount.imIds << buddy1;
+
+    // Remove both buddies with a single call; the unknown account is reported as failed
+    BuddyManagementInterface *buddyIf = new BuddyManagementInterface("com.nokia.contactsd", "/telepathy", QDBusConnection::sessionBus(), 0);
+    {
+        QDBusPendingReply<QList<bool> > async = buddyIf->removeBuddiesBatch(CDTpBuddyOperationList() << knownAccount << unknownAccount);
+        QDBusPendingCallWatcher watcher(async, this);
+        watcher.waitForFinished();
+        QVERIFY2(not async.isError(), async.error().message().toLatin1());
+        QVERIFY(watcher.isValid());
+        QCOMPARE(async.value(), QList<bool>() << true << false);
+    }
+
+    // Both are removed by one storage call, possibly in one notification
+    runExpectation(TestExpectationMassPtr(new TestExpectationMass(0, 0, 2)));
+}
+
+static qlonglong contactsRemovedFromServer()
+{
+    QDBusInterface metrics("com.nokia.contactsd", "/metrics", "com.nokia.contactsd.metrics");
+    QDBusReply<QVariantMap> counters = metrics.call("counters");
+    return counters.isValid() ? counters.value().value("telepathy.contacts-removed-from-server").toLongLong() : -1;
+}
+
+void TestTelepathyPlugin::testRemoveBuddiesChunked()
+{
+    /* More contacts than fit in one removal request */
+    const int nContacts = 250;
+    QStringList buddies;
+    GArray *handles = g_array_new(FALSE, FALSE, sizeof(TpHandle));
+    for (int i = 0; i < nContacts; i++) {
+        const QString buddy = QString("removechunkbuddy%1").arg(i);
+        TpHandle handle = ensureHandle(buddy.toLatin1().constData());
+        g_array_append_val(handles, handle);
+        buddies << buddy;
+    }
+    test_contact_list_manager_request_subscription(mListManager,
+            handles->len, (TpHandle *) handles->data, "wait");
+    runExpectation(TestExpectationMassPtr(new TestExpectationMass(nContacts, 0, 0)));
+
+    const qlonglong removedBefore = contactsRemovedFromServer();
+    QVERIFY(removedBefore >= 0);
+
+    BuddyManagementInterface *buddyIf = new BuddyManagementInterface("com.nokia.contactsd", "/telepathy", QDBusConnection::sessionBus(), 0);
+    {
+        QDBusPendingReply<> async = buddyIf->removeBuddies(ACCOUNT_PATH, buddies);
+        QDBusPendingCallWatcher watcher(async, this);
+        watcher.waitForFinished();
+        QVERIFY2(not async.isError(), async.error().message().toLatin1());
+        QVERIFY(watcher.isValid());
+    }
+    runExpectation(TestExpectationMassPtr(new TestExpectationMass(0, 0, nContacts)));
+
+    /* Progress reaches the total once every chunk is removed from the server */
+    QTRY_COMPARE(contactsRemovedFromServer(), removedBefore + nContacts);
+
+    TpHandleSet *contacts = tp_base_contact_list_dup_contacts(TP_BASE_CONTACT_LIST(mListManager));
+    for (guint i = 0; i < handles->len; i++) {
+        QVERIFY(!tp_handle_set_is_member(contacts, g_array_index(handles, TpHandle, i)));
+    }
+    tp_handle_set_destroy(contacts);
+    g_array_free(handles, TRUE);
+}
+
 void TestTelepathyPlugin::testInviteBuddyDBusAPI()
 {
     const QString buddy("invitebuddy");
@@ -460,6 +634,49 @@ void TestTelepathyPlugin::testInviteBuddyDBusAPI()
     runExpectation(TestExpectationContactPtr(new TestExpectationContact(EventAdded, buddy)));
 }
 
+void TestTelepathyPlugin::testInviteBuddiesBatchDBusAPI()
+{
+    const QString buddy1("invitebatchbuddy1");
+    const QString buddy2("invitebatchbuddy2");
+
+    // The invitations of one account are merged, duplicates included
+    CDTpBuddyOperation first;
+    first.accountPath = ACCOUNT_PATH;
+    first.imIds << buddy1;
+
+    CDTpBuddyOperation second;
+    second.accountPath = ACCOUNT_PATH;
+    second.imIds << buddy1 << buddy2;
+
+    CDTpBuddyOperation unknownAccount;
+    unknownAccount.accountPath = QLatin1String("/org/freedesktop/Telepathy/Account/fakecm/fakeproto/unknown");
+    unknownAccount.imIds << buddy2;
+
+    BuddyManagementInterface *buddyIf = new BuddyManagementInterface("com.nokia.contactsd", "/telepathy", QDBusConnection::sessionBus(), 0);
+    {
+        QDBusPendingReply<QList<bool> > async = buddyIf->inviteBuddiesBatch(CDTpBuddyOperationList() << first << unknownAccount << second);
+        QDBusPendingCallWatcher watcher(async, this);
+        watcher.waitForFinished();
+        QVERIFY2(not async.isError(), async.error().message().toLatin1());
+        QVERIFY(watcher.isValid());
+        QCOMPARE(async.value(), QList<bool>() << true << false << true);
+    }
+
+    // Each buddy is added once, possibly in one notification
+    runExpectation(TestExpectationMassPtr(new TestExpectationMass(2, 0, 0)));
+
+    QContactDetailFilter filter;
+#ifdef USING_QTPIM
+    filter.setDetailType(QContactOnlineAccount::Type, QContactOnlineAccount::FieldAccountUri);
+#else
+    filter.setDetailDefinitionName(QContactOnlineAccount::DefinitionName, QContactOnlineAccount::FieldAccountUri);
+#endif
+    filter.setValue(buddy1);
+    QCOMPARE(mContactManager->contacts(filter).count(), 1);
+    filter.setValue(buddy2);
+    QCOMPARE(mContactManager->contacts(filter).count(), 1);
+}
+
 void TestTelepathyPlugin::testSetOffline()
 {
     createContact("testsetoffline", true);
@@ -598,6 +815,35 @@ void TestTelepathyPlugin::testDisable()
     mCheckLeakedResources = false;
 }
 
+void TestTelepathyPlugin::testAccountChangeWrites()
+{
+    createContact("testaccountchangewrites");
+
+    /* Changing our own presence only updates the self contact */
+    TpTestsContactsConnectionPresenceStatusIndex presence =
+            TP_TESTS_CONTACTS_CONNECTION_STATUS_AWAY;
+    const gchar *message = "Testing account changes";
+    tp_tests_contacts_connection_change_presences(
+        TP_TESTS_CONTACTS_CONNECTION (mConnService),
+        1, &mConnService->self_handle, &presence, &message);
+
+    TestExpectationContactPtr exp(new TestExpectationContact(EventChanged));
+    exp->verifyPresence(presence);
+    runExpectation(exp);
+
+    // Any contact written now would be reported without an expectation,
+    // which fails the test. Wait well past the account update delay.
+    QTest::qWait(1000);
+
+    /* Disabling the account updates the contacts: self contact gets updated,
+     * testaccountchangewrites gets removed */
+    tp_tests_simple_account_set_enabled (mAccount, FALSE);
+    runExpectation(TestExpectationMassPtr(new TestExpectationMass(0, 1, 1)));
+
+    /* FIXME: we can't verify leaked resource because some are qct's responsability */
+    mCheckLeakedResources = false;
+}
+
 void TestTelepathyPlugin::testIRIEncode()
 {
     /* Create a contact with a special id that could confuse tracker */
@@ -765,10 +1011,12 @@ void TestTelepathyPlugin::testBenchmark()
             handles->len, (TpHandle *) handles->data, "wait");
     runExpectation(TestExpectationMassPtr(new TestExpectationMass(N_CONTACTS, 0, 0)));
 
-    /* Set account offline */
-    tp_cli_connection_call_disconnect(mConnection, -1, NULL, NULL, NULL, NULL);
+    /* Set account offline, which resets the presence of every contact */
+    QBENCHMARK_ONCE {
+        tp_cli_connection_call_disconnect(mConnection, -1, NULL, NULL, NULL, NULL);
 
-    runExpectation(TestExpectationDisconnectPtr(new TestExpectationDisconnect(mContactIds.count())));
+        runExpectation(TestExpectationDisconnectPtr(new TestExpectationDisconnect(mContactIds.count())));
+    }
 }
 
 TpHandle TestTelepathyPlugin::ensureHandle(const gchar *id)
@@ -85,15 +85,21 @@ private Q_SLOTS:
     /* Generic tests */
     void testBasicUpdates();
     void testSelfContact();
+    void testSelfContactRemoved();
+    void testAccountUpdatesMerged();
     void testAuthorization();
     void testContactInfo();
     void testContactPhoneNumber();
     void testRemoveContacts();
     void testRemoveBuddyDBusAPI();
+    void testRemoveBuddiesBatchDBusAPI();
+    void testRemoveBuddiesChunked();
     void testInviteBuddyDBusAPI();
+    void testInviteBuddiesBatchDBusAPI();
     void testSetOffline();
     void testAvatar();
     void testDisable();
+    void testAccountChangeWrites();
 
     /* Specific tests */
     void testBug253679();
@@ -45,9 +45,9 @@ PKGCONFIG += TelepathyQt5
 DEFINES *= USING_QTPIM
 
 system(cp $$PWD/../../plugins/telepathy/com.nokia.contacts.buddymanagement.xml .)
-system(qdbusxml2cpp -c BuddyManagementInterface -p buddymanagementinterface.h:buddymanagementinterface.cpp com.nokia.contacts.buddymanagement.xml)
+system(qdbusxml2cpp -c BuddyManagementInterface -p buddymanagementinterface.h:buddymanagementinterface.cpp -i cdtpbuddyoperation.h com.nokia.contacts.buddymanagement.xml)
 
-INCLUDEPATH += ..
+INCLUDEPATH += .. $$PWD/../../plugins/telepathy
 QMAKE_LIBDIR += ../libtelepathy
 LIBS += -ltelepathy
 